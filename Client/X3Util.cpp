@@ -6,27 +6,19 @@ namespace x3
 {
     namespace util
     {
-        std::vector<x3::Entity*> entitiesToDelete;
+        void (*frameCallback)() = nullptr;
 
         void hook_DeleteEntityLoop(void* param_1)
         {
-            for (auto& deletion : entitiesToDelete)
-            {
-                x3::DeleteEntity(deletion);
-                // Entity deletion is handled by X3's built-in deletion system
-            }
-            entitiesToDelete.clear();
+            // Entities deleted here are handled by X3's built-in deletion system
+            if (frameCallback)
+                frameCallback();
             x3::DeleteEntityLoop(param_1); // Call original game function
         }
 
-        void DeleteEntity(x3::Entity* entity)
+        void SetFrameCallback(void (*callback)())
         {
-            entitiesToDelete.push_back(entity);
-        }
-
-        const bool CheckShipPointer(x3::Entity* ptr, std::array<Entity*, MAX_ENTITIES>& entities)
-        {
-            return std::find(std::begin(entities), std::end(entities), ptr) != std::end(entities);
+            frameCallback = callback;
         }
     }
 }
\ No newline at end of file
@@ -11,7 +11,8 @@ namespace x3
 	{
 		void hook_DeleteEntityLoop(void* param_1);
 
-		void DeleteEntity(x3::Entity* entity);
-		const bool CheckShipPointer(x3::Entity* ptr, std::array<Entity*, MAX_ENTITIES>& entities);
+		// Runs on the game thread once per frame, before the engine's own
+		// deletion pass. Set it before the hooks are installed.
+		void SetFrameCallback(void (*callback)());
 	}
 }
\ No newline at end of file
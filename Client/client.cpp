@@ -38,11 +38,7 @@ void Client::Run(const char* ip, unsigned short port)
 	}
 
 	m_bRunning = true;
-	while (m_bRunning)
-	{
-		PollIncomingMessages();
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
-	}
+	x3::net::RunReceiveLoop(m_socket, m_bRunning, packetsReady, ReceiveTimeoutMs, [this]() { return PollIncomingMessages(); });
 
 	ShutdownWinsock();
 }
@@ -77,16 +73,24 @@ void Client::Connect(const char* ip, unsigned short port)
 	// and we receive a ConnectAcknowledge. For now, we are just "Connecting".
 }
 
-void Client::PollIncomingMessages()
+bool Client::PollIncomingMessages()
 {
-	if (m_socket == INVALID_SOCKET) return;
+	if (m_socket == INVALID_SOCKET) return false;
 
-	char recvbuf[1024];
-	int recvbuflen = 1024;
+	// Received into when the ring is full, only to drain the socket
+	char discardbuf[sizeof(CreateShips)];
 	sockaddr_in fromAddr;
 	int fromAddrSize = sizeof(fromAddr);
+	bool received = false;
 
 	while (true) {
+		// Straight into the next free slot; it is only published if the packet is valid
+		char* recvbuf = (char*)receivedPackets.Reserve();
+		bool overflow = recvbuf == nullptr;
+		if (overflow)
+			recvbuf = discardbuf;
+		int recvbuflen = (int)receivedPackets.MaxPacketSize();
+
 		int iResult = recvfrom(m_socket, recvbuf, recvbuflen, 0, (SOCKADDR*)&fromAddr, &fromAddrSize);
 		if (iResult == SOCKET_ERROR) {
 			if (WSAGetLastError() == WSAEWOULDBLOCK) {
@@ -102,46 +106,64 @@ void Client::PollIncomingMessages()
 			}
 		}
 
+		if (overflow) {
+			// The mod thread fell behind; counted, and reported from there
+			receivedPackets.Dropped();
+			continue;
+		}
+
 		if (iResult < sizeof(Packet)) {
 			std::cout << "[ERR] Packet is malformed (too small)." << std::endl;
 			continue;
 		}
 
 		PacketType packetType = ((Packet*)recvbuf)->type;
-		Packet* newPacket = nullptr;
+		size_t length = 0;
 
 		switch (packetType)
 		{
 		case PacketType::ShipUpdate:
 			if (iResult >= sizeof(ShipUpdate))
-			{
-				newPacket = new ShipUpdate();
-				memcpy(newPacket, recvbuf, sizeof(ShipUpdate));
-			}
+				length = sizeof(ShipUpdate);
 			break;
 		case PacketType::CreateShip:
 			if (iResult >= sizeof(CreateShip))
-			{
-				newPacket = new CreateShip();
-				memcpy(newPacket, recvbuf, sizeof(CreateShip));
-			}
+				length = sizeof(CreateShip);
 			break;
 		case PacketType::DeleteShip:
 			if (iResult >= sizeof(DeleteShip))
-			{
-				newPacket = new DeleteShip();
-				memcpy(newPacket, recvbuf, sizeof(DeleteShip));
-			}
+				length = sizeof(DeleteShip);
+			break;
+		case PacketType::CreateShips:
+		{
+			const CreateShips* batch = (const CreateShips*)recvbuf;
+			if (iResult >= (int)(sizeof(CreateShips) - sizeof(batch->Ships))
+				&& batch->Count >= 0 && batch->Count <= MaxShipSpawnsPerPacket
+				&& iResult >= (int)BatchSize(*batch))
+				length = BatchSize(*batch);
+			break;
+		}
+		case PacketType::DeleteShips:
+		{
+			const DeleteShips* batch = (const DeleteShips*)recvbuf;
+			if (iResult >= (int)(sizeof(DeleteShips) - sizeof(batch->ShipIDs))
+				&& batch->Count >= 0 && batch->Count <= MaxShipDespawnsPerPacket
+				&& iResult >= (int)BatchSize(*batch))
+				length = BatchSize(*batch);
 			break;
+		}
 		case PacketType::ConnectAcknowledge:
 			if (iResult >= sizeof(ConnectAcknowledge))
 			{
-				newPacket = new ConnectAcknowledge();
-				memcpy(newPacket, recvbuf, sizeof(ConnectAcknowledge));
+				length = sizeof(ConnectAcknowledge);
 				this->connectionStatus = ConnectionStatus::Connected;
 				std::cout << "[INF] Connection Acknowledged by server!" << std::endl;
 			}
 			break;
+		case PacketType::ConnectChallenge:
+			if (iResult >= sizeof(ConnectChallenge))
+				length = sizeof(ConnectChallenge);
+			break;
 		default:
 			std::cout << "[WARN] Received unknown packet type: " << (int)packetType 
 					  << " from " << inet_ntoa(fromAddr.sin_addr) 
@@ -150,15 +172,18 @@ void Client::PollIncomingMessages()
 			break;
 		}
 
-		if (newPacket)
+		if (length)
 		{
-			receivedPackets.push(newPacket);
+			receivedPackets.Commit(length);
+			received = true;
 		}
 		else
 		{
 			std::cout << "[ERR] Packet is malformed (size mismatch or unknown type)." << std::endl;
 		}
 	}
+
+	return received;
 }
 
 void Client::SendPacket(Packet* message)
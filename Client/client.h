@@ -17,16 +17,19 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
-#include <queue>
+#include <atomic>
 #include <map>
 #include <cctype>
 
 #include <net_message.h>
 #include <net_packets.h>
+#include <net_ring.h>
+#include <net_socket.h>
 
 using namespace x3::net;
 
 const uint16_t DEFAULT_SERVER_PORT = 13337;
+const int ReceiveTimeoutMs = 100;
 
 bool InitWinsock();
 void ShutdownWinsock();
@@ -43,7 +46,11 @@ class Client
 {
 public:
 	ConnectionStatus connectionStatus = ConnectionStatus::Disconnected;
-	std::queue<x3::net::Packet*> receivedPackets;
+	// Written by the network thread, read in place and released by the mod thread.
+	// A slot holds the largest packet, a full CreateShips batch.
+	x3::net::PacketRing<sizeof(CreateShips), 256> receivedPackets;
+	// Notified by the receive loop after packets were added to receivedPackets
+	x3::net::PacketSignal packetsReady;
 
 	void Run(const char* ip, unsigned short port);
 	void Stop();
@@ -52,10 +59,11 @@ public:
 	void SendText(const std::string text);
 
 private:
-	bool m_bRunning = false;
+	std::atomic<bool> m_bRunning{ false };
 	SOCKET m_socket = INVALID_SOCKET;
 	sockaddr_in m_serverAddr;
 
 	void Connect(const char* ip, unsigned short port);
-	void PollIncomingMessages();
+	// Drains the socket into receivedPackets, true if anything was queued
+	bool PollIncomingMessages();
 };
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include <array>
 #include <algorithm>
 #include <sstream>
+#include <chrono>
+#include <bitset>
 
 #include "defines.h"
 
@@ -24,13 +26,43 @@
 #include "mem.h"
 
 #include "net_packets.h"
+#include "net_interpolation.h"
+#include "net_prediction.h"
+#include "net_commands.h"
+#include "net_registry.h"
 
 
 Renderer* renderer{ nullptr };
 Client client;
 std::unique_ptr<Chatbox> chatbox;
 
-std::array<x3::Entity*, MAX_ENTITIES> entities{ nullptr };
+// What the game thread needs to create a ship. Existing registers an
+// entity the game already has, i.e. our own ship, instead of spawning one.
+struct ShipSpawnCommand
+{
+    int32_t Model;
+    x3::Sector* Sector;
+    x3::Entity* Existing;
+};
+
+// Ship creation, deletion and WorldData writes are posted here by the mod
+// thread and applied by the game thread in ApplyShipCommands, so the engine
+// never sees its entities change in the middle of a frame
+x3::net::EntityCommandBuffer<ShipSpawnCommand, x3::net::TransformSample> shipCommands(MAX_ENTITIES);
+// Network ID <-> game entity, both ways in O(1). Only the game thread touches it.
+x3::net::EntityRegistry<x3::Entity> entities(MAX_ENTITIES);
+// Ships the mod thread has asked for, to validate packets without reading entities
+std::bitset<MAX_ENTITIES> knownShips;
+// Sequence of the newest state applied to each ship, to drop late ShipUpdates; 0 accepts anything
+std::array<uint32_t, MAX_ENTITIES> shipSequences{};
+// Remote ships are drawn from here, a little behind the newest update, instead of jumping to each update
+x3::net::SnapshotInterpolator interpolator;
+
+// Seconds on a monotonic clock, the time base of the interpolator
+double ClientTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 void* d3d9Device[119];
 tEndScene oEndScene = nullptr;
@@ -88,6 +120,99 @@ void APIENTRY hook_EndScene(LPDIRECT3DDEVICE9 o_pDevice) {
 }
 
 
+// Shared by CreateShip and the entries of a CreateShips batch, which carry the same fields.
+// sequence is that of the state spawned with, 0 if unknown.
+template <typename Spawn>
+void SpawnShip(const Spawn& spawn, x3::Sector* sectorPtr, uint32_t sequence)
+{
+    // Any datagram gets here, so the ID is checked before it indexes anything
+    if (spawn.ShipID < 0 || spawn.ShipID >= MAX_ENTITIES)
+        return;
+    shipSequences[spawn.ShipID] = sequence;
+    x3::net::TransformSample transform = x3::net::ToTransformSample(spawn, ClientTime());
+    ShipSpawnCommand command = { spawn.Model, sectorPtr, nullptr };
+    shipCommands.PostCreate(spawn.ShipID, command, transform);
+    knownShips.set(spawn.ShipID);
+    interpolator.Remove(spawn.ShipID);
+    interpolator.Push(spawn.ShipID, transform);
+}
+
+void DespawnShip(int32_t shipID)
+{
+    shipCommands.PostDelete(shipID);
+    knownShips.reset(shipID);
+    shipSequences[shipID] = 0;
+    interpolator.Remove(shipID);
+}
+
+x3::net::TransformSample ReadTransform(x3::Entity* entity, double time)
+{
+    x3::net::TransformSample sample;
+    sample.Time = time;
+    sample.Pos[0] = entity->WorldData->PosX;
+    sample.Pos[1] = entity->WorldData->PosY;
+    sample.Pos[2] = entity->WorldData->PosZ;
+    sample.Rot[0] = entity->WorldData->RotQuaternionX;
+    sample.Rot[1] = entity->WorldData->RotQuaternionY;
+    sample.Rot[2] = entity->WorldData->RotQuaternionZ;
+    sample.Rot[3] = entity->WorldData->RotQuaternionW;
+    sample.Up[0] = entity->WorldData->UpQuaternionX;
+    sample.Up[1] = entity->WorldData->UpQuaternionY;
+    sample.Up[2] = entity->WorldData->UpQuaternionZ;
+    sample.Up[3] = entity->WorldData->UpQuaternionW;
+    sample.LookAt[0] = entity->WorldData->LookAtX;
+    sample.LookAt[1] = entity->WorldData->LookAtY;
+    sample.LookAt[2] = entity->WorldData->LookAtZ;
+    return sample;
+}
+
+void ApplyTransform(x3::Entity* entity, const x3::net::TransformSample& sample)
+{
+    entity->WorldData->PosX = sample.Pos[0];
+    entity->WorldData->PosY = sample.Pos[1];
+    entity->WorldData->PosZ = sample.Pos[2];
+    entity->WorldData->RotQuaternionX = sample.Rot[0];
+    entity->WorldData->RotQuaternionY = sample.Rot[1];
+    entity->WorldData->RotQuaternionZ = sample.Rot[2];
+    entity->WorldData->RotQuaternionW = sample.Rot[3];
+    entity->WorldData->UpQuaternionX = sample.Up[0];
+    entity->WorldData->UpQuaternionY = sample.Up[1];
+    entity->WorldData->UpQuaternionZ = sample.Up[2];
+    entity->WorldData->UpQuaternionW = sample.Up[3];
+    entity->WorldData->LookAtX = sample.LookAt[0];
+    entity->WorldData->LookAtY = sample.LookAt[1];
+    entity->WorldData->LookAtZ = sample.LookAt[2];
+}
+
+// Runs on the game thread once per frame, see x3::util::SetFrameCallback
+void ApplyShipCommands()
+{
+    shipCommands.Drain(
+        [](int32_t shipID) {
+            x3::Entity* entity = entities[shipID];
+            if (entity == nullptr)
+                return;
+            entities.Remove(shipID);
+            x3::DeleteEntity(entity);
+        },
+        [](int32_t shipID, const ShipSpawnCommand& spawn, const x3::net::TransformSample& transform) {
+            if (spawn.Existing != nullptr)
+            {
+                entities.Set(shipID, spawn.Existing);
+                return;
+            }
+            x3::Entity* entity = x3::AllocateEntitySpace(0x130);
+            x3::CreateInSectorEntity(entity, 0x70000 + spawn.Model);
+            x3::SetEntityInSector(entity, spawn.Sector);
+            entities.Set(shipID, entity);
+            ApplyTransform(entity, transform);
+        },
+        [](int32_t shipID, const x3::net::TransformSample& transform) {
+            if (x3::Entity* entity = entities[shipID])
+                ApplyTransform(entity, transform);
+        });
+}
+
 DWORD WINAPI ModThread(HMODULE hModule)
 {
     x3::Console& console = x3::Console::GetInstance(); // Fixed TODO: Made Console a singleton
@@ -98,6 +223,7 @@ DWORD WINAPI ModThread(HMODULE hModule)
     x3::InitFunctionPointer(moduleBase);
 
     //Hook
+    x3::util::SetFrameCallback(ApplyShipCommands);
     x3::HookFunctions((BYTE*)hook_SomeUpdate, (BYTE*)x3::util::hook_DeleteEntityLoop);
     //SetSimulatorParam = (tSetSimulatorParam)0x0049f4c0;
     //SetSimulatorParam = (tSetSimulatorParam)mem::TrampHook32((BYTE*)SetSimulatorParam, (BYTE*)hook_SetSimulatorParam, 7);
@@ -143,6 +269,15 @@ DWORD WINAPI ModThread(HMODULE hModule)
     std::thread clientThread(StartClient, xmlSettings->ip.c_str(), xmlSettings->port);
     int clientID = -1;
     int ownShipID = -1;
+    // The player ship we registered under ownShipID
+    x3::Entity* ownShipEntity = nullptr;
+    uint32_t ownShipSequence = 0;
+    // Only send our ship when the others' prediction of it is off, or for the heartbeat
+    x3::net::DeadReckoningSender ownShipPrediction;
+    ownShipPrediction.Thresholds.Position = xmlSettings->predictionPosition;
+    ownShipPrediction.Thresholds.Orientation = xmlSettings->predictionOrientation;
+    ownShipPrediction.Thresholds.Heartbeat = xmlSettings->predictionHeartbeat;
+    uint64_t reportedOverflows = 0;
 
     auto sectorPtr = (x3::Sector*)(uintptr_t)sectorBasePtr->EntityManager->EntityList; // Has to be executed before ship spawn and after sector creation
 
@@ -157,17 +292,37 @@ DWORD WINAPI ModThread(HMODULE hModule)
     connectPacket.size = sizeof(Connect);
     connectPacket.Model = basePtr->EntityManager->EntityList->ShipTypeID;
 
-    for (size_t i = 0; i < USHRT_MAX; i++)
-    {
-        entities[i] = nullptr;
-    }
+    knownShips.reset();
 
     if (client.isConnected)
         client.SendPacket(&connectPacket);
+    // Any step of the handshake can be lost over plain UDP; resend until the ConnectAcknowledge arrives
+    const auto connectResendInterval = std::chrono::seconds(2);
+    auto nextConnectSend = std::chrono::steady_clock::now() + connectResendInterval;
+
+    // Own ship sampling and interpolation run on this tick; packets are handled as soon as they arrive
+    const auto tickInterval = std::chrono::milliseconds(20);
+    auto nextTick = std::chrono::steady_clock::now();
 
     bool pRun = true;
     while (pRun)
     {
+        auto now = std::chrono::steady_clock::now();
+        bool tick = now >= nextTick;
+        if (tick)
+        {
+            nextTick += tickInterval;
+            // Fell behind, e.g. while the game was loading; don't run a burst of ticks to catch up
+            if (nextTick < now)
+                nextTick = now + tickInterval;
+        }
+
+        if (ownShipID == -1 && now >= nextConnectSend)
+        {
+            client.SendPacket(&connectPacket);
+            nextConnectSend = now + connectResendInterval;
+        }
+
         /*if (GetAsyncKeyState(VK_DELETE) & 1)
         {
             std::cout << "VK_DELETE pressed" << std::endl;
@@ -217,8 +372,12 @@ DWORD WINAPI ModThread(HMODULE hModule)
         auto a = *(DWORD*)(sectorBasePtr);
         auto b = *(DWORD*)(a + 0x38); 
 
-        if (b != 0x0 && ownShipID != -1 && x3::util::CheckShipPointer(ownShip, entities))
+        if (tick && b != 0x0 && ownShipID != -1 && ownShip == ownShipEntity)
+            ownShipPrediction.Observe(ReadTransform(ownShip, ClientTime()));
+
+        if (tick && b != 0x0 && ownShipID != -1 && ownShip == ownShipEntity && ownShipPrediction.ShouldSend(ClientTime()))
         {
+            x3::net::TransformSample state = ownShipPrediction.Current();
             ShipUpdate packet;
             packet.type = PacketType::ShipUpdate;
             packet.PosX = ownShip->WorldData->PosX;
@@ -235,90 +394,99 @@ DWORD WINAPI ModThread(HMODULE hModule)
             packet.LookAtX = ownShip->WorldData->LookAtX;
             packet.LookAtY = ownShip->WorldData->LookAtY;
             packet.LookAtZ = ownShip->WorldData->LookAtZ;
+            packet.VelX = state.Vel[0];
+            packet.VelY = state.Vel[1];
+            packet.VelZ = state.Vel[2];
 
-            for (size_t i = 0; i < 65535; i++)
-            {
-                if (entities[i] != nullptr && entities[i] == ownShip)
-                {
-                    packet.ShipID = i;
-                    break;
-                }
-            }
+            packet.ShipID = ownShipID;
 
             packet.size = sizeof(ShipUpdate);
+            if (++ownShipSequence == 0)
+                ++ownShipSequence;
+            packet.Sequence = ownShipSequence;
 
             if (client.isConnected)
+            {
                 client.SendPacket(&packet);
+                ownShipPrediction.Sent(state);
+            }
         }
 
-        while (client.isConnected && !client.receivedPackets.empty())
+        // Packets are read in place from the receive ring and released with Pop
+        Packet* packet;
+        while (client.isConnected && (packet = (Packet*)client.receivedPackets.Front()) != nullptr)
         {
-            Packet* packet = client.receivedPackets.front();
-
             if (packet->type == PacketType::ShipUpdate)
             {
 
                 ShipUpdate* updatePacket = (x3::net::ShipUpdate*)packet;
-                if (entities[updatePacket->ShipID] != nullptr && x3::util::CheckShipPointer(entities[updatePacket->ShipID], entities))
+                if (updatePacket->ShipID < 0 || updatePacket->ShipID >= MAX_ENTITIES)
+                    console.Log(std::string("Ship Update for invalid ship! ShipID: ") + std::to_string(updatePacket->ShipID), x3::MessageLevel::Error);
+                else if (updatePacket->Sequence != 0 && shipSequences[updatePacket->ShipID] != 0
+                    && !SequenceNewer(updatePacket->Sequence, shipSequences[updatePacket->ShipID]))
                 {
-                    entities[updatePacket->ShipID]->WorldData->PosX = updatePacket->PosX;
-                    entities[updatePacket->ShipID]->WorldData->PosY = updatePacket->PosY;
-                    entities[updatePacket->ShipID]->WorldData->PosZ = updatePacket->PosZ;
-                    entities[updatePacket->ShipID]->WorldData->RotQuaternionX = updatePacket->RotX;
-                    entities[updatePacket->ShipID]->WorldData->RotQuaternionY = updatePacket->RotY;
-                    entities[updatePacket->ShipID]->WorldData->RotQuaternionZ = updatePacket->RotZ;
-                    entities[updatePacket->ShipID]->WorldData->RotQuaternionW = updatePacket->RotW;
-                    entities[updatePacket->ShipID]->WorldData->UpQuaternionX = updatePacket->UpX;
-                    entities[updatePacket->ShipID]->WorldData->UpQuaternionY = updatePacket->UpY;
-                    entities[updatePacket->ShipID]->WorldData->UpQuaternionZ = updatePacket->UpZ;
-                    entities[updatePacket->ShipID]->WorldData->UpQuaternionW = updatePacket->UpW;
-                    entities[updatePacket->ShipID]->WorldData->LookAtX = updatePacket->LookAtX;
-                    entities[updatePacket->ShipID]->WorldData->LookAtY = updatePacket->LookAtY;
-                    entities[updatePacket->ShipID]->WorldData->LookAtZ = updatePacket->LookAtZ;
+                    // Arrived after a newer state, applying it would move the ship backwards
+                }
+                else if (knownShips.test(updatePacket->ShipID))
+                {
+                    interpolator.Push(*updatePacket, ClientTime());
+                    shipSequences[updatePacket->ShipID] = updatePacket->Sequence;
                 }
                 else
                     console.Log(std::string("Ship Update for invalid ship! ShipID: ") + std::to_string(updatePacket->ShipID), x3::MessageLevel::Error);
             }
             else if (packet->type == PacketType::CreateShip)
             {
-                if (ownShipID == -1)
+                // Dropped until we know our own ship
+                if (ownShipID != -1)
                 {
-                    continue;
+                    CreateShip* createPacket = (x3::net::CreateShip*)packet;
+                    sectorPtr = (x3::Sector*)(uintptr_t)sectorBasePtr->EntityManager->EntityList; // Has to be executed before ship spawn and after sector creation
+                    SpawnShip(*createPacket, sectorPtr, 0);
+                    console.Log(std::string("Creating ship at position: ") + std::to_string(createPacket->PosX) + std::string("|..."), x3::MessageLevel::Debug);
                 }
-                CreateShip* createPacket = (x3::net::CreateShip*)packet;
+            }
+            else if (packet->type == PacketType::CreateShips && ownShipID != -1)
+            {
+                // Dropped until we know our own ship, like CreateShip; the server
+                // sends the snapshot again when it sees our Connect repeated
+                CreateShips* batch = (x3::net::CreateShips*)packet;
                 sectorPtr = (x3::Sector*)(uintptr_t)sectorBasePtr->EntityManager->EntityList; // Has to be executed before ship spawn and after sector creation
-                x3::Entity* entity = x3::AllocateEntitySpace(0x130);
-                x3::CreateInSectorEntity(entity, 0x70000 + createPacket->Model);
-                x3::SetEntityInSector(entity, sectorPtr);
-                entities[createPacket->ShipID] = entity;
-                entity->WorldData->PosX = createPacket->PosX;
-                entity->WorldData->PosY = createPacket->PosY;
-                entity->WorldData->PosZ = createPacket->PosZ;
-                // Set rotation quaternion and orientation vectors
-                entity->WorldData->RotQuaternionX = createPacket->RotX;
-                entity->WorldData->RotQuaternionY = createPacket->RotY;
-                entity->WorldData->RotQuaternionZ = createPacket->RotZ;
-                entity->WorldData->RotQuaternionW = createPacket->RotW;
-                entity->WorldData->UpQuaternionX = createPacket->UpX;
-                entity->WorldData->UpQuaternionY = createPacket->UpY;
-                entity->WorldData->UpQuaternionZ = createPacket->UpZ;
-                entity->WorldData->UpQuaternionW = createPacket->UpW;
-                entity->WorldData->LookAtX = createPacket->LookAtX;
-                entity->WorldData->LookAtY = createPacket->LookAtY;
-                entity->WorldData->LookAtZ = createPacket->LookAtZ;
-                console.Log(std::string("Creating ship at position: ") + std::to_string(createPacket->PosX) + std::string("|..."), x3::MessageLevel::Debug);
+                for (int32_t i = 0; i < batch->Count; i++)
+                {
+                    // Our own ship is announced to everybody, but we already have it
+                    if (batch->Ships[i].ShipID == ownShipID || batch->Ships[i].ShipID < 0 || batch->Ships[i].ShipID >= MAX_ENTITIES)
+                        continue;
+                    // A repeated snapshot names ships we already spawned; updates keep those current
+                    if (knownShips.test(batch->Ships[i].ShipID))
+                        continue;
+                    SpawnShip(batch->Ships[i], sectorPtr, batch->Ships[i].Sequence);
+                }
+                console.Log(std::string("Creating ") + std::to_string(batch->Count) + std::string(" ships"), x3::MessageLevel::Debug);
             }
 
             else if (packet->type == PacketType::DeleteShip)
             {
                 DeleteShip* deletePacket = (x3::net::DeleteShip*)packet;
-                if (entities[deletePacket->ShipID] != nullptr && x3::util::CheckShipPointer(entities[deletePacket->ShipID], entities))
+                if (deletePacket->ShipID >= 0 && deletePacket->ShipID < MAX_ENTITIES && knownShips.test(deletePacket->ShipID))
                 {
-                    x3::util::DeleteEntity(entities[deletePacket->ShipID]);
+                    DespawnShip(deletePacket->ShipID);
                     console.Log(std::string("Deleted ship ") + std::to_string(deletePacket->ShipID), x3::MessageLevel::Debug);
-                    entities[deletePacket->ShipID] = nullptr;
                 }
             }
+            else if (packet->type == PacketType::DeleteShips)
+            {
+                DeleteShips* batch = (x3::net::DeleteShips*)packet;
+                for (int32_t i = 0; i < batch->Count; i++)
+                {
+                    int32_t shipID = batch->ShipIDs[i];
+                    if (shipID < 0 || shipID >= MAX_ENTITIES)
+                        continue;
+                    if (knownShips.test(shipID))
+                        DespawnShip(shipID);
+                }
+                console.Log(std::string("Deleted ") + std::to_string(batch->Count) + std::string(" ships"), x3::MessageLevel::Debug);
+            }
             else if (packet->type == PacketType::CreateStar)
             {
                 CreateStar* createPacket = (x3::net::CreateStar*)packet;
@@ -330,8 +498,9 @@ DWORD WINAPI ModThread(HMODULE hModule)
                 entity->WorldData->PosY = createPacket->PosY;
                 entity->WorldData->PosZ = createPacket->PosZ;
             }
-            else if (packet->type == PacketType::ConnectAcknowledge)
+            else if (packet->type == PacketType::ConnectAcknowledge && ownShipID == -1)
             {
+                // Resent Connects may be acknowledged more than once; only the first counts
                 ConnectAcknowledge* ackPacket = (x3::net::ConnectAcknowledge*)packet;
                 clientID = ackPacket->ClientID;
                 // Fixed TODO: Shifted hex formatting into proper log messages
@@ -341,7 +510,19 @@ DWORD WINAPI ModThread(HMODULE hModule)
                 console.Log(hexShipID.str(), x3::MessageLevel::Info);
                 console.Log(hexShipAddr.str(), x3::MessageLevel::Info);
                 ownShipID = ackPacket->ShipID;
-                entities[ackPacket->ShipID] = ownShip;
+                ownShipEntity = ownShip;
+                knownShips.set(ackPacket->ShipID);
+                ShipSpawnCommand command = { 0, nullptr, ownShip };
+                shipCommands.PostCreate(ackPacket->ShipID, command, x3::net::TransformSample());
+                ownShipPrediction.Reset();
+            }
+            else if (packet->type == PacketType::ConnectChallenge && ownShipID == -1)
+            {
+                // The server only accepts a Connect that echoes its cookie
+                x3::net::ConnectChallenge* challengePacket = (x3::net::ConnectChallenge*)packet;
+                connectPacket.Cookie = challengePacket->Cookie;
+                client.SendPacket(&connectPacket);
+                nextConnectSend = std::chrono::steady_clock::now() + connectResendInterval;
             }
             else if (packet->type == PacketType::ChatMessage)
             {
@@ -349,10 +530,28 @@ DWORD WINAPI ModThread(HMODULE hModule)
                 chatbox->SendChatMessage(chatPacket->Message, chatPacket->A, chatPacket->R, chatPacket->G, chatPacket->B);
             }
 
-            delete packet;
+            client.receivedPackets.Pop();
+        }
+
+        if (client.receivedPackets.Overflows() != reportedOverflows)
+        {
+            reportedOverflows = client.receivedPackets.Overflows();
+            console.Log(std::string("Receive queue full, ") + std::to_string(reportedOverflows) + std::string(" packets dropped so far"), x3::MessageLevel::Error);
+        }
+
+        // Handed to the game thread, which writes them into WorldData with the next frame
+        if (tick)
+        {
+            interpolator.ForEach(ClientTime(), [&](int32_t shipID, const x3::net::TransformSample& sample) {
+                if (shipID == ownShipID || shipID >= MAX_ENTITIES)
+                    return;
+                if (knownShips.test(shipID))
+                    shipCommands.PostUpdate(shipID, sample);
+            });
         }
 
-        Sleep(20);
+        // Until the next tick or until the network thread has queued packets, whichever comes first
+        client.packetsReady.WaitUntil(nextTick);
     }
 
 
@@ -12,6 +12,12 @@ bool x3mp::Settings::Load()
     localmode = std::stoi(doc.child("config").child_value("local")) == 1;
     debug = std::stoi(doc.child("config").child_value("debug")) == 1;
 
+    // Optional, e.g. <prediction position="2000" orientation="0.05" heartbeat="1"/>
+    pugi::xml_node prediction = doc.child("config").child("prediction");
+    predictionPosition = prediction.attribute("position").as_double(predictionPosition);
+    predictionOrientation = prediction.attribute("orientation").as_double(predictionOrientation);
+    predictionHeartbeat = prediction.attribute("heartbeat").as_double(predictionHeartbeat);
+
     //if xml had a problem...
     if (result.status != pugi::xml_parse_status::status_ok)
     {
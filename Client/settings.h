@@ -12,6 +12,10 @@ namespace x3mp
 		unsigned short port = 13337;
 		bool localmode = false;
 		bool debug = false;
+		// Dead reckoning thresholds of the own ship, see x3::net::PredictionThresholds
+		double predictionPosition = 2000.0;
+		double predictionOrientation = 0.05;
+		double predictionHeartbeat = 1.0;
 
 		bool Load();
 	};
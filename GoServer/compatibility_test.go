@@ -23,8 +23,8 @@ func serializePacket(p interface{}) ([]byte, error) {
 	case network.ConnectPacket:
 		// Define type and size for this packet.
 		packetType := network.Connect
-		// Size = sizeof(type) + sizeof(size) + sizeof(model) + sizeof(name)
-		packetSize := uint32(4 + 4 + 2 + 64)
+		// Size = sizeof(type) + sizeof(size) + sizeof(model) + sizeof(name) + sizeof(cookie)
+		packetSize := uint32(4 + 4 + 2 + 64 + 8)
 
 		// Write fields in order.
 		if err := binary.Write(buf, binary.LittleEndian, packetType); err != nil {
@@ -39,13 +39,16 @@ func serializePacket(p interface{}) ([]byte, error) {
 		if err := binary.Write(buf, binary.LittleEndian, pkt.Name); err != nil {
 			return nil, err
 		}
+		if err := binary.Write(buf, binary.LittleEndian, pkt.Cookie); err != nil {
+			return nil, err
+		}
 
 		return buf.Bytes(), nil
 
 	case network.ShipUpdatePacket:
 		packetType := network.ShipUpdate
-		// Size = type(4) + size(4) + 15*int32(60) = 68
-		packetSize := uint32(4 + 4 + (15 * 4))
+		// Size = type(4) + size(4) + 15*int32(60) + sequence(4) + 3*int32(12) = 84
+		packetSize := uint32(4 + 4 + (15 * 4) + 4 + (3 * 4))
 
 		if err := binary.Write(buf, binary.LittleEndian, packetType); err != nil {
 			return nil, err
@@ -98,6 +101,18 @@ func serializePacket(p interface{}) ([]byte, error) {
 		if err := binary.Write(buf, binary.LittleEndian, pkt.LookAtZ); err != nil {
 			return nil, err
 		}
+		if err := binary.Write(buf, binary.LittleEndian, pkt.Sequence); err != nil {
+			return nil, err
+		}
+		if err := binary.Write(buf, binary.LittleEndian, pkt.VelX); err != nil {
+			return nil, err
+		}
+		if err := binary.Write(buf, binary.LittleEndian, pkt.VelY); err != nil {
+			return nil, err
+		}
+		if err := binary.Write(buf, binary.LittleEndian, pkt.VelZ); err != nil {
+			return nil, err
+		}
 
 		return buf.Bytes(), nil
 
@@ -106,6 +121,52 @@ func serializePacket(p interface{}) ([]byte, error) {
 	}
 }
 
+// connectWithChallenge connects the way the C++ client does: the first Connect
+// is answered with a ConnectChallenge, and the Connect is sent again carrying
+// its cookie.
+func connectWithChallenge(t *testing.T, conn net.Conn, connectPkt network.ConnectPacket) network.ConnectAcknowledgePacket {
+	t.Helper()
+	response := make([]byte, 1024)
+	for attempt := 0; attempt < 2; attempt++ {
+		packetBytes, err := serializePacket(connectPkt)
+		if err != nil {
+			t.Fatalf("Failed to serialize connect packet: %v", err)
+		}
+		if _, err := conn.Write(packetBytes); err != nil {
+			t.Fatalf("Failed to send connect packet: %v", err)
+		}
+
+		n, err := conn.Read(response)
+		if err != nil {
+			t.Fatalf("Failed to read response from server: %v", err)
+		}
+		header, err := network.DecodeHeader(response[:n])
+		if err != nil {
+			t.Fatalf("Failed to decode response header: %v", err)
+		}
+
+		switch header.Type {
+		case network.ConnectChallenge:
+			var challengePkt network.ConnectChallengePacket
+			if err := network.FromBytes(response[:n], &challengePkt); err != nil {
+				t.Fatalf("Failed to deserialize connect challenge packet: %v", err)
+			}
+			connectPkt.Cookie = challengePkt.Cookie
+		case network.ConnectAcknowledge:
+			var ackPkt network.ConnectAcknowledgePacket
+			// The server sends back a standard Go-serialized struct, so FromBytes should work.
+			if err := network.FromBytes(response[:n], &ackPkt); err != nil {
+				t.Fatalf("Failed to deserialize connect acknowledge packet: %v", err)
+			}
+			return ackPkt
+		default:
+			t.Fatalf("Expected ConnectChallenge or ConnectAcknowledge, but got type %d", header.Type)
+		}
+	}
+	t.Fatalf("Server kept challenging a Connect that echoed its cookie")
+	return network.ConnectAcknowledgePacket{}
+}
+
 func TestServerGameStateUpdate(t *testing.T) {
 	// Skip this test in CI environment due to functional issues that need more investigation
 	if os.Getenv("CI") != "" {
@@ -135,21 +196,7 @@ func TestServerGameStateUpdate(t *testing.T) {
 
 	connectPkt := network.ConnectPacket{Model: 1}
 	copy(connectPkt.Name[:], "TestClientForUpdate")
-	packetBytes, _ := serializePacket(connectPkt)
-	if _, err := conn.Write(packetBytes); err != nil {
-		t.Fatalf("Failed to write connect packet: %v", err)
-	}
-
-	response := make([]byte, 1024)
-	n, err := conn.Read(response)
-	if err != nil {
-		t.Fatalf("Failed to read connect response: %v", err)
-	}
-
-	var ackPkt network.ConnectAcknowledgePacket
-	if err := network.FromBytes(response[:n], &ackPkt); err != nil {
-		t.Fatalf("Failed to deserialize response: %v", err)
-	}
+	ackPkt := connectWithChallenge(t, conn, connectPkt)
 
 	shipID := ackPkt.ShipID
 
@@ -219,31 +266,8 @@ func TestServerClientConnection(t *testing.T) {
 	}
 	copy(connectPkt.Name[:], "CompatTestClient")
 
-	packetBytes, err := serializePacket(connectPkt)
-	if err != nil {
-		t.Fatalf("Failed to serialize connect packet: %v", err)
-	}
-
-	// 4. Send the packet
-	_, err = conn.Write(packetBytes)
-	if err != nil {
-		t.Fatalf("Failed to send connect packet: %v", err)
-	}
-
-	// 5. Wait for a response
-	response := make([]byte, 1024)
-	n, err := conn.Read(response)
-	if err != nil {
-		t.Fatalf("Failed to read response from server: %v", err)
-	}
-
-	// 6. Deserialize and verify the response
-	var ackPkt network.ConnectAcknowledgePacket
-	// The server sends back a standard Go-serialized struct, so FromBytes should work.
-	err = network.FromBytes(response[:n], &ackPkt)
-	if err != nil {
-		t.Fatalf("Failed to deserialize connect acknowledge packet: %v", err)
-	}
+	// 4. Send the packet, answer the challenge and wait for the acknowledge
+	ackPkt := connectWithChallenge(t, conn, connectPkt)
 
 	if ackPkt.Header.Type != network.ConnectAcknowledge {
 		t.Errorf("Expected ConnectAcknowledge packet, but got type %d", ackPkt.Header.Type)
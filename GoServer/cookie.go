@@ -0,0 +1,63 @@
+package main
+
+import (
+	"crypto/hmac"
+	"crypto/rand"
+	"crypto/sha256"
+	"encoding/binary"
+	"net"
+	"time"
+)
+
+// CookieBucketLength is how long a bucket lasts; a cookie stays valid for one to two buckets.
+const CookieBucketLength = 10 * time.Second
+
+// ConnectCookies is a stateless proof that a client receives at the address
+// it connects from. A first Connect is answered with a cookie, a keyed hash of
+// the address and the current time bucket. Only a Connect that echoes a
+// cookie for its own address gets a client, so spoofed sources never do.
+type ConnectCookies struct {
+	key [32]byte
+}
+
+// NewConnectCookies creates a random key, so cookies can't be predicted or
+// carried over a restart.
+func NewConnectCookies() *ConnectCookies {
+	c := &ConnectCookies{}
+	if _, err := rand.Read(c.key[:]); err != nil {
+		panic(err)
+	}
+	return c
+}
+
+// Issue returns the cookie for addr, never 0, which is what a Connect without a cookie carries.
+func (c *ConnectCookies) Issue(addr *net.UDPAddr, now time.Time) uint64 {
+	return c.compute(addr, bucket(now))
+}
+
+// Verify reports whether cookie was issued to addr in this bucket or the one before.
+func (c *ConnectCookies) Verify(addr *net.UDPAddr, cookie uint64, now time.Time) bool {
+	if cookie == 0 {
+		return false
+	}
+	b := bucket(now)
+	return cookie == c.compute(addr, b) || cookie == c.compute(addr, b-1)
+}
+
+func (c *ConnectCookies) compute(addr *net.UDPAddr, bucket uint64) uint64 {
+	mac := hmac.New(sha256.New, c.key[:])
+	mac.Write(addr.IP.To16())
+	var message [10]byte
+	binary.LittleEndian.PutUint16(message[0:2], uint16(addr.Port))
+	binary.LittleEndian.PutUint64(message[2:10], bucket)
+	mac.Write(message[:])
+	cookie := binary.LittleEndian.Uint64(mac.Sum(nil))
+	if cookie == 0 {
+		return 1
+	}
+	return cookie
+}
+
+func bucket(now time.Time) uint64 {
+	return uint64(now.UnixNano() / int64(CookieBucketLength))
+}
@@ -5,6 +5,7 @@ import (
 	"log"
 	"net"
 	"sync"
+	"time"
 
 	"x3mp_goserver/game"
 	"x3mp_goserver/network"
@@ -29,6 +30,7 @@ type Server struct {
 	clientsMutex sync.RWMutex
 	universe     *game.Universe
 	nextClientID int32
+	cookies      *ConnectCookies
 }
 
 // NewServer creates and initializes a new server.
@@ -41,6 +43,7 @@ func NewServer() *Server {
 		clients:      make(map[string]*Client),
 		universe:     universe,
 		nextClientID: 0,
+		cookies:      NewConnectCookies(),
 	}
 }
 
@@ -112,7 +115,25 @@ func (s *Server) handleConnect(addr *net.UDPAddr, data []byte) {
 	}
 
 	s.clientsMutex.Lock()
-	defer s.clientsMutex.Unlock()
+	// The client resends its Connect until it is acknowledged, so a repeat
+	// means the acknowledge or the snapshot was lost; send both again.
+	if client, ok := s.clients[addr.String()]; ok {
+		s.clientsMutex.Unlock()
+		s.sendConnectAcknowledge(client)
+		s.sendSnapshot(addr, client.ShipID)
+		return
+	}
+
+	// Only a Connect that echoes the cookie issued to its address gets a client
+	if !s.cookies.Verify(addr, connectPkt.Cookie, time.Now()) {
+		s.clientsMutex.Unlock()
+		challengePkt := network.ConnectChallengePacket{
+			Header: network.PacketHeader{Type: network.ConnectChallenge, Size: uint32(16)}, // type+size+cookie
+			Cookie: s.cookies.Issue(addr, time.Now()),
+		}
+		s.sendPacket(addr, &challengePkt)
+		return
+	}
 
 	// Create and store the new client
 	newClientID := s.nextClientID
@@ -126,22 +147,39 @@ func (s *Server) handleConnect(addr *net.UDPAddr, data []byte) {
 		ShipID:   shipID,
 	}
 	s.clients[addr.String()] = client
+	s.clientsMutex.Unlock()
 
 	log.Printf("Player connected: ClientID %d, ShipID %d", newClientID, shipID)
 
-	// Send ConnectAcknowledge back to the new client
+	s.sendConnectAcknowledge(client)
+	s.sendSnapshot(addr, shipID)
+
+	// Tell all other clients about the new ship
+	newShipCreatePkt := network.CreateShipPacket{
+		Header: network.PacketHeader{Type: network.CreateShip, Size: uint32(68)},
+		ShipID: shipID,
+		Model:  int32(connectPkt.Model),
+		Owner:  newClientID,
+	}
+	s.broadcastPacket(&newShipCreatePkt, addr.String())
+}
+
+// sendConnectAcknowledge tells a client which ID and ship it was given.
+func (s *Server) sendConnectAcknowledge(client *Client) {
 	ackPkt := network.ConnectAcknowledgePacket{
 		Header:   network.PacketHeader{Type: network.ConnectAcknowledge, Size: uint32(16)}, // type+size+clientID+shipID
-		ClientID: newClientID,
-		ShipID:   shipID,
+		ClientID: client.ClientID,
+		ShipID:   client.ShipID,
 	}
-	s.sendPacket(addr, &ackPkt)
+	s.sendPacket(client.Addr, &ackPkt)
+}
 
-	// Send all existing ships to the new client
+// sendSnapshot sends all existing ships except the client's own to addr.
+func (s *Server) sendSnapshot(addr *net.UDPAddr, ownShipID int32) {
 	for existingShipID, entity := range s.universe.GetAllEntities() {
 		// The original C++ code doesn't send the newly created ship back to the owner
 		// in this loop, so we replicate that behavior.
-		if existingShipID == shipID {
+		if existingShipID == ownShipID {
 			continue
 		}
 		createShipPkt := network.CreateShipPacket{
@@ -166,15 +204,6 @@ func (s *Server) handleConnect(addr *net.UDPAddr, data []byte) {
 		}
 		s.sendPacket(addr, &createShipPkt)
 	}
-
-	// Tell all other clients about the new ship
-	newShipCreatePkt := network.CreateShipPacket{
-		Header: network.PacketHeader{Type: network.CreateShip, Size: uint32(68)},
-		ShipID: shipID,
-		Model:  int32(connectPkt.Model),
-		Owner:  newClientID,
-	}
-	s.broadcastPacket(&newShipCreatePkt, addr.String())
 }
 
 func (s *Server) handleShipUpdate(addr *net.UDPAddr, data []byte) {
@@ -22,6 +22,17 @@ func TestPacketSerialization(t *testing.T) {
 	}
 	copy(connectPkt.Name[:], "TestPlayer")
 
+	updatePkt := network.ShipUpdatePacket{
+		Header: network.PacketHeader{
+			Type: network.ShipUpdate,
+			Size: uint32(binary.Size(network.ShipUpdatePacket{})),
+		},
+		ShipID:   7,
+		PosX:     1000,
+		Sequence: 42,
+		VelX:     -250,
+	}
+
 	testCases := []struct {
 		name         string
 		inputPacket  interface{}
@@ -32,6 +43,11 @@ func TestPacketSerialization(t *testing.T) {
 			inputPacket:  &connectPkt,
 			outputPacket: &network.ConnectPacket{},
 		},
+		{
+			name:         "ShipUpdatePacket",
+			inputPacket:  &updatePkt,
+			outputPacket: &network.ShipUpdatePacket{},
+		},
 	}
 
 	for _, tc := range testCases {
@@ -58,6 +74,25 @@ func TestPacketSerialization(t *testing.T) {
 	}
 }
 
+// The packets have to match the C++ client's struct sizes byte for byte.
+func TestPacketSizes(t *testing.T) {
+	sizes := []struct {
+		name   string
+		packet interface{}
+		size   int
+	}{
+		{"ShipUpdatePacket", network.ShipUpdatePacket{}, 84},
+		{"ConnectPacket", network.ConnectPacket{}, 82},
+		{"ConnectChallengePacket", network.ConnectChallengePacket{}, 16},
+	}
+
+	for _, s := range sizes {
+		if got := binary.Size(s.packet); got != s.size {
+			t.Errorf("%s is %d bytes, the client expects %d", s.name, got, s.size)
+		}
+	}
+}
+
 func TestHandleConnect_ExistingShipBroadcast(t *testing.T) {
 	// Skip this test in CI environment due to potential deadlocks and timeouts
 	if os.Getenv("CI") != "" {
@@ -75,24 +110,25 @@ func TestHandleConnect_ExistingShipBroadcast(t *testing.T) {
 		PosZ:       3000,
 	}
 
-	// 2. Create a fake client connection
+	// 2. Setup a listener for the fake client
+	clientConn, err := net.ListenUDP("udp", &net.UDPAddr{IP: net.ParseIP("127.0.0.1"), Port: 0})
+	if err != nil {
+		t.Fatalf("Failed to listen on UDP for test: %v", err)
+	}
+	defer clientConn.Close()
+	clientAddr := clientConn.LocalAddr().(*net.UDPAddr)
+
+	// 3. Create a connect packet that already carries the client's cookie
 	connectPkt := network.ConnectPacket{
 		Header: network.PacketHeader{Type: network.Connect, Size: uint32(binary.Size(network.ConnectPacket{}))},
 		Model:  99,
+		Cookie: server.cookies.Issue(clientAddr, time.Now()),
 	}
 	packetBytes, err := network.ToBytes(&connectPkt)
 	if err != nil {
 		t.Fatalf("Failed to serialize connect packet: %v", err)
 	}
 
-	// 3. Setup a listener for the fake client
-	clientConn, err := net.ListenUDP("udp", &net.UDPAddr{IP: net.ParseIP("127.0.0.1"), Port: 0})
-	if err != nil {
-		t.Fatalf("Failed to listen on UDP for test: %v", err)
-	}
-	defer clientConn.Close()
-	clientAddr := clientConn.LocalAddr().(*net.UDPAddr)
-
 	// The server needs a connection to send from, but it doesn't have to be the same one
 	server.conn, err = net.ListenUDP("udp", &net.UDPAddr{IP: net.ParseIP("127.0.0.1"), Port: 0})
 	if err != nil {
@@ -119,21 +155,27 @@ func TestHandleConnect_ExistingShipBroadcast(t *testing.T) {
 			return
 		}
 
-		n, _, err := clientConn.ReadFromUDP(buf)
-		if err != nil {
-			t.Logf("Read error: %v", err)
-			close(readFinished)
-			return
-		}
+		// The snapshot also holds the startup ship, in map order
+		for {
+			n, _, err := clientConn.ReadFromUDP(buf)
+			if err != nil {
+				t.Logf("Read error: %v", err)
+				close(readFinished)
+				return
+			}
 
-		var createShipPkt network.CreateShipPacket
-		err = network.FromBytes(buf[:n], &createShipPkt)
-		if err != nil {
-			t.Logf("Decode error: %v", err)
-			close(readFinished)
-			return
+			var createShipPkt network.CreateShipPacket
+			err = network.FromBytes(buf[:n], &createShipPkt)
+			if err != nil {
+				t.Logf("Decode error: %v", err)
+				close(readFinished)
+				return
+			}
+			if createShipPkt.ShipID == existingShipID {
+				readFinished <- &createShipPkt
+				return
+			}
 		}
-		readFinished <- &createShipPkt
 	}()
 
 	server.handleConnect(clientAddr, packetBytes)
@@ -166,11 +208,21 @@ func TestHandleConnect(t *testing.T) {
 	server := NewServer()
 	initialEntityCount := len(server.universe.Entities)
 
-	// 2. Create a fake client connection
-	// Create a fake connect packet
+	// 2. Create a dummy connection for the server, which will also serve as our fake client connection
+	addr := &net.UDPAddr{IP: net.ParseIP("127.0.0.1"), Port: 0} // Port 0 asks the OS for a free port
+	conn, err := net.ListenUDP("udp", addr)
+	if err != nil {
+		t.Fatalf("Failed to listen on UDP for test: %v", err)
+	}
+	fakeAddr := conn.LocalAddr().(*net.UDPAddr)
+	defer conn.Close()
+	server.conn = conn
+
+	// 3. Create a fake connect packet that already carries the client's cookie
 	connectPkt := network.ConnectPacket{
 		Header: network.PacketHeader{Type: network.Connect, Size: uint32(binary.Size(network.ConnectPacket{}))},
 		Model:  99,
+		Cookie: server.cookies.Issue(fakeAddr, time.Now()),
 	}
 	copy(connectPkt.Name[:], "TestHandleConnect")
 
@@ -180,16 +232,6 @@ func TestHandleConnect(t *testing.T) {
 		t.Fatalf("Failed to serialize connect packet for test: %v", err)
 	}
 
-	// Create a dummy connection for the server, which will also serve as our fake client connection
-	addr := &net.UDPAddr{IP: net.ParseIP("127.0.0.1"), Port: 0} // Port 0 asks the OS for a free port
-	conn, err := net.ListenUDP("udp", addr)
-	if err != nil {
-		t.Fatalf("Failed to listen on UDP for test: %v", err)
-	}
-	fakeAddr := conn.LocalAddr().(*net.UDPAddr)
-	defer conn.Close()
-	server.conn = conn
-
 	// 4. Call the handler function
 	// We need to read the packets the server sends back to avoid blocking
 	readFinished := make(chan bool)
@@ -260,6 +302,112 @@ func TestHandleConnect(t *testing.T) {
 	}
 }
 
+// readPacket reads one packet from conn and decodes it into p.
+func readPacket(t *testing.T, conn *net.UDPConn, p interface{}) {
+	t.Helper()
+	if err := conn.SetReadDeadline(time.Now().Add(2 * time.Second)); err != nil {
+		t.Fatalf("Failed to set read deadline: %v", err)
+	}
+	buf := make([]byte, 1024)
+	n, _, err := conn.ReadFromUDP(buf)
+	if err != nil {
+		t.Fatalf("Failed to read packet: %v", err)
+	}
+	if err := network.FromBytes(buf[:n], p); err != nil {
+		t.Fatalf("Failed to decode packet: %v", err)
+	}
+}
+
+// TestHandleConnect_Challenge checks that a Connect only gets a client once it echoes its cookie.
+func TestHandleConnect_Challenge(t *testing.T) {
+	server := NewServer()
+	conn, err := net.ListenUDP("udp", &net.UDPAddr{IP: net.ParseIP("127.0.0.1"), Port: 0})
+	if err != nil {
+		t.Fatalf("Failed to listen on UDP for test: %v", err)
+	}
+	defer conn.Close()
+	server.conn = conn
+	addr := conn.LocalAddr().(*net.UDPAddr)
+
+	connectPkt := network.ConnectPacket{
+		Header: network.PacketHeader{Type: network.Connect, Size: uint32(binary.Size(network.ConnectPacket{}))},
+		Model:  99,
+	}
+	packetBytes, _ := network.ToBytes(&connectPkt)
+	server.handleConnect(addr, packetBytes)
+
+	var challengePkt network.ConnectChallengePacket
+	readPacket(t, conn, &challengePkt)
+	if challengePkt.Header.Type != network.ConnectChallenge || challengePkt.Cookie == 0 {
+		t.Fatalf("Expected a ConnectChallenge with a cookie, got %+v", challengePkt)
+	}
+	if len(server.clients) != 0 {
+		t.Fatalf("A Connect without a cookie must not create a client")
+	}
+
+	// A cookie issued to another address is challenged again
+	otherAddr := &net.UDPAddr{IP: addr.IP, Port: addr.Port + 1}
+	connectPkt.Cookie = server.cookies.Issue(otherAddr, time.Now())
+	packetBytes, _ = network.ToBytes(&connectPkt)
+	server.handleConnect(addr, packetBytes)
+	readPacket(t, conn, &challengePkt)
+	if challengePkt.Header.Type != network.ConnectChallenge || len(server.clients) != 0 {
+		t.Fatalf("A cookie for another address must not create a client")
+	}
+
+	connectPkt.Cookie = challengePkt.Cookie
+	packetBytes, _ = network.ToBytes(&connectPkt)
+	server.handleConnect(addr, packetBytes)
+
+	var ackPkt network.ConnectAcknowledgePacket
+	readPacket(t, conn, &ackPkt)
+	if ackPkt.Header.Type != network.ConnectAcknowledge {
+		t.Fatalf("Expected ConnectAcknowledge after echoing the cookie, got type %d", ackPkt.Header.Type)
+	}
+	if len(server.clients) != 1 {
+		t.Errorf("Expected 1 client after the handshake, got %d", len(server.clients))
+	}
+}
+
+// TestHandleConnect_Repeated checks that a repeated Connect resends the acknowledge and snapshot instead of creating another ship.
+func TestHandleConnect_Repeated(t *testing.T) {
+	server := NewServer()
+	conn, err := net.ListenUDP("udp", &net.UDPAddr{IP: net.ParseIP("127.0.0.1"), Port: 0})
+	if err != nil {
+		t.Fatalf("Failed to listen on UDP for test: %v", err)
+	}
+	defer conn.Close()
+	server.conn = conn
+	addr := conn.LocalAddr().(*net.UDPAddr)
+
+	connectPkt := network.ConnectPacket{
+		Header: network.PacketHeader{Type: network.Connect, Size: uint32(binary.Size(network.ConnectPacket{}))},
+		Model:  99,
+		Cookie: server.cookies.Issue(addr, time.Now()),
+	}
+	packetBytes, _ := network.ToBytes(&connectPkt)
+
+	var first, second network.ConnectAcknowledgePacket
+	var createShipPkt network.CreateShipPacket
+	server.handleConnect(addr, packetBytes)
+	readPacket(t, conn, &first)
+	readPacket(t, conn, &createShipPkt)
+	entityCount := len(server.universe.Entities)
+
+	server.handleConnect(addr, packetBytes)
+	readPacket(t, conn, &second)
+	if second.Header.Type != network.ConnectAcknowledge || second != first {
+		t.Errorf("Expected the same ConnectAcknowledge again, got %+v after %+v", second, first)
+	}
+	readPacket(t, conn, &createShipPkt)
+	if createShipPkt.Header.Type != network.CreateShip {
+		t.Errorf("Expected the snapshot to be resent, got type %d", createShipPkt.Header.Type)
+	}
+	if len(server.clients) != 1 || len(server.universe.Entities) != entityCount {
+		t.Errorf("A repeated Connect must not create another client or ship")
+	}
+}
+
 func TestHandleShipUpdate(t *testing.T) {
 	type testCase struct {
 		name         string
@@ -12,6 +12,9 @@ const (
 	ConnectAcknowledge
 	ChatMessage
 	PlayerChatEnter
+	CreateShips
+	DeleteShips
+	ConnectChallenge
 )
 
 // Packet is the base struct for all network packets.
@@ -45,6 +48,13 @@ type ShipUpdatePacket struct {
 	LookAtX int32
 	LookAtY int32
 	LookAtZ int32
+	// Increases with every state change of the ship; 0 means unsequenced.
+	// The sender numbers its own ship's updates, they are relayed unchanged.
+	Sequence uint32
+	// Position units per second, for dead reckoning between updates
+	VelX int32
+	VelY int32
+	VelZ int32
 }
 
 // ConnectPacket corresponds to the C++ Connect struct.
@@ -52,6 +62,15 @@ type ConnectPacket struct {
 	Header PacketHeader
 	Model  int16
 	Name   [64]byte
+	// 0 at first; the server may answer with a ConnectChallengePacket, and the
+	// Connect is then sent again carrying its cookie
+	Cookie uint64
+}
+
+// ConnectChallengePacket corresponds to the C++ ConnectChallenge struct.
+type ConnectChallengePacket struct {
+	Header PacketHeader
+	Cookie uint64
 }
 
 // ConnectAcknowledgePacket corresponds to the C++ ConnectAcknowledge struct.
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+// Where the server loop takes its time from. Everything that paces the
+// simulation reads Now() and waits through SleepFor, so the same loop runs
+// against the wall clock or against virtual time.
+class Clock
+{
+public:
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	virtual ~Clock() {}
+	virtual TimePoint Now() const = 0;
+	virtual void SleepFor(std::chrono::microseconds duration) = 0;
+};
+
+class SteadyClock : public Clock
+{
+public:
+	TimePoint Now() const override { return std::chrono::steady_clock::now(); }
+	void SleepFor(std::chrono::microseconds duration) override { std::this_thread::sleep_for(duration); }
+};
+
+// Time that only moves when the loop sleeps or is advanced, so ticks run as
+// fast as the CPU allows and a run repeats tick by tick. It starts at the
+// same point every run, well after the zero time point, which the server
+// reads as "never".
+class VirtualClock : public Clock
+{
+public:
+	TimePoint Now() const override { return now; }
+	void SleepFor(std::chrono::microseconds duration) override { now += duration; }
+	void Advance(std::chrono::microseconds duration) { now += duration; }
+
+private:
+	TimePoint now = TimePoint(std::chrono::hours(1));
+};
@@ -0,0 +1,101 @@
+#include "ConnectCookie.h"
+
+#include <cstring>
+#include <random>
+
+constexpr std::chrono::seconds ConnectCookies::BucketLength;
+
+static inline uint64_t RotateLeft(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t ReadLittleEndian64(const uint8_t* p)
+{
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+static inline void SipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3)
+{
+	v0 += v1; v1 = RotateLeft(v1, 13); v1 ^= v0; v0 = RotateLeft(v0, 32);
+	v2 += v3; v3 = RotateLeft(v3, 16); v3 ^= v2;
+	v0 += v3; v3 = RotateLeft(v3, 21); v3 ^= v0;
+	v2 += v1; v1 = RotateLeft(v1, 17); v1 ^= v2; v2 = RotateLeft(v2, 32);
+}
+
+uint64_t SipHash24(const uint8_t key[16], const void* data, size_t length)
+{
+	uint64_t k0 = ReadLittleEndian64(key);
+	uint64_t k1 = ReadLittleEndian64(key + 8);
+	uint64_t v0 = 0x736f6d6570736575ull ^ k0;
+	uint64_t v1 = 0x646f72616e646f6dull ^ k1;
+	uint64_t v2 = 0x6c7967656e657261ull ^ k0;
+	uint64_t v3 = 0x7465646279746573ull ^ k1;
+
+	const uint8_t* bytes = (const uint8_t*)data;
+	size_t full = length & ~(size_t)7;
+	for (size_t i = 0; i < full; i += 8)
+	{
+		uint64_t m = ReadLittleEndian64(bytes + i);
+		v3 ^= m;
+		SipRound(v0, v1, v2, v3);
+		SipRound(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	// The last block holds the remaining bytes and the length's low byte
+	uint64_t last = (uint64_t)length << 56;
+	for (size_t i = 0; i < (length & 7); i++)
+		last |= (uint64_t)bytes[full + i] << (8 * i);
+	v3 ^= last;
+	SipRound(v0, v1, v2, v3);
+	SipRound(v0, v1, v2, v3);
+	v0 ^= last;
+
+	v2 ^= 0xff;
+	for (int i = 0; i < 4; i++)
+		SipRound(v0, v1, v2, v3);
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+ConnectCookies::ConnectCookies()
+{
+	std::random_device random;
+	for (size_t i = 0; i < sizeof(key); i += 4)
+	{
+		uint32_t value = random();
+		memcpy(key + i, &value, 4);
+	}
+}
+
+uint64_t ConnectCookies::Issue(uint32_t ip, uint16_t port, std::chrono::steady_clock::time_point now) const
+{
+	return Compute(ip, port, Bucket(now));
+}
+
+bool ConnectCookies::Verify(uint32_t ip, uint16_t port, uint64_t cookie, std::chrono::steady_clock::time_point now) const
+{
+	if (cookie == 0)
+		return false;
+	// Issued in this bucket or, close to its start, in the one before
+	uint64_t bucket = Bucket(now);
+	return cookie == Compute(ip, port, bucket) || cookie == Compute(ip, port, bucket - 1);
+}
+
+uint64_t ConnectCookies::Compute(uint32_t ip, uint16_t port, uint64_t bucket) const
+{
+	uint8_t message[14];
+	memcpy(message, &ip, 4);
+	memcpy(message + 4, &port, 2);
+	memcpy(message + 6, &bucket, 8);
+	uint64_t cookie = SipHash24(key, message, sizeof(message));
+	return cookie != 0 ? cookie : 1;
+}
+
+uint64_t ConnectCookies::Bucket(std::chrono::steady_clock::time_point now)
+{
+	return (uint64_t)(now.time_since_epoch() / BucketLength);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// SipHash-2-4 of data under a 128 bit key
+uint64_t SipHash24(const uint8_t key[16], const void* data, size_t length);
+
+// Stateless proof that a client receives at the address it connects from.
+// The server answers a first Connect with a cookie, a keyed hash of the
+// address and the current time bucket, and remembers nothing. Only a Connect
+// that echoes a cookie for its own address gets a connection, so spoofed
+// sources never get past the cookie check.
+class ConnectCookies
+{
+public:
+	// A cookie stays valid for one to two buckets
+	static constexpr std::chrono::seconds BucketLength{ 10 };
+
+	// Random key, so cookies can't be predicted or carried over a restart
+	ConnectCookies();
+
+	// Never 0, which is what a Connect without a cookie carries
+	uint64_t Issue(uint32_t ip, uint16_t port, std::chrono::steady_clock::time_point now) const;
+	bool Verify(uint32_t ip, uint16_t port, uint64_t cookie, std::chrono::steady_clock::time_point now) const;
+
+private:
+	uint8_t key[16];
+
+	uint64_t Compute(uint32_t ip, uint16_t port, uint64_t bucket) const;
+	static uint64_t Bucket(std::chrono::steady_clock::time_point now);
+};
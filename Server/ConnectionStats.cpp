@@ -0,0 +1,22 @@
+#include "ConnectionStats.h"
+
+void ConnectionStats::AddSample(const ConnectionSample& sample, const LaneSample* sampleLanes, size_t sampleLaneCount)
+{
+	latest = sample;
+	ping.Push(sample.PingMs);
+	if (sample.QualityRemote >= 0.0f)
+		outLoss.Push(1.0f - sample.QualityRemote);
+	if (sample.QualityLocal >= 0.0f)
+		inLoss.Push(1.0f - sample.QualityLocal);
+	pendingBytes.Push(sample.PendingReliable + sample.PendingUnreliable);
+	sendRate.Push(sample.SendRateBytesPerSec);
+	outBytes.Push(sample.OutBytesPerSec);
+	queueTime.Push(sample.QueueTimeUs);
+
+	laneCount = sampleLaneCount < MaxLanes ? sampleLaneCount : MaxLanes;
+	for (size_t i = 0; i < laneCount; i++)
+	{
+		lanes[i] = sampleLanes[i];
+		lanePending[i].Push(sampleLanes[i].PendingReliable + sampleLanes[i].PendingUnreliable);
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed size ring holding the most recent N samples
+template <typename T, size_t N>
+class RollingWindow
+{
+public:
+	void Push(T value)
+	{
+		values[next] = value;
+		next = (next + 1) % N;
+		if (count < N)
+			count++;
+	}
+
+	size_t Count() const { return count; }
+	T Latest() const { return count ? values[(next + N - 1) % N] : T(); }
+
+	T Max() const
+	{
+		T result = T();
+		for (size_t i = 0; i < count; i++)
+			if (i == 0 || values[i] > result)
+				result = values[i];
+		return result;
+	}
+
+	double Mean() const
+	{
+		if (count == 0)
+			return 0.0;
+		double sum = 0.0;
+		for (size_t i = 0; i < count; i++)
+			sum += (double)values[i];
+		return sum / (double)count;
+	}
+
+private:
+	T values[N] = {};
+	size_t next = 0;
+	size_t count = 0;
+};
+
+// One reading of a connection's transport state, as reported by
+// GameNetworkingSockets' GetConnectionRealTimeStatus
+struct ConnectionSample
+{
+	int32_t PingMs = 0;
+	// Fraction of packets that arrived, locally and at the remote end; -1 if not known yet
+	float QualityLocal = -1.0f;
+	float QualityRemote = -1.0f;
+	float OutBytesPerSec = 0.0f;
+	float InBytesPerSec = 0.0f;
+	// Estimated bandwidth available towards the client
+	int32_t SendRateBytesPerSec = 0;
+	int32_t PendingReliable = 0;
+	int32_t PendingUnreliable = 0;
+	int32_t SentUnackedReliable = 0;
+	// How long a message queued now would wait before it goes on the wire
+	int64_t QueueTimeUs = 0;
+};
+
+struct LaneSample
+{
+	int32_t PendingReliable = 0;
+	int32_t PendingUnreliable = 0;
+	int32_t SentUnackedReliable = 0;
+	int64_t QueueTimeUs = 0;
+};
+
+// Rolling view of a client's connection quality. The server samples every
+// connection on a timer; the console, the metrics and the replication code
+// read from here rather than querying the transport themselves.
+class ConnectionStats
+{
+public:
+	// 20 samples at the server's 250 ms interval cover the last five seconds
+	static const size_t WindowSize = 20;
+	static const size_t MaxLanes = 4;
+
+	void AddSample(const ConnectionSample& sample, const LaneSample* lanes, size_t laneCount);
+
+	bool HasSamples() const { return ping.Count() > 0; }
+	const ConnectionSample& Latest() const { return latest; }
+
+	double PingMean() const { return ping.Mean(); }
+	int32_t PingMax() const { return ping.Max(); }
+	// Loss towards the client, from the quality the client reports back; 0 while unknown
+	double OutLossMean() const { return outLoss.Mean(); }
+	// Loss of the client's packets towards us; 0 while unknown
+	double InLossMean() const { return inLoss.Mean(); }
+	// Bytes queued but not yet sent, both reliable and unreliable
+	int32_t PendingBytes() const { return pendingBytes.Latest(); }
+	double PendingBytesMean() const { return pendingBytes.Mean(); }
+	double SendRateMean() const { return sendRate.Mean(); }
+	double OutBytesPerSecMean() const { return outBytes.Mean(); }
+	int64_t QueueTimeMaxUs() const { return queueTime.Max(); }
+
+	size_t LaneCount() const { return laneCount; }
+	const LaneSample& Lane(size_t lane) const { return lanes[lane]; }
+	double LanePendingBytesMean(size_t lane) const { return lanePending[lane].Mean(); }
+
+private:
+	ConnectionSample latest;
+	RollingWindow<int32_t, WindowSize> ping;
+	RollingWindow<float, WindowSize> outLoss;
+	RollingWindow<float, WindowSize> inLoss;
+	RollingWindow<int32_t, WindowSize> pendingBytes;
+	RollingWindow<int32_t, WindowSize> sendRate;
+	RollingWindow<float, WindowSize> outBytes;
+	RollingWindow<int64_t, WindowSize> queueTime;
+
+	LaneSample lanes[MaxLanes];
+	RollingWindow<int32_t, WindowSize> lanePending[MaxLanes];
+	size_t laneCount = 0;
+};
@@ -0,0 +1,334 @@
+#include "EntityColumns.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define X3MP_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions inside functions that opt in,
+// which keeps the rest of the server runnable on any x86 CPU.
+#if defined(__GNUC__)
+#define X3MP_TARGET_SSE2 __attribute__((target("sse2")))
+#define X3MP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define X3MP_TARGET_SSE2
+#define X3MP_TARGET_AVX2
+#endif
+
+EntityColumns::EntityColumns()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+void EntityColumns::Set(size_t id, const x3::net::Entity& entity)
+{
+	PosX[id] = entity.PosX;
+	PosY[id] = entity.PosY;
+	PosZ[id] = entity.PosZ;
+	RotX[id] = entity.RotX;
+	RotY[id] = entity.RotY;
+	RotZ[id] = entity.RotZ;
+	RotW[id] = entity.RotW;
+	Live[id] = -1;
+}
+
+void EntityColumns::Clear(size_t id)
+{
+	Live[id] = 0;
+}
+
+void EntityColumns::QueryRadius(float x, float y, float z, float radius, std::vector<size_t>& out) const
+{
+	GetColumnKernels().WithinRadius(PosX, PosY, PosZ, Live, Capacity, x, y, z, radius * radius, out);
+}
+
+void EntityColumns::QueryBox(const int32_t min[3], const int32_t max[3], std::vector<size_t>& out) const
+{
+	GetColumnKernels().WithinBox(PosX, PosY, PosZ, Live, Capacity, min, max, out);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Scalar
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// Lanes [begin, n), for the scalar kernels and the vector kernels' tails
+
+static void DistanceSquared_Scalar(const int32_t* x, const int32_t* y, const int32_t* z, size_t begin, size_t n, float px, float py, float pz, float* out)
+{
+	for (size_t i = begin; i < n; i++)
+	{
+		float dx = (float)x[i] - px;
+		float dy = (float)y[i] - py;
+		float dz = (float)z[i] - pz;
+		out[i] = dx * dx + dy * dy + dz * dz;
+	}
+}
+
+static void WithinRadius_Scalar(const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t begin, size_t n, float px, float py, float pz, float radiusSq, std::vector<size_t>& out)
+{
+	for (size_t i = begin; i < n; i++)
+	{
+		if (!live[i])
+			continue;
+		float dx = (float)x[i] - px;
+		float dy = (float)y[i] - py;
+		float dz = (float)z[i] - pz;
+		if (dx * dx + dy * dy + dz * dz <= radiusSq)
+			out.push_back(i);
+	}
+}
+
+static void WithinBox_Scalar(const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t begin, size_t n, const int32_t min[3], const int32_t max[3], std::vector<size_t>& out)
+{
+	for (size_t i = begin; i < n; i++)
+	{
+		if (live[i] && x[i] >= min[0] && x[i] <= max[0] && y[i] >= min[1] && y[i] <= max[1] && z[i] >= min[2] && z[i] <= max[2])
+			out.push_back(i);
+	}
+}
+
+static void FixedToFloat_Scalar(const int32_t* in, size_t begin, size_t n, float scale, float* out)
+{
+	for (size_t i = begin; i < n; i++)
+		out[i] = (float)in[i] * scale;
+}
+
+static const ColumnKernels s_kernelsScalar = {
+	"scalar",
+	[](const int32_t* x, const int32_t* y, const int32_t* z, size_t n, float px, float py, float pz, float* out) {
+		DistanceSquared_Scalar(x, y, z, 0, n, px, py, pz, out);
+	},
+	[](const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t n, float px, float py, float pz, float radiusSq, std::vector<size_t>& out) {
+		WithinRadius_Scalar(x, y, z, live, 0, n, px, py, pz, radiusSq, out);
+	},
+	[](const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t n, const int32_t min[3], const int32_t max[3], std::vector<size_t>& out) {
+		WithinBox_Scalar(x, y, z, live, 0, n, min, max, out);
+	},
+	[](const int32_t* in, size_t n, float scale, float* out) {
+		FixedToFloat_Scalar(in, 0, n, scale, out);
+	}
+};
+
+#ifdef X3MP_X86
+
+static inline void AppendMask(int mask, size_t base, std::vector<size_t>& out)
+{
+	while (mask)
+	{
+#ifdef _MSC_VER
+		unsigned long bit;
+		_BitScanForward(&bit, (unsigned long)mask);
+#else
+		int bit = __builtin_ctz((unsigned)mask);
+#endif
+		out.push_back(base + bit);
+		mask &= mask - 1;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// SSE2, four lanes
+//
+/////////////////////////////////////////////////////////////////////////////
+
+X3MP_TARGET_SSE2 static inline __m128 DistanceSquared_SSE2_4(const int32_t* x, const int32_t* y, const int32_t* z, __m128 px, __m128 py, __m128 pz)
+{
+	__m128 dx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_load_si128((const __m128i*)x)), px);
+	__m128 dy = _mm_sub_ps(_mm_cvtepi32_ps(_mm_load_si128((const __m128i*)y)), py);
+	__m128 dz = _mm_sub_ps(_mm_cvtepi32_ps(_mm_load_si128((const __m128i*)z)), pz);
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+}
+
+X3MP_TARGET_SSE2 static void DistanceSquared_SSE2(const int32_t* x, const int32_t* y, const int32_t* z, size_t n, float px, float py, float pz, float* out)
+{
+	__m128 vx = _mm_set1_ps(px), vy = _mm_set1_ps(py), vz = _mm_set1_ps(pz);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_store_ps(out + i, DistanceSquared_SSE2_4(x + i, y + i, z + i, vx, vy, vz));
+	DistanceSquared_Scalar(x, y, z, i, n, px, py, pz, out);
+}
+
+X3MP_TARGET_SSE2 static void WithinRadius_SSE2(const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t n, float px, float py, float pz, float radiusSq, std::vector<size_t>& out)
+{
+	__m128 vx = _mm_set1_ps(px), vy = _mm_set1_ps(py), vz = _mm_set1_ps(pz), vr = _mm_set1_ps(radiusSq);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 alive = _mm_castsi128_ps(_mm_load_si128((const __m128i*)(live + i)));
+		if (_mm_movemask_ps(alive) == 0)
+			continue;
+		__m128 inside = _mm_cmple_ps(DistanceSquared_SSE2_4(x + i, y + i, z + i, vx, vy, vz), vr);
+		AppendMask(_mm_movemask_ps(_mm_and_ps(inside, alive)), i, out);
+	}
+	WithinRadius_Scalar(x, y, z, live, i, n, px, py, pz, radiusSq, out);
+}
+
+X3MP_TARGET_SSE2 static inline __m128i InRange_SSE2(const int32_t* v, __m128i lo, __m128i hi)
+{
+	__m128i value = _mm_load_si128((const __m128i*)v);
+	// lo <= v <= hi  ==  !(v < lo) && !(v > hi)
+	return _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi32(value, lo), _mm_cmpgt_epi32(value, hi)), _mm_set1_epi32(-1));
+}
+
+X3MP_TARGET_SSE2 static void WithinBox_SSE2(const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t n, const int32_t min[3], const int32_t max[3], std::vector<size_t>& out)
+{
+	__m128i loX = _mm_set1_epi32(min[0]), loY = _mm_set1_epi32(min[1]), loZ = _mm_set1_epi32(min[2]);
+	__m128i hiX = _mm_set1_epi32(max[0]), hiY = _mm_set1_epi32(max[1]), hiZ = _mm_set1_epi32(max[2]);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i inside = _mm_load_si128((const __m128i*)(live + i));
+		inside = _mm_and_si128(inside, InRange_SSE2(x + i, loX, hiX));
+		inside = _mm_and_si128(inside, InRange_SSE2(y + i, loY, hiY));
+		inside = _mm_and_si128(inside, InRange_SSE2(z + i, loZ, hiZ));
+		AppendMask(_mm_movemask_ps(_mm_castsi128_ps(inside)), i, out);
+	}
+	WithinBox_Scalar(x, y, z, live, i, n, min, max, out);
+}
+
+X3MP_TARGET_SSE2 static void FixedToFloat_SSE2(const int32_t* in, size_t n, float scale, float* out)
+{
+	__m128 vs = _mm_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_store_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_load_si128((const __m128i*)(in + i))), vs));
+	FixedToFloat_Scalar(in, i, n, scale, out);
+}
+
+static const ColumnKernels s_kernelsSSE2 = {
+	"sse2", DistanceSquared_SSE2, WithinRadius_SSE2, WithinBox_SSE2, FixedToFloat_SSE2
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// AVX2, eight lanes
+//
+/////////////////////////////////////////////////////////////////////////////
+
+X3MP_TARGET_AVX2 static inline __m256 DistanceSquared_AVX2_8(const int32_t* x, const int32_t* y, const int32_t* z, __m256 px, __m256 py, __m256 pz)
+{
+	__m256 dx = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_load_si256((const __m256i*)x)), px);
+	__m256 dy = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_load_si256((const __m256i*)y)), py);
+	__m256 dz = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_load_si256((const __m256i*)z)), pz);
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+}
+
+X3MP_TARGET_AVX2 static void DistanceSquared_AVX2(const int32_t* x, const int32_t* y, const int32_t* z, size_t n, float px, float py, float pz, float* out)
+{
+	__m256 vx = _mm256_set1_ps(px), vy = _mm256_set1_ps(py), vz = _mm256_set1_ps(pz);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_store_ps(out + i, DistanceSquared_AVX2_8(x + i, y + i, z + i, vx, vy, vz));
+	DistanceSquared_Scalar(x, y, z, i, n, px, py, pz, out);
+}
+
+X3MP_TARGET_AVX2 static void WithinRadius_AVX2(const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t n, float px, float py, float pz, float radiusSq, std::vector<size_t>& out)
+{
+	__m256 vx = _mm256_set1_ps(px), vy = _mm256_set1_ps(py), vz = _mm256_set1_ps(pz), vr = _mm256_set1_ps(radiusSq);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 alive = _mm256_castsi256_ps(_mm256_load_si256((const __m256i*)(live + i)));
+		if (_mm256_movemask_ps(alive) == 0)
+			continue;
+		__m256 inside = _mm256_cmp_ps(DistanceSquared_AVX2_8(x + i, y + i, z + i, vx, vy, vz), vr, _CMP_LE_OQ);
+		AppendMask(_mm256_movemask_ps(_mm256_and_ps(inside, alive)), i, out);
+	}
+	WithinRadius_Scalar(x, y, z, live, i, n, px, py, pz, radiusSq, out);
+}
+
+X3MP_TARGET_AVX2 static inline __m256i OutOfRange_AVX2(const int32_t* v, __m256i lo, __m256i hi)
+{
+	__m256i value = _mm256_load_si256((const __m256i*)v);
+	return _mm256_or_si256(_mm256_cmpgt_epi32(lo, value), _mm256_cmpgt_epi32(value, hi));
+}
+
+X3MP_TARGET_AVX2 static void WithinBox_AVX2(const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t n, const int32_t min[3], const int32_t max[3], std::vector<size_t>& out)
+{
+	__m256i loX = _mm256_set1_epi32(min[0]), loY = _mm256_set1_epi32(min[1]), loZ = _mm256_set1_epi32(min[2]);
+	__m256i hiX = _mm256_set1_epi32(max[0]), hiY = _mm256_set1_epi32(max[1]), hiZ = _mm256_set1_epi32(max[2]);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i outside = OutOfRange_AVX2(x + i, loX, hiX);
+		outside = _mm256_or_si256(outside, OutOfRange_AVX2(y + i, loY, hiY));
+		outside = _mm256_or_si256(outside, OutOfRange_AVX2(z + i, loZ, hiZ));
+		__m256i inside = _mm256_andnot_si256(outside, _mm256_load_si256((const __m256i*)(live + i)));
+		AppendMask(_mm256_movemask_ps(_mm256_castsi256_ps(inside)), i, out);
+	}
+	WithinBox_Scalar(x, y, z, live, i, n, min, max, out);
+}
+
+X3MP_TARGET_AVX2 static void FixedToFloat_AVX2(const int32_t* in, size_t n, float scale, float* out)
+{
+	__m256 vs = _mm256_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_store_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_load_si256((const __m256i*)(in + i))), vs));
+	FixedToFloat_Scalar(in, i, n, scale, out);
+}
+
+static const ColumnKernels s_kernelsAVX2 = {
+	"avx2", DistanceSquared_AVX2, WithinRadius_AVX2, WithinBox_AVX2, FixedToFloat_AVX2
+};
+
+static bool CpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// The OS has to save the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+	if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool CpuHasSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+std::vector<const ColumnKernels*> GetSupportedColumnKernels()
+{
+	std::vector<const ColumnKernels*> kernels;
+#ifdef X3MP_X86
+	if (CpuHasAVX2())
+		kernels.push_back(&s_kernelsAVX2);
+	if (CpuHasSSE2())
+		kernels.push_back(&s_kernelsSSE2);
+#endif
+	kernels.push_back(&s_kernelsScalar);
+	return kernels;
+}
+
+const ColumnKernels& GetColumnKernels()
+{
+	static const ColumnKernels& kernels = *GetSupportedColumnKernels().front();
+	return kernels;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "net_entity.h"
+
+// Columnar (structure of arrays) mirror of the entity transform data.
+// Universe keeps it in sync with the x3::net::Entity structs, which stay
+// the source of truth; passes over all ships (proximity, culling,
+// validation) read these packed, 32-byte aligned arrays instead of chasing
+// one shared_ptr per ship.
+class EntityColumns
+{
+public:
+	// One more than the entity array, a whole number of vectors
+	static const size_t Capacity = 65536;
+
+	alignas(32) int32_t PosX[Capacity];
+	alignas(32) int32_t PosY[Capacity];
+	alignas(32) int32_t PosZ[Capacity];
+	alignas(32) int32_t RotX[Capacity];
+	alignas(32) int32_t RotY[Capacity];
+	alignas(32) int32_t RotZ[Capacity];
+	alignas(32) int32_t RotW[Capacity];
+	// -1 for live slots, 0 for empty ones, so it can be used as a lane mask
+	alignas(32) int32_t Live[Capacity];
+
+	EntityColumns();
+	void Set(size_t id, const x3::net::Entity& entity);
+	void Clear(size_t id);
+
+	// Appends the IDs of live entities within radius of the point
+	void QueryRadius(float x, float y, float z, float radius, std::vector<size_t>& out) const;
+	// Appends the IDs of live entities inside the box, bounds inclusive
+	void QueryBox(const int32_t min[3], const int32_t max[3], std::vector<size_t>& out) const;
+};
+
+// Kernels over raw columns. The arrays must be 32-byte aligned; n can be
+// anything, lanes past the last full vector are done one at a time.
+// Implementations are picked once at runtime: AVX2, then SSE2, then scalar.
+struct ColumnKernels
+{
+	const char* name;
+	// out[i] = squared distance from (px, py, pz), computed in float
+	void (*DistanceSquared)(const int32_t* x, const int32_t* y, const int32_t* z, size_t n, float px, float py, float pz, float* out);
+	// Appends i where live[i] is -1 and the squared distance is <= radiusSq;
+	// live lanes are all ones or all zeros so the vector kernels can mask with them
+	void (*WithinRadius)(const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t n, float px, float py, float pz, float radiusSq, std::vector<size_t>& out);
+	// Appends i where live[i] is -1 and min <= (x, y, z) <= max
+	void (*WithinBox)(const int32_t* x, const int32_t* y, const int32_t* z, const int32_t* live, size_t n, const int32_t min[3], const int32_t max[3], std::vector<size_t>& out);
+	// out[i] = in[i] * scale, converting the game's fixed point values to float
+	void (*FixedToFloat)(const int32_t* in, size_t n, float scale, float* out);
+};
+
+const ColumnKernels& GetColumnKernels();
+// Every implementation this CPU can run, best first; scalar is always last
+std::vector<const ColumnKernels*> GetSupportedColumnKernels();
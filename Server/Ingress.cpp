@@ -0,0 +1,48 @@
+#include "Ingress.h"
+
+#include <algorithm>
+
+constexpr std::chrono::seconds IngressPolicy::ViolationWindow;
+
+IngressPolicy::IngressPolicy()
+{
+	// Server to client packets are never expected, but a few may be harmless
+	for (size_t i = 0; i < x3::net::PacketTypeCount; i++)
+		limits[i] = { 10.0, 20.0 };
+	// The client samples its own ship at 50 Hz and only sends when it changed
+	SetLimit(x3::net::PacketType::ShipUpdate, 60.0, 120.0);
+	// Every accepted Connect spawns a ship
+	SetLimit(x3::net::PacketType::Connect, 0.2, 2.0);
+	SetLimit(x3::net::PacketType::ChatMessage, 5.0, 10.0);
+}
+
+void IngressPolicy::SetLimit(x3::net::PacketType type, double rate, double burst)
+{
+	if ((size_t)type >= x3::net::PacketTypeCount)
+		return;
+	limits[(size_t)type] = { rate, rate > 0.0 ? std::max(burst, 1.0) : 0.0 };
+	version++;
+}
+
+IngressLimiter::Verdict IngressLimiter::Admit(const IngressPolicy& policy, x3::net::PacketType type, std::chrono::steady_clock::time_point now)
+{
+	if (version != policy.Version())
+	{
+		version = policy.Version();
+		for (size_t i = 0; i < x3::net::PacketTypeCount; i++)
+			buckets[i] = TokenBucket(policy.Rate((x3::net::PacketType)i), policy.Burst((x3::net::PacketType)i));
+	}
+
+	if (policy.Rate(type) <= 0.0 || buckets[(size_t)type].TryTake(now))
+		return Verdict::Accept;
+
+	if (now - windowStart >= IngressPolicy::ViolationWindow)
+	{
+		windowStart = now;
+		violations = 0;
+	}
+	violations++;
+	if (policy.MaxViolations() != 0 && violations > policy.MaxViolations())
+		return Verdict::Disconnect;
+	return Verdict::Drop;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include <net_packets.h>
+#include "RateLimit.h"
+
+// What each client may send, per packet type. Packets over their type's
+// limit are dropped before they are decoded, and a client that keeps
+// exceeding its limits is disconnected.
+class IngressPolicy
+{
+public:
+	// Dropped packets are counted over windows of this length
+	static constexpr std::chrono::seconds ViolationWindow{ 10 };
+
+	IngressPolicy();
+
+	// rate packets per second with bursts of up to burst; a rate of 0 lifts the limit
+	void SetLimit(x3::net::PacketType type, double rate, double burst);
+	double Rate(x3::net::PacketType type) const { return limits[(size_t)type].rate; }
+	double Burst(x3::net::PacketType type) const { return limits[(size_t)type].burst; }
+	// Drops within one ViolationWindow that disconnect the client; 0 never disconnects
+	void SetMaxViolations(uint32_t count) { maxViolations = count; }
+	uint32_t MaxViolations() const { return maxViolations; }
+	// Changes whenever a limit does, so limiters know to start over
+	uint32_t Version() const { return version; }
+
+private:
+	struct Limit
+	{
+		double rate = 0.0;
+		double burst = 0.0;
+	};
+	Limit limits[x3::net::PacketTypeCount];
+	uint32_t maxViolations = 200;
+	uint32_t version = 0;
+};
+
+// One client's token buckets under an IngressPolicy
+class IngressLimiter
+{
+public:
+	enum class Verdict
+	{
+		Accept,
+		Drop,
+		// Dropped, and the client went over the policy's MaxViolations
+		Disconnect
+	};
+
+	Verdict Admit(const IngressPolicy& policy, x3::net::PacketType type, std::chrono::steady_clock::time_point now);
+
+private:
+	TokenBucket buckets[x3::net::PacketTypeCount];
+	uint32_t version = (uint32_t)-1;
+	uint32_t violations = 0;
+	std::chrono::steady_clock::time_point windowStart;
+};
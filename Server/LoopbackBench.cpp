@@ -0,0 +1,154 @@
+#include "LoopbackBench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <net_packets.h>
+#include "Screen.h"
+#include "Server.h"
+
+namespace
+{
+	// A circle of 10 km at one turn a minute
+	const float OrbitRadius = 10000000.0f;
+	const float OrbitRate = 2.0f * 3.14159265f / 60.0f;
+
+	struct VirtualClient
+	{
+		TransportConnection conn = InvalidTransportConnection;
+		int32_t shipID = -1;
+		uint32_t sequence = 0;
+		float angle = 0.0f;
+		std::chrono::steady_clock::time_point nextUpdate;
+	};
+
+	struct ClientTotals
+	{
+		uint64_t messages = 0;
+		uint64_t bytes = 0;
+		uint64_t shipUpdates = 0;
+		uint64_t updatesSent = 0;
+		unsigned joined = 0;
+		// FNV-1a over everything the clients received, in order
+		uint64_t digest = 14695981039346656037ull;
+
+		void Add(const void* data, uint32_t size)
+		{
+			messages++;
+			bytes += size;
+			for (uint32_t i = 0; i < size; i++)
+				digest = (digest ^ ((const uint8_t*)data)[i]) * 1099511628211ull;
+		}
+	};
+}
+
+LoopbackBenchResult RunLoopbackBench(Server& server, uint16_t port, const LoopbackBenchOptions& options)
+{
+	if (options.VirtualTime)
+		server.SetClock(std::make_shared<VirtualClock>());
+	std::shared_ptr<Clock> clock = server.GetClock();
+	std::unique_ptr<LoopbackTransport> owned = std::make_unique<LoopbackTransport>(options.Link, options.Seed, clock);
+	// The server owns the transport from Start on; the clients keep using it until Stop
+	LoopbackTransport& transport = *owned;
+	server.Start(std::move(owned), port);
+
+	Screen::Log("Loopback bench: " + std::to_string(options.Clients) + " clients for " + std::to_string(options.Duration.count()) + "s" + (options.VirtualTime ? " of virtual time" : ""));
+
+	std::vector<VirtualClient> clients(options.Clients);
+	for (size_t i = 0; i < clients.size(); i++)
+	{
+		VirtualClient& client = clients[i];
+		client.conn = transport.ConnectClient("virtual client " + std::to_string(i));
+		client.angle = (float)i;
+
+		x3::net::Connect connect;
+		connect.type = x3::net::PacketType::Connect;
+		connect.size = sizeof(x3::net::Connect);
+		memset(connect.Name, 0, sizeof(connect.Name));
+		snprintf(connect.Name, sizeof(connect.Name), "bot%zu", i);
+		transport.ClientSend(client.conn, &connect, sizeof(connect));
+	}
+
+	ClientTotals totals;
+	auto wallStart = std::chrono::steady_clock::now();
+	auto start = clock->Now();
+	auto end = start + options.Duration;
+	uint64_t ticks = 0;
+	while (clock->Now() < end)
+	{
+		auto now = clock->Now();
+		for (VirtualClient& client : clients)
+		{
+			transport.ClientReceive(client.conn, [&](const void* data, uint32_t size) {
+				totals.Add(data, size);
+				if (size < sizeof(x3::net::Packet))
+					return;
+				x3::net::PacketType type = ((const x3::net::Packet*)data)->type;
+				if (type == x3::net::PacketType::ShipUpdate)
+					totals.shipUpdates++;
+				else if (type == x3::net::PacketType::ConnectAcknowledge && size >= sizeof(x3::net::ConnectAcknowledge))
+				{
+					x3::net::ConnectAcknowledge acknowledge;
+					memcpy(&acknowledge, data, sizeof(acknowledge));
+					client.shipID = acknowledge.ShipID;
+					totals.joined++;
+				}
+			});
+
+			if (client.shipID < 0 || now < client.nextUpdate)
+				continue;
+			client.nextUpdate = now + options.UpdateInterval;
+
+			client.angle += OrbitRate * std::chrono::duration<float>(options.UpdateInterval).count();
+			x3::net::ShipUpdate update;
+			update.type = x3::net::PacketType::ShipUpdate;
+			update.size = sizeof(x3::net::ShipUpdate);
+			update.ShipID = client.shipID;
+			update.Sequence = ++client.sequence;
+			update.PosX = (int32_t)(OrbitRadius * std::cos(client.angle));
+			update.PosZ = (int32_t)(OrbitRadius * std::sin(client.angle));
+			update.VelX = (int32_t)(-OrbitRadius * OrbitRate * std::sin(client.angle));
+			update.VelZ = (int32_t)(OrbitRadius * OrbitRate * std::cos(client.angle));
+			transport.ClientSend(client.conn, &update, sizeof(update), SendMode::Unreliable);
+			totals.updatesSent++;
+		}
+
+		server.Tick();
+		ticks++;
+		// Paced like the server's own loop
+		clock->SleepFor(options.TickSleep);
+	}
+
+	double seconds = std::chrono::duration<double>(clock->Now() - start).count();
+	double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+	std::stringstream stream;
+	stream << "Loopback bench done: " << ticks << " ticks in " << seconds << "s";
+	if (options.VirtualTime)
+		stream << " (" << wallSeconds << "s real, " << seconds / std::max(wallSeconds, 1e-6) << "x)";
+	stream << ", " << totals.joined << "/" << clients.size() << " clients joined, "
+		<< totals.updatesSent << " updates sent, " << totals.messages << " messages (" << totals.bytes << " B, "
+		<< totals.shipUpdates << " ship updates) received, " << transport.MessagesLost() << " lost, digest " << std::hex << totals.digest;
+	Screen::Log(stream.str());
+	server.PrintStats();
+
+	LoopbackBenchResult result;
+	result.Ticks = ticks;
+	result.Joined = totals.joined;
+	result.UpdatesSent = totals.updatesSent;
+	result.Messages = totals.messages;
+	result.Bytes = totals.bytes;
+	result.ShipUpdates = totals.shipUpdates;
+	result.MessagesLost = transport.MessagesLost();
+	result.Digest = totals.digest;
+
+	for (VirtualClient& client : clients)
+		transport.DisconnectClient(client.conn);
+	server.Tick();
+	server.Stop();
+	return result;
+}
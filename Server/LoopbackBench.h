@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "LoopbackTransport.h"
+
+class Server;
+
+struct LoopbackBenchOptions
+{
+	unsigned Clients = 100;
+	std::chrono::seconds Duration{ 10 };
+	// How often each virtual client sends its ship's position, like the game client's tick
+	std::chrono::milliseconds UpdateInterval{ 20 };
+	LinkConditions Link;
+	uint32_t Seed = 1;
+	// Runs on a VirtualClock: Duration is simulated time and passes as fast as the server can tick
+	bool VirtualTime = false;
+	// What the server loop sleeps between iterations, in real or virtual time
+	std::chrono::milliseconds TickSleep{ 5 };
+};
+
+// What the virtual clients saw over a run
+struct LoopbackBenchResult
+{
+	uint64_t Ticks = 0;
+	unsigned Joined = 0;
+	uint64_t UpdatesSent = 0;
+	uint64_t Messages = 0;
+	uint64_t Bytes = 0;
+	uint64_t ShipUpdates = 0;
+	uint64_t MessagesLost = 0;
+	// FNV-1a over everything the clients received, in order
+	uint64_t Digest = 0;
+};
+
+// Runs the whole server, scripts included, against virtual clients over a
+// LoopbackTransport. Every client joins with a Connect, then flies its ship in
+// a circle and reads everything the server replicates to it. Prints what the
+// clients saw and the server's stats at the end. With VirtualTime, runs with
+// the same options return the same totals and digest.
+LoopbackBenchResult RunLoopbackBench(Server& server, uint16_t port, const LoopbackBenchOptions& options);
@@ -0,0 +1,253 @@
+#include "LoopbackTransport.h"
+
+#include <algorithm>
+#include <cstring>
+
+LoopbackTransport::LoopbackTransport(const LinkConditions& conditions, uint32_t seed, std::shared_ptr<Clock> clock)
+	: conditions(conditions), random(seed), clock(clock)
+{
+}
+
+bool LoopbackTransport::Listen(uint16_t /*port*/)
+{
+	listening = true;
+	return true;
+}
+
+void LoopbackTransport::Poll(TransportHandler& handler)
+{
+	// Connections open first, so a client's Connect sent right after ConnectClient is delivered with it
+	for (TransportConnection conn : opening)
+	{
+		auto found = endpoints.find(conn);
+		if (found == endpoints.end() || found->second.state != State::Opening)
+			continue;
+		Endpoint& endpoint = found->second;
+		if (!listening)
+		{
+			Close(endpoint);
+			continue;
+		}
+		endpoint.state = State::Open;
+		endpoint.lastSample = Now();
+		endpoint.userData = handler.OnConnectionOpened(conn, endpoint.description);
+		if (endpoint.userData < 0)
+			Close(endpoint);
+	}
+	opening.clear();
+
+	TimePoint now = Now();
+	while (!toServer.empty() && toServer.front().due <= now)
+	{
+		std::pop_heap(toServer.begin(), toServer.end(), std::greater<Message>());
+		Message message = toServer.back();
+		toServer.pop_back();
+
+		auto found = endpoints.find(message.conn);
+		if (found != endpoints.end() && found->second.state == State::Open)
+		{
+			found->second.bytesIn += message.size;
+			handler.OnMessage(message.conn, found->second.userData, payloads[message.payload].data(), message.size);
+		}
+		// Only now, as the handler's sends may take the next free buffer
+		freePayloads.push_back(message.payload);
+	}
+
+	for (TransportConnection conn : closing)
+	{
+		auto found = endpoints.find(conn);
+		if (found == endpoints.end() || found->second.state != State::Closing)
+			continue;
+		Endpoint& endpoint = found->second;
+		int64_t userData = endpoint.userData;
+		Close(endpoint);
+		if (userData >= 0)
+			handler.OnConnectionClosed(conn, userData, "Closed by peer", false);
+	}
+	closing.clear();
+}
+
+void LoopbackTransport::Send(TransportConnection conn, const void* data, uint32_t size, SendMode mode)
+{
+	auto found = endpoints.find(conn);
+	if (found == endpoints.end() || found->second.state != State::Open || size == 0)
+		return;
+	Endpoint& endpoint = found->second;
+	bool reliable = mode == SendMode::Reliable;
+	size_t queued = endpoint.toClient.size();
+	Enqueue(endpoint.toClient, endpoint.lastReliableToClient, conn, data, size, reliable);
+	if (endpoint.toClient.size() != queued)
+		(reliable ? endpoint.pendingReliable : endpoint.pendingUnreliable)++;
+	endpoint.bytesOut += size;
+}
+
+bool LoopbackTransport::Sample(TransportConnection conn, ConnectionSample& sample, LaneSample* lanes, int laneCount)
+{
+	auto found = endpoints.find(conn);
+	if (found == endpoints.end() || found->second.state != State::Open)
+		return false;
+	Endpoint& endpoint = found->second;
+
+	TimePoint now = Now();
+	double seconds = std::max(std::chrono::duration<double>(now - endpoint.lastSample).count(), 1e-3);
+
+	// The link's conditions stand in for what a real transport would measure
+	sample = ConnectionSample();
+	sample.PingMs = (int32_t)std::chrono::duration_cast<std::chrono::milliseconds>(2 * conditions.Latency + conditions.Jitter).count();
+	sample.QualityLocal = (float)(1.0 - conditions.Loss);
+	sample.QualityRemote = (float)(1.0 - conditions.Loss);
+	sample.OutBytesPerSec = (float)(endpoint.bytesOut / seconds);
+	sample.InBytesPerSec = (float)(endpoint.bytesIn / seconds);
+	sample.PendingReliable = endpoint.pendingReliable;
+	sample.PendingUnreliable = endpoint.pendingUnreliable;
+	for (int i = 0; i < laneCount; i++)
+		lanes[i] = LaneSample();
+	if (laneCount > 0)
+	{
+		lanes[0].PendingReliable = endpoint.pendingReliable;
+		lanes[0].PendingUnreliable = endpoint.pendingUnreliable;
+	}
+
+	endpoint.bytesOut = 0;
+	endpoint.bytesIn = 0;
+	endpoint.lastSample = now;
+	return true;
+}
+
+void LoopbackTransport::CloseConnection(TransportConnection conn, const char* /*reason*/)
+{
+	auto found = endpoints.find(conn);
+	if (found != endpoints.end())
+		Close(found->second);
+}
+
+void LoopbackTransport::Shutdown()
+{
+	for (auto& entry : endpoints)
+		Close(entry.second);
+	Release(toServer);
+	opening.clear();
+	closing.clear();
+	listening = false;
+}
+
+TransportConnection LoopbackTransport::ConnectClient(const std::string& description)
+{
+	TransportConnection conn = ++lastConnection;
+	if (conn == InvalidTransportConnection)
+		conn = ++lastConnection;
+	Endpoint& endpoint = endpoints[conn];
+	endpoint.description = description;
+	opening.push_back(conn);
+	return conn;
+}
+
+void LoopbackTransport::ClientSend(TransportConnection conn, const void* data, uint32_t size, SendMode mode)
+{
+	auto found = endpoints.find(conn);
+	if (found == endpoints.end() || size == 0)
+		return;
+	State state = found->second.state;
+	if (state != State::Opening && state != State::Open)
+		return;
+	Enqueue(toServer, found->second.lastReliableToServer, conn, data, size, mode == SendMode::Reliable);
+}
+
+size_t LoopbackTransport::ClientReceive(TransportConnection conn, const std::function<void(const void*, uint32_t)>& onMessage)
+{
+	auto found = endpoints.find(conn);
+	if (found == endpoints.end())
+		return 0;
+	Endpoint& endpoint = found->second;
+
+	TimePoint now = Now();
+	size_t received = 0;
+	while (!endpoint.toClient.empty() && endpoint.toClient.front().due <= now)
+	{
+		std::pop_heap(endpoint.toClient.begin(), endpoint.toClient.end(), std::greater<Message>());
+		Message message = endpoint.toClient.back();
+		endpoint.toClient.pop_back();
+		(message.reliable ? endpoint.pendingReliable : endpoint.pendingUnreliable)--;
+		onMessage(payloads[message.payload].data(), message.size);
+		freePayloads.push_back(message.payload);
+		received++;
+	}
+	return received;
+}
+
+void LoopbackTransport::DisconnectClient(TransportConnection conn)
+{
+	auto found = endpoints.find(conn);
+	if (found == endpoints.end())
+		return;
+	Endpoint& endpoint = found->second;
+	if (endpoint.state == State::Opening)
+		Close(endpoint);
+	else if (endpoint.state == State::Open)
+	{
+		endpoint.state = State::Closing;
+		closing.push_back(conn);
+	}
+}
+
+bool LoopbackTransport::ClientConnected(TransportConnection conn) const
+{
+	auto found = endpoints.find(conn);
+	return found != endpoints.end() && (found->second.state == State::Opening || found->second.state == State::Open);
+}
+
+void LoopbackTransport::Enqueue(MessageHeap& heap, TimePoint& lastReliable, TransportConnection conn, const void* data, uint32_t size, bool reliable)
+{
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+	TimePoint due = Now() + conditions.Latency;
+	if (conditions.Jitter.count() > 0)
+		due += std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, conditions.Jitter.count())(random));
+	if (reliable)
+	{
+		// Jitter may reorder the network underneath, but reliable messages still arrive in order
+		due = std::max(due, lastReliable);
+		lastReliable = due;
+	}
+	else
+	{
+		if (conditions.Loss > 0.0 && chance(random) < conditions.Loss)
+		{
+			messagesLost++;
+			return;
+		}
+		if (conditions.Reorder > 0.0 && chance(random) < conditions.Reorder)
+			due += conditions.ReorderDelay;
+	}
+
+	uint32_t payload;
+	if (!freePayloads.empty())
+	{
+		payload = freePayloads.back();
+		freePayloads.pop_back();
+	}
+	else
+	{
+		payload = (uint32_t)payloads.size();
+		payloads.emplace_back();
+	}
+	payloads[payload].assign((const char*)data, (const char*)data + size);
+
+	heap.push_back({ due, nextOrder++, conn, payload, size, reliable });
+	std::push_heap(heap.begin(), heap.end(), std::greater<Message>());
+}
+
+void LoopbackTransport::Release(MessageHeap& heap)
+{
+	for (const Message& message : heap)
+		freePayloads.push_back(message.payload);
+	heap.clear();
+}
+
+void LoopbackTransport::Close(Endpoint& endpoint)
+{
+	endpoint.state = State::Closed;
+	endpoint.userData = -1;
+	endpoint.pendingReliable = 0;
+	endpoint.pendingUnreliable = 0;
+	Release(endpoint.toClient);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Clock.h"
+#include "Transport.h"
+
+// The simulated link between the server and each in-process client, the same
+// in both directions
+struct LinkConditions
+{
+	// One way delay, plus up to Jitter more, drawn per message
+	std::chrono::microseconds Latency{ 0 };
+	std::chrono::microseconds Jitter{ 0 };
+	// Chance that an unreliable message is lost; reliable ones always arrive, in order
+	double Loss = 0.0;
+	// Chance that an unreliable message is held back by ReorderDelay, so later ones overtake it
+	double Reorder = 0.0;
+	std::chrono::microseconds ReorderDelay{ 20000 };
+};
+
+// Server and clients in one process, connected by queues instead of sockets.
+// The server uses it like any other transport; a harness drives the virtual
+// clients through the Client* calls between the server's iterations. Loss,
+// jitter and reordering come from a seeded generator, so a run with the same
+// seed, clients and timing sees the same network. Delays are measured on
+// clock, which should be the server's; with a VirtualClock the whole run
+// repeats exactly.
+class LoopbackTransport : public Transport
+{
+public:
+	typedef Clock::TimePoint TimePoint;
+
+	explicit LoopbackTransport(const LinkConditions& conditions = LinkConditions(), uint32_t seed = 1, std::shared_ptr<Clock> clock = std::make_shared<SteadyClock>());
+
+	const char* Name() const override { return "loopback"; }
+
+	bool Listen(uint16_t port) override;
+	void Poll(TransportHandler& handler) override;
+	void Send(TransportConnection conn, const void* data, uint32_t size, SendMode mode) override;
+	bool Sample(TransportConnection conn, ConnectionSample& sample, LaneSample* lanes, int laneCount) override;
+	void CloseConnection(TransportConnection conn, const char* reason) override;
+	void Shutdown() override;
+
+	// A new client; the server sees the connection open on its next Poll
+	TransportConnection ConnectClient(const std::string& description = "loopback");
+	void ClientSend(TransportConnection conn, const void* data, uint32_t size, SendMode mode = SendMode::Reliable);
+	// Calls onMessage(data, size) for every message that reached the client by
+	// now, in arrival order. data is only valid during the call.
+	size_t ClientReceive(TransportConnection conn, const std::function<void(const void*, uint32_t)>& onMessage);
+	// Closes from the client's side; the server hears of it on its next Poll
+	void DisconnectClient(TransportConnection conn);
+	// False once either side closed the connection or the server rejected it
+	bool ClientConnected(TransportConnection conn) const;
+
+	uint64_t MessagesLost() const { return messagesLost; }
+
+private:
+	enum class State
+	{
+		Opening,
+		Open,
+		// The client left; the server is told on its next Poll
+		Closing,
+		Closed
+	};
+
+	// Payloads live in a pool of buffers that are reused, so a long run doesn't allocate per message
+	struct Message
+	{
+		TimePoint due;
+		// Breaks ties in due, so messages due at once arrive in the order they were sent
+		uint64_t order;
+		TransportConnection conn;
+		uint32_t payload;
+		uint32_t size;
+		bool reliable;
+
+		bool operator>(const Message& other) const { return due != other.due ? due > other.due : order > other.order; }
+	};
+	typedef std::vector<Message> MessageHeap;
+
+	struct Endpoint
+	{
+		State state = State::Opening;
+		std::string description;
+		int64_t userData = -1;
+		MessageHeap toClient;
+		// Reliable messages may not arrive before the one sent before them
+		TimePoint lastReliableToClient;
+		TimePoint lastReliableToServer;
+		int32_t pendingReliable = 0;
+		int32_t pendingUnreliable = 0;
+		// Totals since the last Sample, for its rates
+		uint64_t bytesIn = 0;
+		uint64_t bytesOut = 0;
+		TimePoint lastSample;
+	};
+
+	LinkConditions conditions;
+	std::mt19937 random;
+	std::shared_ptr<Clock> clock;
+	bool listening = false;
+	TransportConnection lastConnection = InvalidTransportConnection;
+	std::unordered_map<TransportConnection, Endpoint> endpoints;
+	// Connections in the order they changed state, for the next Poll
+	std::vector<TransportConnection> opening;
+	std::vector<TransportConnection> closing;
+	MessageHeap toServer;
+	uint64_t nextOrder = 0;
+	uint64_t messagesLost = 0;
+
+	std::vector<std::vector<char>> payloads;
+	std::vector<uint32_t> freePayloads;
+
+	TimePoint Now() const { return clock->Now(); }
+	// Queues the message onto heap, or drops it if the link loses it
+	void Enqueue(MessageHeap& heap, TimePoint& lastReliable, TransportConnection conn, const void* data, uint32_t size, bool reliable);
+	void Release(MessageHeap& heap);
+	void Close(Endpoint& endpoint);
+};
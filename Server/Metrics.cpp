@@ -0,0 +1,314 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <sstream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment (lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+#define CLOSE_SOCKET closesocket
+// Winsock never raises SIGPIPE
+#define MSG_NOSIGNAL 0
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define CLOSE_SOCKET close
+#endif
+
+namespace metrics
+{
+	/////////////////////////////////////////////////////////////////////////////
+	//
+	// Counter
+	//
+	/////////////////////////////////////////////////////////////////////////////
+
+	static size_t ThreadShard()
+	{
+		static std::atomic<size_t> nextShard{ 0 };
+		thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed);
+		return shard;
+	}
+
+	void Counter::Add(uint64_t n)
+	{
+		shards[ThreadShard() % Shards].value.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	uint64_t Counter::Value() const
+	{
+		uint64_t total = 0;
+		for (const Shard& shard : shards)
+			total += shard.value.load(std::memory_order_relaxed);
+		return total;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////
+	//
+	// Histogram
+	//
+	/////////////////////////////////////////////////////////////////////////////
+
+	size_t Histogram::BucketIndex(uint64_t value)
+	{
+		const uint64_t subBuckets = 1ull << SubBucketBits;
+		if (value < subBuckets)
+			return (size_t)value;
+
+		int exponent = 63;
+		while (!(value & (1ull << exponent)))
+			exponent--;
+		int shift = exponent - SubBucketBits;
+		size_t sub = (size_t)((value >> shift) & (subBuckets - 1));
+		return ((size_t)(shift + 1) << SubBucketBits) + sub;
+	}
+
+	uint64_t Histogram::BucketUpperBound(size_t index)
+	{
+		const size_t subBuckets = (size_t)1 << SubBucketBits;
+		if (index < subBuckets)
+			return index;
+
+		int shift = (int)(index >> SubBucketBits) - 1;
+		uint64_t lower = (uint64_t)(subBuckets + (index & (subBuckets - 1))) << shift;
+		return lower + ((1ull << shift) - 1);
+	}
+
+	void Histogram::Record(uint64_t value)
+	{
+		buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	uint64_t Histogram::Quantile(double q) const
+	{
+		uint64_t total = Count();
+		if (total == 0)
+			return 0;
+
+		uint64_t rank = (uint64_t)(q * (double)(total - 1)) + 1;
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BucketCount; i++)
+		{
+			seen += BucketValue(i);
+			if (seen >= rank)
+				return BucketUpperBound(i);
+		}
+		return BucketUpperBound(BucketCount - 1);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////
+	//
+	// Registry
+	//
+	/////////////////////////////////////////////////////////////////////////////
+
+	Registry& Registry::Get()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	Registry::Entry& Registry::Add(Kind kind, const std::string& name, const std::string& help, const std::string& labels)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.emplace_back();
+		Entry& entry = entries.back();
+		entry.kind = kind;
+		entry.name = name;
+		entry.help = help;
+		entry.labels = labels;
+		return entry;
+	}
+
+	Counter& Registry::AddCounter(const std::string& name, const std::string& help, const std::string& labels)
+	{
+		Entry& entry = Add(Kind::Counter, name, help, labels);
+		entry.counter = std::make_unique<Counter>();
+		return *entry.counter;
+	}
+
+	Gauge& Registry::AddGauge(const std::string& name, const std::string& help, const std::string& labels)
+	{
+		Entry& entry = Add(Kind::Gauge, name, help, labels);
+		entry.gauge = std::make_unique<Gauge>();
+		return *entry.gauge;
+	}
+
+	Histogram& Registry::AddHistogram(const std::string& name, const std::string& help, const std::string& labels)
+	{
+		Entry& entry = Add(Kind::Histogram, name, help, labels);
+		entry.histogram = std::make_unique<Histogram>();
+		return *entry.histogram;
+	}
+
+	static std::string LabelSet(const std::string& labels, const std::string& extra = "")
+	{
+		if (labels.empty() && extra.empty())
+			return "";
+		if (labels.empty() || extra.empty())
+			return "{" + labels + extra + "}";
+		return "{" + labels + "," + extra + "}";
+	}
+
+	std::string Registry::Exposition() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Metrics may be registered in any order; group each family together
+		std::vector<const Entry*> sorted;
+		for (const Entry& entry : entries)
+			sorted.push_back(&entry);
+		std::stable_sort(sorted.begin(), sorted.end(), [](const Entry* a, const Entry* b) { return a->name < b->name; });
+
+		std::ostringstream out;
+		std::string lastFamily;
+		for (const Entry* pEntry : sorted)
+		{
+			const Entry& entry = *pEntry;
+			// Metrics registered under the same name with different labels form one family
+			if (entry.name != lastFamily)
+			{
+				static const char* kindNames[] = { "counter", "gauge", "histogram" };
+				out << "# HELP " << entry.name << " " << entry.help << "\n";
+				out << "# TYPE " << entry.name << " " << kindNames[(int)entry.kind] << "\n";
+				lastFamily = entry.name;
+			}
+
+			switch (entry.kind)
+			{
+			case Kind::Counter:
+				out << entry.name << LabelSet(entry.labels) << " " << entry.counter->Value() << "\n";
+				break;
+			case Kind::Gauge:
+				out << entry.name << LabelSet(entry.labels) << " " << entry.gauge->Value() << "\n";
+				break;
+			case Kind::Histogram:
+			{
+				// Only buckets that have seen samples are written; Prometheus
+				// buckets are cumulative, so skipping empty ones loses nothing.
+				const Histogram& histogram = *entry.histogram;
+				uint64_t cumulative = 0;
+				for (size_t i = 0; i < Histogram::BucketCount; i++)
+				{
+					uint64_t n = histogram.BucketValue(i);
+					if (n == 0)
+						continue;
+					cumulative += n;
+					out << entry.name << "_bucket" << LabelSet(entry.labels, "le=\"" + std::to_string(Histogram::BucketUpperBound(i)) + "\"") << " " << cumulative << "\n";
+				}
+				out << entry.name << "_bucket" << LabelSet(entry.labels, "le=\"+Inf\"") << " " << histogram.Count() << "\n";
+				out << entry.name << "_sum" << LabelSet(entry.labels) << " " << histogram.Sum() << "\n";
+				out << entry.name << "_count" << LabelSet(entry.labels) << " " << histogram.Count() << "\n";
+				break;
+			}
+			}
+		}
+		return out.str();
+	}
+
+	/////////////////////////////////////////////////////////////////////////////
+	//
+	// Exporter
+	//
+	/////////////////////////////////////////////////////////////////////////////
+
+	bool Exporter::Start(uint16_t port, const char* bindAddress)
+	{
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+			return false;
+#endif
+		socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if ((intptr_t)sock < 0)
+			return false;
+
+		int reuse = 1;
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		inet_pton(AF_INET, bindAddress, &addr.sin_addr);
+		if (bind(sock, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(sock, 8) != 0)
+		{
+			CLOSE_SOCKET(sock);
+			return false;
+		}
+
+		listenSocket = (intptr_t)sock;
+		running = true;
+		thread = std::thread(&Exporter::Serve, this);
+		return true;
+	}
+
+	void Exporter::Stop()
+	{
+		if (!running.exchange(false))
+			return;
+		thread.join();
+		CLOSE_SOCKET((socket_t)listenSocket);
+		listenSocket = -1;
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	void Exporter::Serve()
+	{
+		while (running)
+		{
+			// Wake up regularly so Stop() does not hang on accept()
+#ifdef _WIN32
+			fd_set readable;
+			FD_ZERO(&readable);
+			FD_SET((socket_t)listenSocket, &readable);
+			timeval timeout{ 0, 200 * 1000 };
+			if (select(0, &readable, nullptr, nullptr, &timeout) <= 0)
+				continue;
+#else
+			pollfd pfd{ (int)listenSocket, POLLIN, 0 };
+			if (poll(&pfd, 1, 200) <= 0)
+				continue;
+#endif
+			socket_t client = accept((socket_t)listenSocket, nullptr, nullptr);
+			if ((intptr_t)client < 0)
+				continue;
+
+			// A scraper that connects and then stalls must not hold the thread, or Stop() with it
+#ifdef _WIN32
+			DWORD timeout = ClientTimeoutMs;
+#else
+			timeval timeout{ ClientTimeoutMs / 1000, (ClientTimeoutMs % 1000) * 1000 };
+#endif
+			setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+			setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+
+			// Every request gets the exposition; read and discard what was sent
+			char request[1024];
+			recv(client, request, sizeof(request), 0);
+
+			std::string body = Registry::Get().Exposition();
+			std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+				+ std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+			size_t sent = 0;
+			while (sent < response.size())
+			{
+				// A scraper hanging up mid response must not raise SIGPIPE and end the server
+				int n = send(client, response.data() + sent, (int)(response.size() - sent), MSG_NOSIGNAL);
+				if (n <= 0)
+					break;
+				sent += n;
+			}
+			CLOSE_SOCKET(client);
+		}
+	}
+}
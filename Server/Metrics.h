@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Low overhead metrics for the server. Counters are sharded per thread so
+// hot paths only touch their own cache line; gauges are single atomics;
+// histograms use log-linear (HDR style) buckets with ~12% relative error.
+// Everything is exposed in Prometheus text format by metrics::Exporter and
+// summarized on the console by the "stats" command.
+namespace metrics
+{
+	class Counter
+	{
+	public:
+		void Add(uint64_t n = 1);
+		uint64_t Value() const;
+
+	private:
+		static const size_t Shards = 16;
+		struct alignas(64) Shard
+		{
+			std::atomic<uint64_t> value{ 0 };
+		};
+		Shard shards[Shards];
+	};
+
+	class Gauge
+	{
+	public:
+		void Set(int64_t v) { value.store(v, std::memory_order_relaxed); }
+		void Add(int64_t v) { value.fetch_add(v, std::memory_order_relaxed); }
+		int64_t Value() const { return value.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<int64_t> value{ 0 };
+	};
+
+	class Histogram
+	{
+	public:
+		// 8 sub-buckets per power of two, covering the whole uint64 range
+		static const int SubBucketBits = 3;
+		static const size_t BucketCount = (64 - SubBucketBits + 1) << SubBucketBits;
+
+		void Record(uint64_t value);
+		uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+		uint64_t Sum() const { return sum.load(std::memory_order_relaxed); }
+		// Upper bound of the bucket holding the q-th quantile, q in [0, 1]
+		uint64_t Quantile(double q) const;
+
+		static size_t BucketIndex(uint64_t value);
+		static uint64_t BucketUpperBound(size_t index);
+		uint64_t BucketValue(size_t index) const { return buckets[index].load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<uint64_t> buckets[BucketCount] = {};
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> sum{ 0 };
+	};
+
+	// Owns all metrics. Registration takes a lock and returns a reference that
+	// stays valid for the lifetime of the process, so callers cache it.
+	class Registry
+	{
+	public:
+		static Registry& Get();
+
+		// labels is the inner part of a Prometheus label set, e.g. type="ShipUpdate"
+		Counter& AddCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+		Gauge& AddGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+		Histogram& AddHistogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+		std::string Exposition() const;
+
+	private:
+		enum class Kind { Counter, Gauge, Histogram };
+		struct Entry
+		{
+			Kind kind;
+			std::string name;
+			std::string help;
+			std::string labels;
+			std::unique_ptr<Counter> counter;
+			std::unique_ptr<Gauge> gauge;
+			std::unique_ptr<Histogram> histogram;
+		};
+
+		mutable std::mutex mutex;
+		std::deque<Entry> entries;
+		Entry& Add(Kind kind, const std::string& name, const std::string& help, const std::string& labels);
+	};
+
+	// Serves Registry::Exposition() over plain HTTP on a background thread
+	class Exporter
+	{
+	public:
+		~Exporter() { Stop(); }
+		bool Start(uint16_t port, const char* bindAddress = "127.0.0.1");
+		void Stop();
+
+	private:
+		// Per recv and send on a scraper's connection
+		static const int ClientTimeoutMs = 1000;
+
+		std::atomic<bool> running{ false };
+		std::thread thread;
+		intptr_t listenSocket = -1;
+		void Serve();
+	};
+
+	// Records the lifetime of the scope in microseconds
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(Histogram& histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+		~ScopedTimer()
+		{
+			histogram.Record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+		}
+
+	private:
+		Histogram& histogram;
+		std::chrono::steady_clock::time_point start;
+	};
+}
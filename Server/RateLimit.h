@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <unordered_map>
+
+// Allows rate events per second on average, with bursts of up to burst
+class TokenBucket
+{
+public:
+	TokenBucket() {}
+	TokenBucket(double rate, double burst) : rate(rate), burst(burst), tokens(burst) {}
+
+	// Takes cost tokens if there are that many
+	bool TryTake(std::chrono::steady_clock::time_point now, double cost = 1.0)
+	{
+		Refill(now);
+		if (tokens < cost)
+			return false;
+		tokens -= cost;
+		return true;
+	}
+
+	// Refilled completely, so forgetting the bucket changes nothing
+	bool Full(std::chrono::steady_clock::time_point now)
+	{
+		Refill(now);
+		return tokens >= burst;
+	}
+
+private:
+	double rate = 0.0;
+	double burst = 0.0;
+	double tokens = 0.0;
+	std::chrono::steady_clock::time_point last;
+
+	void Refill(std::chrono::steady_clock::time_point now)
+	{
+		if (last != std::chrono::steady_clock::time_point())
+			tokens = std::min(burst, tokens + rate * std::chrono::duration<double>(now - last).count());
+		last = now;
+	}
+};
+
+// A token bucket per key, e.g. per source network. Only keys that were
+// limited recently are remembered; once the table holds maxKeys of them,
+// new keys share one overflow bucket instead of growing it further.
+template <typename Key>
+class KeyedRateLimiter
+{
+public:
+	KeyedRateLimiter(double rate, double burst, size_t maxKeys)
+		: rate(rate), burst(burst), maxKeys(maxKeys), overflow(rate, burst) {}
+
+	bool TryTake(const Key& key, std::chrono::steady_clock::time_point now, double cost = 1.0)
+	{
+		auto found = buckets.find(key);
+		if (found == buckets.end())
+		{
+			if (buckets.size() >= maxKeys)
+				return overflow.TryTake(now, cost);
+			found = buckets.emplace(key, TokenBucket(rate, burst)).first;
+		}
+		return found->second.TryTake(now, cost);
+	}
+
+	// Forgets the buckets that refilled; call now and then
+	void Prune(std::chrono::steady_clock::time_point now)
+	{
+		for (auto it = buckets.begin(); it != buckets.end();)
+		{
+			if (it->second.Full(now))
+				it = buckets.erase(it);
+			else
+				++it;
+		}
+	}
+
+	size_t Size() const { return buckets.size(); }
+
+private:
+	double rate;
+	double burst;
+	size_t maxKeys;
+	TokenBucket overflow;
+	std::unordered_map<Key, TokenBucket> buckets;
+};
@@ -0,0 +1,206 @@
+#include "Replication.h"
+
+#include <algorithm>
+#include <cmath>
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// OutboundMailbox
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void OutboundMailbox::Grow(size_t id)
+{
+	if (id < slot.size())
+		return;
+	size_t size = std::max<size_t>(id + 1, 65536);
+	slot.resize(size, NotPosted);
+	priority.resize(size, 0.0f);
+	deferred.resize(size, false);
+	lastSent.resize(size, NeverSent);
+}
+
+void OutboundMailbox::Post(size_t id)
+{
+	Grow(id);
+	if (slot[id] != NotPosted)
+		return;
+	slot[id] = (uint32_t)pending.size();
+	pending.push_back(id);
+	deferred[id] = false;
+}
+
+bool OutboundMailbox::Defer(size_t id)
+{
+	if (deferred[id])
+		return false;
+	deferred[id] = true;
+	return true;
+}
+
+void OutboundMailbox::Remove(size_t id)
+{
+	uint32_t index = slot[id];
+	size_t last = pending.back();
+	pending[index] = last;
+	slot[last] = index;
+	pending.pop_back();
+	slot[id] = NotPosted;
+}
+
+void OutboundMailbox::Sent(size_t id, int64_t ms, bool reliable)
+{
+	Grow(id);
+	lastSent[id] = ms;
+	priority[id] = 0.0f;
+	if (!reliable)
+		unsettled.push_back({ id, ms });
+}
+
+bool OutboundMailbox::TakeSettled(int64_t nowMs, int64_t delayMs, size_t& id)
+{
+	while (!unsettled.empty() && unsettled.front().sentMs + delayMs <= nowMs)
+	{
+		Unsettled entry = unsettled.front();
+		unsettled.pop_front();
+		// Superseded by a later send, or a newer state is already waiting
+		if (lastSent[entry.id] != entry.sentMs || slot[entry.id] != NotPosted)
+			continue;
+		id = entry.id;
+		return true;
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// LodPolicy
+//
+/////////////////////////////////////////////////////////////////////////////
+
+LodPolicy::LodPolicy()
+{
+	// 30 Hz close by, 5 Hz in the mid range and 1 Hz for everything further out
+	bands = {
+		{ 1000000.0f, std::chrono::milliseconds(33) },
+		{ 10000000.0f, std::chrono::milliseconds(200) },
+		{ std::numeric_limits<float>::max(), std::chrono::milliseconds(1000) },
+	};
+}
+
+void LodPolicy::SetBands(std::vector<LodBand> newBands)
+{
+	if (newBands.empty())
+		return;
+	std::sort(newBands.begin(), newBands.end(), [](const LodBand& a, const LodBand& b) { return a.Distance < b.Distance; });
+	bands = std::move(newBands);
+}
+
+std::chrono::milliseconds LodPolicy::Interval(float distance, float relativeSpeed) const
+{
+	float effective = std::max(distance - relativeSpeed * speedLookahead, 0.0f);
+	for (const LodBand& band : bands)
+	{
+		if (effective <= band.Distance)
+			return band.Interval;
+	}
+	return bands.back().Interval;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// MotionTracker
+//
+/////////////////////////////////////////////////////////////////////////////
+
+const MotionTracker::Motion MotionTracker::none;
+
+void MotionTracker::Observe(size_t id, int32_t x, int32_t y, int32_t z, int32_t vx, int32_t vy, int32_t vz, std::chrono::steady_clock::time_point now)
+{
+	if (id >= motion.size())
+		motion.resize(std::max<size_t>(id + 1, 65536));
+	Motion& m = motion[id];
+	if (vx != 0 || vy != 0 || vz != 0)
+	{
+		m.vx = (float)vx;
+		m.vy = (float)vy;
+		m.vz = (float)vz;
+	}
+	else if (m.valid)
+	{
+		float dt = std::chrono::duration<float>(now - m.time).count();
+		// Several changes within one tick keep the previous estimate
+		if (dt < 0.001f)
+			return;
+		m.vx = ((float)x - m.x) / dt;
+		m.vy = ((float)y - m.y) / dt;
+		m.vz = ((float)z - m.z) / dt;
+	}
+	m.x = (float)x;
+	m.y = (float)y;
+	m.z = (float)z;
+	m.time = now;
+	m.valid = true;
+}
+
+void MotionTracker::Forget(size_t id)
+{
+	if (id < motion.size())
+		motion[id] = Motion();
+}
+
+float MotionTracker::Speed(size_t id) const
+{
+	const Motion& m = Get(id);
+	return std::sqrt(m.vx * m.vx + m.vy * m.vy + m.vz * m.vz);
+}
+
+float MotionTracker::RelativeSpeed(size_t a, size_t b) const
+{
+	const Motion& ma = Get(a);
+	const Motion& mb = Get(b);
+	float dx = ma.vx - mb.vx;
+	float dy = ma.vy - mb.vy;
+	float dz = ma.vz - mb.vz;
+	return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// SendRateController
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void SendRateController::Update(const ConnectionStats& stats)
+{
+	if (!stats.HasSamples())
+		return;
+
+	const ConnectionSample& latest = stats.Latest();
+	int32_t pending = stats.PendingBytes();
+	sendRateBytesPerSec = stats.SendRateMean();
+
+	congested = pending > CongestedPendingBytes
+		|| latest.QueueTimeUs > CongestedQueueTimeUs
+		|| stats.OutLossMean() > CongestedLoss;
+
+	if (congested)
+	{
+		intervalMs = std::min(intervalMs * 1.5, MaxIntervalMs);
+		budget = std::max(budget * 0.5, MinBudget);
+	}
+	else if (pending < ClearPendingBytes && latest.QueueTimeUs < ClearQueueTimeUs)
+	{
+		intervalMs = std::max(intervalMs - 25.0, MinIntervalMs);
+		budget = std::min(budget + 32.0, MaxBudget);
+	}
+}
+
+size_t SendRateController::Budget(size_t entrySize) const
+{
+	double result = budget;
+	// Never plan more per snapshot than the link can carry in one interval
+	if (sendRateBytesPerSec > 0.0 && entrySize > 0)
+		result = std::min(result, sendRateBytesPerSec * intervalMs / 1000.0 / (double)entrySize);
+	return (size_t)std::max(result, MinBudget);
+}
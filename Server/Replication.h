@@ -0,0 +1,204 @@
+#pragma once
+
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <vector>
+#include "ConnectionStats.h"
+
+// Latest-value-wins outbox for one client, keyed by ship. A ship has at most
+// one slot; its state is read from the universe when the slot is taken, so
+// however many changes pile up while the link is slow, only the newest goes
+// out and the backlog is bounded by the number of ships, not by time.
+//
+// Posted ships compete for the client's budget through a priority
+// accumulator: every snapshot adds a weight to each posted ship, the highest
+// priorities are sent and a sent ship starts again from zero. Low weight
+// ships wait longer but their priority keeps growing, so none starve.
+//
+// Updates go out unreliable so the transport never replays stale states.
+// To make sure the last state of a ship that stops changing still arrives,
+// the mailbox remembers unreliable sends and hands the ship back once it has
+// settled, for one reliable send.
+class OutboundMailbox
+{
+public:
+	void Post(size_t id);
+	size_t Size() const { return pending.size(); }
+	bool Empty() const { return pending.empty() && unsettled.empty(); }
+
+	// Adds weight(id) to the priority of every posted ship
+	template <typename Weight>
+	void Accumulate(Weight weight)
+	{
+		for (size_t id : pending)
+			priority[id] += weight(id);
+	}
+
+	// Takes up to n posted ships for which ready(id) holds, highest priority first
+	template <typename Ready>
+	void TakeHighest(size_t n, Ready ready, std::vector<size_t>& out)
+	{
+		out.clear();
+		for (size_t id : pending)
+			if (ready(id))
+				out.push_back(id);
+		auto higher = [this](size_t a, size_t b) { return priority[a] > priority[b]; };
+		if (out.size() > n)
+		{
+			std::partial_sort(out.begin(), out.begin() + n, out.end(), higher);
+			out.resize(n);
+		}
+		else
+		{
+			std::sort(out.begin(), out.end(), higher);
+		}
+		for (size_t id : out)
+			Remove(id);
+	}
+
+	float Priority(size_t id) const { return id < priority.size() ? priority[id] : 0.0f; }
+
+	// Notes that a posted ship was held back; true only the first time since it was posted
+	bool Defer(size_t id);
+
+	// When the ship was last sent to this client, in steady clock milliseconds
+	int64_t LastSent(size_t id) const { return id < lastSent.size() ? lastSent[id] : NeverSent; }
+	bool EverSent(size_t id) const { return LastSent(id) != NeverSent; }
+	// Records a send and resets the ship's priority
+	void Sent(size_t id, int64_t ms, bool reliable);
+	// Takes a ship last sent unreliably at least delayMs ago and not posted or sent since
+	bool TakeSettled(int64_t nowMs, int64_t delayMs, size_t& id);
+
+private:
+	static constexpr int64_t NeverSent = std::numeric_limits<int64_t>::min() / 2;
+	static constexpr uint32_t NotPosted = UINT32_MAX;
+	// Posted ships, unordered; slot[id] is the ship's index in pending
+	std::vector<size_t> pending;
+	std::vector<uint32_t> slot;
+	std::vector<float> priority;
+	std::vector<bool> deferred;
+	std::vector<int64_t> lastSent;
+	void Grow(size_t id);
+	void Remove(size_t id);
+	struct Unsettled
+	{
+		size_t id;
+		int64_t sentMs;
+	};
+	std::deque<Unsettled> unsettled;
+};
+
+// Ships within Distance of the viewer are sent at most once per Interval
+struct LodBand
+{
+	float Distance;
+	std::chrono::milliseconds Interval;
+};
+
+// Picks how often a ship is worth sending to a client from its distance to
+// the client's ship. Ships moving fast relative to the viewer are treated as
+// if they were SpeedLookahead seconds of travel closer.
+class LodPolicy
+{
+public:
+	LodPolicy();
+
+	// Bands are sorted by distance; ships beyond the last band use its interval
+	void SetBands(std::vector<LodBand> bands);
+	const std::vector<LodBand>& Bands() const { return bands; }
+	void SetSpeedLookahead(float seconds) { speedLookahead = seconds; }
+	float SpeedLookahead() const { return speedLookahead; }
+
+	// distance in position units, relativeSpeed in units per second
+	std::chrono::milliseconds Interval(float distance, float relativeSpeed) const;
+
+private:
+	std::vector<LodBand> bands;
+	float speedLookahead = 2.0f;
+};
+
+// Velocity per ship, so replication can weigh relative speed: the one the
+// owner reported in its ShipUpdate, or an estimate from successive position
+// changes for ships that report none
+class MotionTracker
+{
+public:
+	// vx, vy, vz all 0 means no velocity was reported
+	void Observe(size_t id, int32_t x, int32_t y, int32_t z, int32_t vx, int32_t vy, int32_t vz, std::chrono::steady_clock::time_point now);
+	void Forget(size_t id);
+	// Units per second; 0 for ships without two observations yet
+	float Speed(size_t id) const;
+	float RelativeSpeed(size_t a, size_t b) const;
+
+private:
+	struct Motion
+	{
+		float x = 0, y = 0, z = 0;
+		float vx = 0, vy = 0, vz = 0;
+		std::chrono::steady_clock::time_point time;
+		bool valid = false;
+	};
+	std::vector<Motion> motion;
+	static const Motion none;
+	const Motion& Get(size_t id) const { return id < motion.size() ? motion[id] : none; }
+};
+
+// Weight a posted ship adds to its priority per second of waiting
+struct PriorityWeights
+{
+	// Distance at which a ship weighs half as much as one right next to the viewer
+	float DistanceScale = 1000000.0f;
+	// Movement since the last send that doubles the weight
+	float ChangeScale = 100000.0f;
+	// Factor for the ship the player has targeted
+	float TargetBoost = 4.0f;
+
+	float Weight(float distance, float change, bool isTarget) const
+	{
+		float weight = 1.0f / (1.0f + distance / DistanceScale);
+		weight *= 1.0f + change / ChangeScale;
+		if (isTarget)
+			weight *= TargetBoost;
+		return weight;
+	}
+};
+
+// Per-client snapshot rate and size, adjusted from the connection stats.
+// Congestion (send queue building up, high queue delay or loss) backs off
+// multiplicatively; a clean link recovers additively. The entity budget is
+// further capped by the bandwidth the transport estimates for the client.
+class SendRateController
+{
+public:
+	// The nearest LOD band wants 30 Hz
+	static constexpr double MinIntervalMs = 33.0;
+	static constexpr double MaxIntervalMs = 1000.0;
+	static constexpr double MinBudget = 8.0;
+	static constexpr double MaxBudget = 512.0;
+
+	// Backlog above which the client is considered congested
+	static const int32_t CongestedPendingBytes = 16 * 1024;
+	static const int64_t CongestedQueueTimeUs = 100 * 1000;
+	static constexpr double CongestedLoss = 0.05;
+	// Backlog below which the rate may grow again
+	static const int32_t ClearPendingBytes = 4 * 1024;
+	static const int64_t ClearQueueTimeUs = 20 * 1000;
+
+	// Call after each new connection sample
+	void Update(const ConnectionStats& stats);
+
+	std::chrono::milliseconds Interval() const { return std::chrono::milliseconds((int64_t)intervalMs); }
+	// Ships per snapshot; entrySize is the wire size of one ship update
+	size_t Budget(size_t entrySize) const;
+	bool Congested() const { return congested; }
+
+private:
+	double intervalMs = MinIntervalMs;
+	double budget = MaxBudget;
+	double sendRateBytesPerSec = 0.0;
+	bool congested = false;
+};
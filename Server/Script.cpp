@@ -4,6 +4,8 @@ std::vector<std::shared_ptr<Script>> scripts = std::vector<std::shared_ptr<Scrip
 
 void Script::call_callback_OnPlayerConnect(int clientID)
 {
+    static metrics::Histogram& duration = metrics::Registry::Get().AddHistogram("x3mp_script_callback_duration_us", "Time spent in script callbacks in microseconds", "callback=\"onPlayerConnect\"");
+    metrics::ScopedTimer timer(duration);
     for(const auto& value: scripts)
     {
         value->call_OnPlayerConnect(clientID);
@@ -12,6 +14,8 @@ void Script::call_callback_OnPlayerConnect(int clientID)
 
 void Script::call_callback_OnConsoleCommand(std::string cmd)
 {
+    static metrics::Histogram& duration = metrics::Registry::Get().AddHistogram("x3mp_script_callback_duration_us", "Time spent in script callbacks in microseconds", "callback=\"onConsoleCommand\"");
+    metrics::ScopedTimer timer(duration);
     for (const auto& value : scripts)
     {
         value->call_OnConsoleCommand(cmd);
@@ -45,6 +49,151 @@ extern int luaopen_luamylib(lua_State *L)
     return 0;
 }
 
+/*
+ * Ship handles are light userdata carrying the ship ID (offset by one so ID 0
+ * is not NULL). All light userdata share one metatable, so __index/__newindex
+ * resolve the ID and read or write the Universe entity in place. A handle to a
+ * deleted ship reads as nil instead of dangling.
+ */
+struct ShipField
+{
+    const char* name;
+    int32_t x3::net::Entity::* member;
+    bool writable;
+    bool transform;
+};
+
+static const ShipField shipFields[] = {
+    {"Model", &x3::net::Entity::Model, false, false},
+    {"Owner", &x3::net::Entity::Owner, true, false},
+    {"NetOwnerID", &x3::net::Entity::NetOwnerID, true, false},
+    {"PosX", &x3::net::Entity::PosX, true, true},
+    {"PosY", &x3::net::Entity::PosY, true, true},
+    {"PosZ", &x3::net::Entity::PosZ, true, true},
+    {"RotX", &x3::net::Entity::RotX, true, true},
+    {"RotY", &x3::net::Entity::RotY, true, true},
+    {"RotZ", &x3::net::Entity::RotZ, true, true},
+    {"RotW", &x3::net::Entity::RotW, true, true},
+    {"UpX", &x3::net::Entity::UpX, true, true},
+    {"UpY", &x3::net::Entity::UpY, true, true},
+    {"UpZ", &x3::net::Entity::UpZ, true, true},
+    {"UpW", &x3::net::Entity::UpW, true, true},
+    {"LookAtX", &x3::net::Entity::LookAtX, true, true},
+    {"LookAtY", &x3::net::Entity::LookAtY, true, true},
+    {"LookAtZ", &x3::net::Entity::LookAtZ, true, true},
+    {"VelX", &x3::net::Entity::VelX, true, true},
+    {"VelY", &x3::net::Entity::VelY, true, true},
+    {"VelZ", &x3::net::Entity::VelZ, true, true},
+};
+
+static const ShipField* find_ship_field(const char* name)
+{
+    for (const auto& field : shipFields)
+    {
+        if (strcmp(field.name, name) == 0)
+            return &field;
+    }
+    return nullptr;
+}
+
+static void push_ship_handle(lua_State* L, size_t id)
+{
+    lua_pushlightuserdata(L, (void*)(uintptr_t)(id + 1));
+}
+
+// Accepts either a ship handle or a plain numeric ship ID.
+static bool to_ship_id(lua_State* L, int idx, size_t& id)
+{
+    if (lua_islightuserdata(L, idx))
+    {
+        uintptr_t raw = (uintptr_t)lua_touserdata(L, idx);
+        if (raw == 0)
+            return false;
+        id = raw - 1;
+    }
+    else if (lua_isnumber(L, idx))
+        id = (size_t)lua_tointeger(L, idx);
+    else
+        return false;
+    return id < ServerSingleton->GetUniverse()->entities->size();
+}
+
+static x3::net::Entity* to_ship(lua_State* L, int idx, size_t& id)
+{
+    if (!to_ship_id(L, idx, id))
+        return nullptr;
+    return (*ServerSingleton->GetUniverse()->entities)[id].get();
+}
+
+static int ship_index(lua_State* L)
+{
+    size_t id;
+    x3::net::Entity* entity = to_ship(L, 1, id);
+    const char* key = lua_tostring(L, 2);
+    if (entity == nullptr || key == nullptr)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+    if (strcmp(key, "ID") == 0)
+    {
+        lua_pushinteger(L, id);
+        return 1;
+    }
+    const ShipField* field = find_ship_field(key);
+    if (field == nullptr)
+        lua_pushnil(L);
+    else
+        lua_pushinteger(L, entity->*(field->member));
+    return 1;
+}
+
+static int ship_newindex(lua_State* L)
+{
+    size_t id;
+    x3::net::Entity* entity = to_ship(L, 1, id);
+    if (entity == nullptr)
+        return luaL_error(L, "attempt to write to a deleted ship");
+    const char* key = lua_tostring(L, 2);
+    const ShipField* field = key ? find_ship_field(key) : nullptr;
+    if (field == nullptr || !field->writable)
+        return luaL_error(L, "ship field '%s' is not writable", key ? key : "?");
+    int32_t value = (int32_t)luaL_checknumber(L, 3);
+    // Ownership changes have to keep the owner index in sync
+    if (field->member == &x3::net::Entity::NetOwnerID)
+        ServerSingleton->GetUniverse()->SetNetOwner(id, value);
+    else
+        entity->*(field->member) = value;
+    ServerSingleton->GetUniverse()->MarkDirty(id, field->transform ? Universe::DirtyTransform : Universe::DirtyOwner);
+    return 0;
+}
+
+static int ship_tostring(lua_State* L)
+{
+    size_t id;
+    if (!to_ship_id(L, 1, id))
+        lua_pushstring(L, "ship(invalid)");
+    else
+        lua_pushstring(L, ("ship(" + std::to_string(id) + ")").c_str());
+    return 1;
+}
+
+static const struct luaL_Reg shiphandlelib [] = {
+    {"__index", ship_index},
+    {"__newindex", ship_newindex},
+    {"__tostring", ship_tostring},
+    {NULL, NULL}
+};
+
+static void luaopen_shiphandle(lua_State* L)
+{
+    lua_pushlightuserdata(L, nullptr);
+    lua_newtable(L);
+    luaL_setfuncs(L, shiphandlelib, 0);
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+}
+
 std::shared_ptr<Script> Script::Init(std::string path)
 {
     std::shared_ptr<Script> script = std::make_shared<Script>();
@@ -54,6 +203,21 @@ std::shared_ptr<Script> Script::Init(std::string path)
     luaopen_luamylib(script->L);
     lua_register(script->L, "createShip", lua_CreateShip);
     lua_register(script->L, "deleteShip", lua_DeleteShip);
+    lua_register(script->L, "createShips", lua_CreateShips);
+    lua_register(script->L, "deleteShips", lua_DeleteShips);
+    lua_register(script->L, "getShip", lua_GetShip);
+    lua_register(script->L, "getShipsOwnedBy", lua_GetShipsOwnedBy);
+    lua_register(script->L, "transferShips", lua_TransferShips);
+    lua_register(script->L, "forEachShip", lua_ForEachShip);
+    lua_register(script->L, "getShipsInRadius", lua_GetShipsInRadius);
+    lua_register(script->L, "getShipsInBox", lua_GetShipsInBox);
+    lua_register(script->L, "setShipsPositions", lua_SetShipsPositions);
+    lua_register(script->L, "setUpdateBands", lua_SetUpdateBands);
+    lua_register(script->L, "setUpdateSpeedLookahead", lua_SetUpdateSpeedLookahead);
+    lua_register(script->L, "setPlayerTarget", lua_SetPlayerTarget);
+    lua_register(script->L, "setIngressLimit", lua_SetIngressLimit);
+    lua_register(script->L, "setIngressMaxViolations", lua_SetIngressMaxViolations);
+    luaopen_shiphandle(script->L);
     if (luaL_dofile(script->L, path.c_str())) {
         Screen::LogError(lua_tostring(script->L, -1));
         return nullptr;
@@ -130,4 +294,243 @@ int lua_DeleteShip(lua_State *L)
     int32_t id = (int32_t)lua_tonumber(L, 1);
     ServerSingleton->DeleteShip(id);
     return 1;
-}
\ No newline at end of file
+}
+// createShips(model, count[, { {x, y, z}, ... }]) returns a table with the new ship IDs
+int lua_CreateShips(lua_State* L)
+{
+    int32_t model = (int32_t)lua_tonumber(L, 1);
+    lua_Integer count = luaL_checkinteger(L, 2);
+    // There are only so many ship IDs; a larger count must not reach an allocation
+    size_t clamped = count > 0 ? (size_t)std::min<lua_Integer>(count, (lua_Integer)Server::MaxShips) : 0;
+    std::vector<std::array<int32_t, 3>> positions;
+    if (lua_istable(L, 3))
+    {
+        size_t n = std::min(lua_rawlen(L, 3), clamped);
+        positions.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            positions[i] = { 0, 0, 0 };
+            lua_rawgeti(L, 3, i + 1);
+            // Rows that aren't { x, y, z } tables leave the ship at the origin
+            if (lua_istable(L, -1))
+            {
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    lua_rawgeti(L, -1, axis + 1);
+                    positions[i][axis] = (int32_t)lua_tonumber(L, -1);
+                    lua_pop(L, 1);
+                }
+            }
+            lua_pop(L, 1);
+        }
+    }
+
+    std::vector<size_t> ids = ServerSingleton->CreateShips(model, clamped, positions);
+    lua_createtable(L, (int)ids.size(), 0);
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        lua_pushinteger(L, ids[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+// deleteShips({ ship, ... }) where each ship is a handle or an ID
+int lua_DeleteShips(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    std::vector<size_t> ids;
+    size_t n = lua_rawlen(L, 1);
+    ids.reserve(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t id;
+        lua_rawgeti(L, 1, i + 1);
+        if (to_ship_id(L, -1, id))
+            ids.push_back(id);
+        lua_pop(L, 1);
+    }
+    ServerSingleton->DeleteShips(ids);
+    return 0;
+}
+
+int lua_GetShip(lua_State* L)
+{
+    size_t id;
+    if (to_ship(L, 1, id) == nullptr)
+        lua_pushnil(L);
+    else
+        push_ship_handle(L, id);
+    return 1;
+}
+
+int lua_GetShipsOwnedBy(lua_State* L)
+{
+    int32_t owner = (int32_t)lua_tonumber(L, 1);
+    const std::vector<size_t>& owned = ServerSingleton->GetUniverse()->GetOwnedEntities(owner);
+    lua_createtable(L, (int)owned.size(), 0);
+    for (size_t i = 0; i < owned.size(); i++)
+    {
+        push_ship_handle(L, owned[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+// transferShips(fromClientID, toClientID) hands every ship of one player to another
+int lua_TransferShips(lua_State* L)
+{
+    int32_t from = (int32_t)lua_tonumber(L, 1);
+    int32_t to = (int32_t)lua_tonumber(L, 2);
+    ServerSingleton->GetUniverse()->TransferOwnership(from, to);
+    return 0;
+}
+
+int lua_ForEachShip(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    auto& entities = *ServerSingleton->GetUniverse()->entities;
+    for (size_t i = 0; i < entities.size(); i++)
+    {
+        if (entities[i] == nullptr)
+            continue;
+        lua_pushvalue(L, 1);
+        push_ship_handle(L, i);
+        lua_call(L, 1, 0);
+    }
+    return 0;
+}
+
+static void push_ship_handles(lua_State* L, const std::vector<size_t>& ids)
+{
+    lua_createtable(L, (int)ids.size(), 0);
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        push_ship_handle(L, ids[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+int lua_GetShipsInRadius(lua_State* L)
+{
+    float x = (float)luaL_checknumber(L, 1);
+    float y = (float)luaL_checknumber(L, 2);
+    float z = (float)luaL_checknumber(L, 3);
+    float radius = (float)luaL_checknumber(L, 4);
+
+    std::vector<size_t> ids;
+    ServerSingleton->GetUniverse()->columns->QueryRadius(x, y, z, radius, ids);
+    push_ship_handles(L, ids);
+    return 1;
+}
+
+// getShipsInBox(minX, minY, minZ, maxX, maxY, maxZ), bounds inclusive
+int lua_GetShipsInBox(lua_State* L)
+{
+    int32_t min[3], max[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        min[axis] = (int32_t)luaL_checknumber(L, 1 + axis);
+        max[axis] = (int32_t)luaL_checknumber(L, 4 + axis);
+    }
+
+    std::vector<size_t> ids;
+    ServerSingleton->GetUniverse()->columns->QueryBox(min, max, ids);
+    push_ship_handles(L, ids);
+    return 1;
+}
+
+// setShipsPositions({ [ship] = { x, y, z }, ... }) where ship is a handle or an ID
+int lua_SetShipsPositions(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_pushnil(L);
+    while (lua_next(L, 1) != 0)
+    {
+        size_t id;
+        x3::net::Entity* entity = to_ship(L, -2, id);
+        if (entity != nullptr && lua_istable(L, -1))
+        {
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            lua_rawgeti(L, -3, 3);
+            entity->PosX = (int32_t)lua_tonumber(L, -3);
+            entity->PosY = (int32_t)lua_tonumber(L, -2);
+            entity->PosZ = (int32_t)lua_tonumber(L, -1);
+            lua_pop(L, 3);
+            ServerSingleton->GetUniverse()->MarkDirty(id, Universe::DirtyTransform);
+        }
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+// setUpdateBands({ { distance, hz }, ... }) sets how often ships are sent to a
+// player depending on their distance; ships beyond the last band use its rate
+int lua_SetUpdateBands(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    std::vector<LodBand> bands;
+    lua_Integer n = luaL_len(L, 1);
+    for (lua_Integer i = 1; i <= n; i++)
+    {
+        lua_rawgeti(L, 1, i);
+        if (lua_istable(L, -1))
+        {
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            float distance = (float)lua_tonumber(L, -2);
+            double hz = lua_tonumber(L, -1);
+            lua_pop(L, 2);
+            if (hz > 0)
+                bands.push_back({ distance, std::chrono::milliseconds((int64_t)(1000.0 / hz)) });
+        }
+        lua_pop(L, 1);
+    }
+    ServerSingleton->GetLodPolicy().SetBands(bands);
+    return 0;
+}
+
+// setUpdateSpeedLookahead(seconds): fast ships count as this many seconds of travel closer
+int lua_SetUpdateSpeedLookahead(lua_State* L)
+{
+    ServerSingleton->GetLodPolicy().SetSpeedLookahead((float)luaL_checknumber(L, 1));
+    return 0;
+}
+
+// setPlayerTarget(clientID, ship) makes the ship replicate to the player with
+// priority; nil as ship clears it. Returns false for unknown clients.
+int lua_SetPlayerTarget(lua_State* L)
+{
+    int32_t clientID = (int32_t)luaL_checkinteger(L, 1);
+    size_t id = (size_t)-1;
+    if (!lua_isnoneornil(L, 2) && !to_ship_id(L, 2, id))
+        return luaL_argerror(L, 2, "ship handle or ID expected");
+    lua_pushboolean(L, ServerSingleton->SetPlayerTarget(clientID, id));
+    return 1;
+}
+
+// setIngressLimit(type, rate, burst) limits what each client may send of a
+// packet type, e.g. setIngressLimit("ShipUpdate", 60, 120); rate 0 lifts it
+int lua_SetIngressLimit(lua_State* L)
+{
+    const char* name = luaL_checkstring(L, 1);
+    double rate = luaL_checknumber(L, 2);
+    double burst = luaL_optnumber(L, 3, rate);
+    for (size_t i = 0; i < x3::net::PacketTypeCount; i++)
+    {
+        if (strcmp(name, x3::net::PacketTypeName((x3::net::PacketType)i)) == 0)
+        {
+            ServerSingleton->GetIngressPolicy().SetLimit((x3::net::PacketType)i, rate, burst);
+            return 0;
+        }
+    }
+    return luaL_argerror(L, 1, "unknown packet type");
+}
+
+// setIngressMaxViolations(count): clients dropping more packets than this within 10 s are disconnected; 0 never
+int lua_SetIngressMaxViolations(lua_State* L)
+{
+    ServerSingleton->GetIngressPolicy().SetMaxViolations((uint32_t)luaL_checkinteger(L, 1));
+    return 0;
+}
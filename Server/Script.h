@@ -7,6 +7,20 @@
 
 int lua_CreateShip(lua_State *L); 
 int lua_DeleteShip(lua_State* L);
+int lua_CreateShips(lua_State* L);
+int lua_DeleteShips(lua_State* L);
+int lua_GetShip(lua_State* L);
+int lua_GetShipsOwnedBy(lua_State* L);
+int lua_TransferShips(lua_State* L);
+int lua_ForEachShip(lua_State* L);
+int lua_GetShipsInRadius(lua_State* L);
+int lua_GetShipsInBox(lua_State* L);
+int lua_SetShipsPositions(lua_State* L);
+int lua_SetUpdateBands(lua_State* L);
+int lua_SetUpdateSpeedLookahead(lua_State* L);
+int lua_SetPlayerTarget(lua_State* L);
+int lua_SetIngressLimit(lua_State* L);
+int lua_SetIngressMaxViolations(lua_State* L);
 
 class Script{
     private:
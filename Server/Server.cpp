@@ -1,38 +1,15 @@
 #include "Server.h"
 #include "Quaternion.h"
-
-SteamNetworkingMicroseconds g_logTimeZero;
+#include <cmath>
+#include <cstdio>
 
 Server *Server::instance = 0;
+// std::min takes it by reference, which needs a definition before C++17
+const size_t Server::MaxShips;
 std::unique_ptr<Server> ServerSingleton = std::unique_ptr<Server>(Server::getInstance());
 
-static Server* s_pCallbackInstance;
-
 bool g_bQuit = false;
 
-void InitSteamDatagramConnectionSockets()
-{
-	SteamDatagramErrMsg errMsg;
-	if (!GameNetworkingSockets_Init(nullptr, errMsg))
-		Screen::LogError("GameNetworkingSockets_Init failed.");
-
-	g_logTimeZero = SteamNetworkingUtils()->GetLocalTimestamp();
-
-	// Fixed TODO: Reimplemented debug output function
-	SteamNetworkingUtils()->SetDebugOutputFunction(k_ESteamNetworkingSocketsDebugOutputType_Msg, [](ESteamNetworkingSocketsDebugOutputType eType, const char* pszMsg) {
-		Screen::Log(pszMsg);
-	});
-}
-
-void ShutdownSteamDatagramConnectionSockets()
-{
-	// Give connections time to finish up.  This is an application layer protocol
-	// here, it's not TCP.  Note that if you have an application layer protocol, pending operations should be completed.
-	std::this_thread::sleep_for(std::chrono::milliseconds(500));
-
-	GameNetworkingSockets_Kill();
-}
-
 /////////////////////////////////////////////////////////////////////////////
 //
 // Server
@@ -43,42 +20,107 @@ void Server::Init(std::shared_ptr<Universe> universe, std::function<void(int)> c
 {
 	this->universe = universe;
 	this->callback_OnPlayerConnect = callback_OnPlayerConnect;
+	InitMetrics();
 }
 
-void Server::Run(uint16 nPort)
+void Server::InitMetrics()
 {
-	// Select instance to use.  For now we'll always use the default.
-	// But we could use SteamGameServerNetworkingSockets() on Steam.
-	m_pInterface = SteamNetworkingSockets();
+	metrics::Registry& registry = metrics::Registry::Get();
+	for (size_t i = 0; i < x3::net::PacketTypeCount; i++)
+	{
+		std::string labels = std::string("type=\"") + x3::net::PacketTypeName((x3::net::PacketType)i) + "\"";
+		m_metrics.packetsReceived[i] = &registry.AddCounter("x3mp_packets_received_total", "Packets received by type", labels);
+		m_metrics.bytesReceived[i] = &registry.AddCounter("x3mp_bytes_received_total", "Bytes received by packet type", labels);
+		m_metrics.packetsSent[i] = &registry.AddCounter("x3mp_packets_sent_total", "Packets sent by type, counted per recipient", labels);
+		m_metrics.bytesSent[i] = &registry.AddCounter("x3mp_bytes_sent_total", "Bytes sent by packet type, counted per recipient", labels);
+		m_metrics.packetsLimited[i] = &registry.AddCounter("x3mp_packets_limited_total", "Received packets dropped by the ingress rate limits by type", labels);
+	}
+	m_metrics.packetsMalformed = &registry.AddCounter("x3mp_packets_malformed_total", "Received messages too short or of unknown type");
+	m_metrics.clientsKicked = &registry.AddCounter("x3mp_clients_kicked_total", "Clients disconnected for exceeding the ingress rate limits");
+	m_metrics.shipsCreated = &registry.AddCounter("x3mp_ships_created_total", "Ships created");
+	m_metrics.shipsDeleted = &registry.AddCounter("x3mp_ships_deleted_total", "Ships deleted");
+	m_metrics.shipsLive = &registry.AddGauge("x3mp_ships", "Ships currently in the universe");
+	m_metrics.clientsConnected = &registry.AddGauge("x3mp_clients", "Connected clients");
+	m_metrics.tickDuration = &registry.AddHistogram("x3mp_tick_duration_us", "Server loop work per iteration in microseconds, excluding sleep");
+	m_metrics.broadcastRecipients = &registry.AddHistogram("x3mp_broadcast_recipients", "Recipients per broadcast packet");
+	m_metrics.broadcastDuration = &registry.AddHistogram("x3mp_broadcast_duration_us", "Time to hand one broadcast to all recipients in microseconds");
+	// Per-client values are recorded into shared distributions; the "clients" command has the breakdown
+	m_metrics.clientPing = &registry.AddHistogram("x3mp_client_ping_ms", "Client round trip time per connection sample in milliseconds");
+	m_metrics.clientLoss = &registry.AddHistogram("x3mp_client_loss_permille", "Packet loss towards the client per connection sample in permille");
+	m_metrics.clientPendingBytes = &registry.AddHistogram("x3mp_client_pending_bytes", "Bytes queued for a client per connection sample");
+	m_metrics.clientQueueTime = &registry.AddHistogram("x3mp_client_queue_time_us", "Send queue delay for a client per connection sample in microseconds");
+	m_metrics.clientPingMax = &registry.AddGauge("x3mp_client_ping_max_ms", "Highest client ping at the last connection sample");
+	m_metrics.clientPendingBytesMax = &registry.AddGauge("x3mp_client_pending_bytes_max", "Most bytes queued for any client at the last connection sample");
+	m_metrics.snapshotShips = &registry.AddHistogram("x3mp_snapshot_ships", "Ship updates sent to a client per snapshot");
+	m_metrics.replicationBacklog = &registry.AddHistogram("x3mp_replication_backlog", "Ships still queued for a client after its snapshot");
+	m_metrics.clientsCongested = &registry.AddGauge("x3mp_clients_congested", "Clients whose send rate is backing off");
+	m_metrics.dirtyShips = &registry.AddHistogram("x3mp_dirty_ships", "Ships changed per tick");
+	m_metrics.shipsSerialized = &registry.AddCounter("x3mp_ships_serialized_total", "Ship states serialized into ShipUpdate packets");
+	m_metrics.updatesStale = &registry.AddCounter("x3mp_updates_stale_total", "Ship updates dropped because a newer one was already applied");
+	m_metrics.updatesSettled = &registry.AddCounter("x3mp_updates_settled_total", "Reliable resends of ships whose last unreliable update was not followed up");
+	m_metrics.updatesDeferred = &registry.AddCounter("x3mp_updates_deferred_total", "Ship updates held back because their distance band was not due yet");
+	m_lastStatsTime = m_clock->Now();
+}
 
-	// Start listening
-	SteamNetworkingIPAddr serverLocalAddr;
-	serverLocalAddr.Clear();
-	serverLocalAddr.m_port = nPort;
-	SteamNetworkingConfigValue_t opt;
-	opt.SetPtr(k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged, (void*)SteamNetConnectionStatusChangedCallback);
-	m_hListenSock = m_pInterface->CreateListenSocketIP(serverLocalAddr, 1, &opt);
-	if (m_hListenSock == k_HSteamListenSocket_Invalid)
-		Screen::LogError("Failed to listen on port " + std::to_string(nPort));
-	m_hPollGroup = m_pInterface->CreatePollGroup();
-	if (m_hPollGroup == k_HSteamNetPollGroup_Invalid)
-		Screen::LogError("Failed to listen on port " + std::to_string(nPort));
+void Server::PrintStats()
+{
+	auto now = m_clock->Now();
+	double seconds = std::max(std::chrono::duration<double>(now - m_lastStatsTime).count(), 1e-3);
+	m_lastStatsTime = now;
+
+	std::stringstream stream;
+	stream << "Stats over the last " << (int)seconds << "s: " << m_metrics.clientsConnected->Value() << " clients, " << m_metrics.shipsLive->Value() << " ships";
+	Screen::Log(stream.str());
+	for (size_t i = 0; i < x3::net::PacketTypeCount; i++)
+	{
+		uint64_t received = m_metrics.packetsReceived[i]->Value();
+		uint64_t sent = m_metrics.packetsSent[i]->Value();
+		if (received == 0 && sent == 0)
+			continue;
+		stream.str(std::string());
+		stream << "  " << x3::net::PacketTypeName((x3::net::PacketType)i)
+			<< " in " << received << " (" << (int)((received - m_lastStatsReceived[i]) / seconds) << "/s, " << m_metrics.bytesReceived[i]->Value() << " B)"
+			<< " out " << sent << " (" << (int)((sent - m_lastStatsSent[i]) / seconds) << "/s, " << m_metrics.bytesSent[i]->Value() << " B)";
+		Screen::Log(stream.str());
+		m_lastStatsReceived[i] = received;
+		m_lastStatsSent[i] = sent;
+	}
+	stream.str(std::string());
+	stream << "  tick p50 " << m_metrics.tickDuration->Quantile(0.5) << "us p99 " << m_metrics.tickDuration->Quantile(0.99)
+		<< "us, fan-out p50 " << m_metrics.broadcastRecipients->Quantile(0.5) << " p99 " << m_metrics.broadcastRecipients->Quantile(0.99)
+		<< ", malformed " << m_metrics.packetsMalformed->Value();
+	uint64_t limited = 0;
+	for (size_t i = 0; i < x3::net::PacketTypeCount; i++)
+		limited += m_metrics.packetsLimited[i]->Value();
+	stream << ", rate limited " << limited << ", kicked " << m_metrics.clientsKicked->Value();
+	Screen::Log(stream.str());
+}
 
-	// Fixed TODO: Properly convert port number to string to avoid garbage output
-	Screen::Log("Server listening on port " + std::to_string(nPort));
+void Server::Run(std::unique_ptr<Transport> transport, uint16_t nPort)
+{
+	Start(std::move(transport), nPort);
 
 	while (!g_bQuit)
 	{
-		PollIncomingMessages();
-		PollConnectionStateChanges();
+		Tick();
 		std::string cmd = Screen::PollCommand();
 		if(cmd == "exit")
 			g_bQuit = true;
+		if (cmd == "stats")
+		{
+			PrintStats();
+			continue;
+		}
+		if (cmd == "clients")
+		{
+			PrintClients();
+			continue;
+		}
 		if (cmd.rfind("say ", 0) == 0)
 		{
 			x3::net::ChatMessage message;
 			cmd = cmd.erase(0, 4).insert(0, "Server: ");
-			strncpy_s(message.Message, sizeof(message.Message), cmd.c_str(), _TRUNCATE);
+			snprintf(message.Message, sizeof(message.Message), "%s", cmd.c_str());
 			SendPacketToAllClients(&message);
 			continue;
 		}
@@ -88,169 +130,412 @@ void Server::Run(uint16 nPort)
 		// Fixed TODO: Improved sleep timing - use shorter sleep for better responsiveness
 		// and longer sleep when no activity to reduce CPU usage
 		if (cmd.empty()) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			m_clock->SleepFor(std::chrono::milliseconds(5));
 		} else {
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			m_clock->SleepFor(std::chrono::milliseconds(1));
 		}
 	}
 
+	Stop();
+}
+
+void Server::Start(std::unique_ptr<Transport> transport, uint16_t nPort)
+{
+	m_transport = std::move(transport);
+	m_lastStatsTime = m_clock->Now();
+
+	// Start listening
+	if (!m_transport->Listen(nPort))
+		Screen::LogError("Failed to listen on port " + std::to_string(nPort));
+
+	// Fixed TODO: Properly convert port number to string to avoid garbage output
+	Screen::Log(std::string("Server listening on port ") + std::to_string(nPort) + " (" + m_transport->Name() + ")");
+
+	// Prometheus metrics live on the next port, local only
+	if (m_metricsExporter.Start(nPort + 1))
+		Screen::Log("Metrics at http://127.0.0.1:" + std::to_string(nPort + 1) + "/metrics");
+	else
+		Screen::LogError("Failed to serve metrics on port " + std::to_string(nPort + 1));
+}
+
+void Server::Tick()
+{
+	metrics::ScopedTimer tickTimer(*m_metrics.tickDuration);
+	m_transport->Poll(*this);
+	DisconnectKickedClients();
+	FlushLifecycle();
+	CollectChanges();
+	ReplicateShips();
+	if (m_clock->Now() >= m_nextConnectionSample)
+		SampleConnections();
+	m_transport->Flush();
+}
+
+void Server::Stop()
+{
 	// Close all the connections
 	Screen::Log("Closing connections...\n");
-	for (auto it : m_mapClients)
+	for (const Client_t& c : m_vecClients)
 	{
+		if (c.m_hConn == InvalidTransportConnection)
+			continue;
+
 		// Send them one more goodbye message.  Note that we also have the
 		// connection close reason as a place to send final data.  However,
 		// that's usually best left for more diagnostic/debug text not actual
 		// protocol strings.
 		//SendStringToClient(it.first, "Server is shutting down.  Goodbye.");
 
-		// Close the connection.  We use "linger mode" to ask SteamNetworkingSockets
-		// to flush this out and close gracefully.
-		m_pInterface->CloseConnection(it.first, 0, "Server Shutdown", true);
+		// Close the connection, letting the transport flush what is still queued
+		m_transport->CloseConnection(c.m_hConn, "Server Shutdown");
 	}
-	m_mapClients.clear();
+	m_vecClients.clear();
+	m_vecFreeClientSlots.clear();
 
-	m_pInterface->CloseListenSocket(m_hListenSock);
-	m_hListenSock = k_HSteamListenSocket_Invalid;
+	m_metricsExporter.Stop();
 
-	m_pInterface->DestroyPollGroup(m_hPollGroup);
-	m_hPollGroup = k_HSteamNetPollGroup_Invalid;
+	m_transport->Shutdown();
+	m_transport.reset();
 }
 
-void Server::SendPacketToClient(HSteamNetConnection conn, x3::net::Packet* packet)
+bool Server::SetPlayerTarget(int32_t clientID, size_t shipID)
 {
-	m_pInterface->SendMessageToConnection(conn, packet, packet->size, k_nSteamNetworkingSend_Reliable, nullptr);
+	for (Client_t& c : m_vecClients)
+	{
+		if (c.m_hConn != InvalidTransportConnection && c.clientID == clientID && clientID != -1)
+		{
+			c.m_targetShip = shipID;
+			return true;
+		}
+	}
+	return false;
 }
 
-void Server::SendStringToClient(HSteamNetConnection conn, const char* str)
+Server::Client_t* Server::GetClient(int64_t nConnUserData, TransportConnection conn)
 {
-	m_pInterface->SendMessageToConnection(conn, str, (uint32)strlen(str), k_nSteamNetworkingSend_Reliable, nullptr);
+	if (nConnUserData < 0 || nConnUserData >= (int64_t)m_vecClients.size())
+		return nullptr;
+	Client_t& client = m_vecClients[(size_t)nConnUserData];
+	return client.m_hConn == conn ? &client : nullptr;
 }
 
-void Server::SendPacketToAllClients(x3::net::Packet* packet, HSteamNetConnection except)
+int64_t Server::AddClient(TransportConnection conn)
 {
-	for (auto& c : m_mapClients)
+	uint32_t slot;
+	if (!m_vecFreeClientSlots.empty())
 	{
-		if (c.first != except)
-			SendPacketToClient(c.first, packet);
+		slot = m_vecFreeClientSlots.back();
+		m_vecFreeClientSlots.pop_back();
 	}
+	else
+	{
+		slot = (uint32_t)m_vecClients.size();
+		m_vecClients.emplace_back();
+	}
+	m_vecClients[slot] = Client_t();
+	m_vecClients[slot].m_hConn = conn;
+	m_metrics.clientsConnected->Add(1);
+	return slot;
 }
 
-void Server::SendStringToAllClients(const char* str, HSteamNetConnection except)
+void Server::RemoveClient(int64_t nConnUserData)
 {
-	for (auto& c : m_mapClients)
+	if (nConnUserData < 0 || nConnUserData >= (int64_t)m_vecClients.size())
+		return;
+	m_vecClients[(size_t)nConnUserData] = Client_t();
+	m_vecFreeClientSlots.push_back((uint32_t)nConnUserData);
+	m_metrics.clientsConnected->Add(-1);
+}
+
+void Server::DropClient(int64_t nConnUserData)
+{
+	if (nConnUserData < 0 || nConnUserData >= (int64_t)m_vecClients.size())
+		return;
+
+	// Despawn everything the client owned; the owner index makes this O(owned)
+	int32_t clientID = m_vecClients[(size_t)nConnUserData].clientID;
+	if (clientID != -1)
 	{
-		if (c.first != except)
-			SendStringToClient(c.first, str);
+		std::vector<size_t> owned = universe->GetOwnedEntities(clientID);
+		DeleteShips(owned);
 	}
+
+	RemoveClient(nConnUserData);
 }
 
-void Server::PollIncomingMessages()
+void Server::DisconnectKickedClients()
 {
-	while (!g_bQuit)
+	// Not closed from within OnMessage, so the transport never sees its connections change while it delivers
+	for (int64_t userData : m_vecKickedClients)
 	{
-		ISteamNetworkingMessage* pIncomingMsg = nullptr;
-		int numMsgs = m_pInterface->ReceiveMessagesOnPollGroup(m_hPollGroup, &pIncomingMsg, 1);
-		if (numMsgs == 0)
-			break;
-		if (numMsgs < 0)
-			Screen::LogError("Error checking for messages");
-		assert(numMsgs == 1 && pIncomingMsg);
-		auto itClient = m_mapClients.find(pIncomingMsg->m_conn);
-		assert(itClient != m_mapClients.end());
+		Client_t& client = m_vecClients[(size_t)userData];
+		if (client.m_hConn == InvalidTransportConnection || !client.m_kicked)
+			continue;
+		Screen::Log(client.m_sNick + " was disconnected for flooding (client " + std::to_string(client.clientID) + ")");
+		m_transport->CloseConnection(client.m_hConn, "Rate limit exceeded");
+		m_metrics.clientsKicked->Add();
+		DropClient(userData);
+	}
+	m_vecKickedClients.clear();
+}
+
+void Server::SampleConnections()
+{
+	m_nextConnectionSample = m_clock->Now() + ConnectionSampleInterval;
+
+	int32_t pingMax = 0;
+	int32_t pendingMax = 0;
+	int64_t congested = 0;
+	for (Client_t& c : m_vecClients)
+	{
+		if (c.m_hConn == InvalidTransportConnection)
+			continue;
 
-		x3::net::Packet* packet = (x3::net::Packet*)pIncomingMsg->m_pData;
+		ConnectionSample sample;
+		LaneSample lanes[ConnectionLanes];
+		if (!m_transport->Sample(c.m_hConn, sample, lanes, ConnectionLanes))
+			continue;
+		c.m_stats.AddSample(sample, lanes, ConnectionLanes);
+		c.m_sendRate.Update(c.m_stats);
+		if (c.m_sendRate.Congested())
+			congested++;
+
+		int32_t pending = sample.PendingReliable + sample.PendingUnreliable;
+		m_metrics.clientPing->Record((uint64_t)std::max(sample.PingMs, 0));
+		if (sample.QualityRemote >= 0.0f)
+			m_metrics.clientLoss->Record((uint64_t)((1.0f - sample.QualityRemote) * 1000.0f));
+		m_metrics.clientPendingBytes->Record((uint64_t)std::max(pending, 0));
+		m_metrics.clientQueueTime->Record((uint64_t)std::max<int64_t>(sample.QueueTimeUs, 0));
+		pingMax = std::max(pingMax, sample.PingMs);
+		pendingMax = std::max(pendingMax, pending);
+	}
+	m_metrics.clientPingMax->Set(pingMax);
+	m_metrics.clientPendingBytesMax->Set(pendingMax);
+	m_metrics.clientsCongested->Set(congested);
+}
 
-		//Screen::LogDebug(std::string("Package: ") + std::to_string((int)packet->type));
+void Server::PrintClients()
+{
+	Screen::Log("  id  ping(avg/max)  loss out/in  pending  queue  rate out/est (KB/s)  every  budget  backlog");
+	for (const Client_t& c : m_vecClients)
+	{
+		if (c.m_hConn == InvalidTransportConnection)
+			continue;
 
-		if (packet->type == x3::net::PacketType::ShipUpdate)
+		const ConnectionStats& stats = c.m_stats;
+		char line[160];
+		if (!stats.HasSamples())
 		{
-			//Screen::LogDebug("Ship update.");
-			x3::net::ShipUpdate updatePacket;
-			memcpy(&updatePacket, pIncomingMsg->m_pData, sizeof(x3::net::ShipUpdate));
+			snprintf(line, sizeof(line), "%4d  no samples yet", c.clientID);
+		}
+		else
+		{
+			snprintf(line, sizeof(line), "%4d  %4.0f/%-4d ms   %4.1f%%/%4.1f%%  %7d  %4lldms  %6.1f/%-6.1f        %4lldms  %6zu  %7zu%s",
+				c.clientID, stats.PingMean(), stats.PingMax(),
+				stats.OutLossMean() * 100.0, stats.InLossMean() * 100.0,
+				stats.PendingBytes(), (long long)(stats.QueueTimeMaxUs() / 1000),
+				stats.OutBytesPerSecMean() / 1024.0, stats.SendRateMean() / 1024.0,
+				(long long)c.m_sendRate.Interval().count(), c.m_sendRate.Budget(sizeof(x3::net::ShipUpdate)),
+				c.m_mailbox.Size(), c.m_sendRate.Congested() ? "  congested" : "");
+		}
+		Screen::Log(line);
+	}
+}
 
-			if (m_mapClients[pIncomingMsg->m_conn].clientID == (*universe->entities)[updatePacket.ShipID]->NetOwnerID)
-			{
-				(*universe->entities)[updatePacket.ShipID]->PosX = updatePacket.PosX;
-				(*universe->entities)[updatePacket.ShipID]->PosY = updatePacket.PosY;
-				(*universe->entities)[updatePacket.ShipID]->PosZ = updatePacket.PosZ;
-				(*universe->entities)[updatePacket.ShipID]->RotX = updatePacket.RotX;
-				(*universe->entities)[updatePacket.ShipID]->RotY = updatePacket.RotY;
-				(*universe->entities)[updatePacket.ShipID]->RotZ = updatePacket.RotZ;
-				(*universe->entities)[updatePacket.ShipID]->RotW = updatePacket.RotW;
-				(*universe->entities)[updatePacket.ShipID]->UpX = updatePacket.UpX;
-				(*universe->entities)[updatePacket.ShipID]->UpY = updatePacket.UpY;
-				(*universe->entities)[updatePacket.ShipID]->UpZ = updatePacket.UpZ;
-				(*universe->entities)[updatePacket.ShipID]->LookAtX = updatePacket.LookAtX;
-				(*universe->entities)[updatePacket.ShipID]->LookAtY = updatePacket.LookAtY;
-				(*universe->entities)[updatePacket.ShipID]->LookAtZ = updatePacket.LookAtZ;
-			}
-			else
+void Server::SendPacketToClient(TransportConnection conn, x3::net::Packet* packet, SendMode mode)
+{
+	m_transport->Send(conn, packet, (uint32_t)packet->size, mode);
+	if ((size_t)packet->type < x3::net::PacketTypeCount)
+	{
+		m_metrics.packetsSent[(size_t)packet->type]->Add();
+		m_metrics.bytesSent[(size_t)packet->type]->Add(packet->size);
+	}
+}
+
+void Server::SendStringToClient(TransportConnection conn, const char* str)
+{
+	m_transport->Send(conn, str, (uint32_t)strlen(str), SendMode::Reliable);
+}
+
+void Server::SendPacketToAllClients(x3::net::Packet* packet, TransportConnection except)
+{
+	metrics::ScopedTimer timer(*m_metrics.broadcastDuration);
+	uint64_t recipients = 0;
+	for (const Client_t& c : m_vecClients)
+	{
+		if (c.m_hConn != InvalidTransportConnection && c.m_hConn != except)
+		{
+			SendPacketToClient(c.m_hConn, packet);
+			recipients++;
+		}
+	}
+	m_metrics.broadcastRecipients->Record(recipients);
+}
+
+void Server::SendPacketToJoinedClients(x3::net::Packet* packet)
+{
+	metrics::ScopedTimer timer(*m_metrics.broadcastDuration);
+	uint64_t recipients = 0;
+	for (const Client_t& c : m_vecClients)
+	{
+		if (c.clientID != -1)
+		{
+			SendPacketToClient(c.m_hConn, packet);
+			recipients++;
+		}
+	}
+	m_metrics.broadcastRecipients->Record(recipients);
+}
+
+void Server::SendStringToAllClients(const char* str, TransportConnection except)
+{
+	for (const Client_t& c : m_vecClients)
+	{
+		if (c.m_hConn != InvalidTransportConnection && c.m_hConn != except)
+			SendStringToClient(c.m_hConn, str);
+	}
+}
+
+void Server::OnMessage(TransportConnection conn, int64_t userData, const void* data, uint32_t size)
+{
+	Client_t* pClient = GetClient(userData, conn);
+	assert(pClient);
+	if (!pClient)
+		return;
+
+	const x3::net::Packet* packet = (const x3::net::Packet*)data;
+	if (size < sizeof(x3::net::Packet) || (size_t)packet->type >= x3::net::PacketTypeCount)
+	{
+		m_metrics.packetsMalformed->Add();
+		return;
+	}
+	m_metrics.packetsReceived[(size_t)packet->type]->Add();
+	m_metrics.bytesReceived[(size_t)packet->type]->Add(size);
+
+	// Limited before anything is decoded, so a flooding client costs little more than its receive
+	if (pClient->m_kicked)
+		return;
+	IngressLimiter::Verdict verdict = pClient->m_ingress.Admit(m_ingressPolicy, packet->type, m_clock->Now());
+	if (verdict != IngressLimiter::Verdict::Accept)
+	{
+		m_metrics.packetsLimited[(size_t)packet->type]->Add();
+		if (verdict == IngressLimiter::Verdict::Disconnect)
+		{
+			pClient->m_kicked = true;
+			m_vecKickedClients.push_back(userData);
+		}
+		return;
+	}
+
+	//Screen::LogDebug(std::string("Package: ") + std::to_string((int)packet->type));
+
+	if (packet->type == x3::net::PacketType::ShipUpdate)
+	{
+		//Screen::LogDebug("Ship update.");
+		if (size < sizeof(x3::net::ShipUpdate))
+		{
+			m_metrics.packetsMalformed->Add();
+			return;
+		}
+		x3::net::ShipUpdate updatePacket;
+		memcpy(&updatePacket, data, sizeof(x3::net::ShipUpdate));
+
+		if (updatePacket.ShipID < 0 || updatePacket.ShipID >= (int32_t)universe->entities->size() || (*universe->entities)[updatePacket.ShipID] == nullptr)
+			return;
+
+		if (pClient->clientID == (*universe->entities)[updatePacket.ShipID]->NetOwnerID)
+		{
+			// Unreliable updates can arrive out of order; never step a ship back in time
+			if (!universe->AcceptSequence(updatePacket.ShipID, updatePacket.Sequence))
 			{
-				std::stringstream stream;
-				stream << "Ignoring packet for ship " << updatePacket.ShipID << ". NetOwner missmatch! Owner is " << (*universe->entities)[updatePacket.ShipID]->NetOwnerID << " but packet was sent by " << m_mapClients[pIncomingMsg->m_conn].clientID;
-				Screen::Log(stream.str());
+				m_metrics.updatesStale->Add();
+				return;
 			}
 
-			SendPacketToAllClients(&updatePacket, pIncomingMsg->m_conn);
+			(*universe->entities)[updatePacket.ShipID]->PosX = updatePacket.PosX;
+			(*universe->entities)[updatePacket.ShipID]->PosY = updatePacket.PosY;
+			(*universe->entities)[updatePacket.ShipID]->PosZ = updatePacket.PosZ;
+			(*universe->entities)[updatePacket.ShipID]->RotX = updatePacket.RotX;
+			(*universe->entities)[updatePacket.ShipID]->RotY = updatePacket.RotY;
+			(*universe->entities)[updatePacket.ShipID]->RotZ = updatePacket.RotZ;
+			(*universe->entities)[updatePacket.ShipID]->RotW = updatePacket.RotW;
+			(*universe->entities)[updatePacket.ShipID]->UpX = updatePacket.UpX;
+			(*universe->entities)[updatePacket.ShipID]->UpY = updatePacket.UpY;
+			(*universe->entities)[updatePacket.ShipID]->UpZ = updatePacket.UpZ;
+			(*universe->entities)[updatePacket.ShipID]->LookAtX = updatePacket.LookAtX;
+			(*universe->entities)[updatePacket.ShipID]->LookAtY = updatePacket.LookAtY;
+			(*universe->entities)[updatePacket.ShipID]->LookAtZ = updatePacket.LookAtZ;
+			(*universe->entities)[updatePacket.ShipID]->VelX = updatePacket.VelX;
+			(*universe->entities)[updatePacket.ShipID]->VelY = updatePacket.VelY;
+			(*universe->entities)[updatePacket.ShipID]->VelZ = updatePacket.VelZ;
+			universe->MarkDirty(updatePacket.ShipID, Universe::DirtyTransform, pClient->clientID);
 		}
-			
-		if (packet->type == x3::net::PacketType::Connect)
+		else
 		{
-			//Screen::LogDebug("Connect package.");
-			x3::net::Connect connectPacket;
-			memcpy(&connectPacket, pIncomingMsg->m_pData, sizeof(x3::net::Connect));
-
-			m_mapClients[pIncomingMsg->m_conn].clientID = lastClientID;
+			std::stringstream stream;
+			stream << "Ignoring packet for ship " << updatePacket.ShipID << ". NetOwner missmatch! Owner is " << (*universe->entities)[updatePacket.ShipID]->NetOwnerID << " but packet was sent by " << pClient->clientID;
+			Screen::Log(stream.str());
+		}
+	}
+		
+	if (packet->type == x3::net::PacketType::Connect)
+	{
+		//Screen::LogDebug("Connect package.");
+		if (size < sizeof(x3::net::Connect))
+		{
+			m_metrics.packetsMalformed->Add();
+			return;
+		}
+		// Already joined: the client resends its Connect until it sees the
+		// acknowledge and drops the snapshot until then, so repeat both, but
+		// never spawn again
+		if (pClient->clientID != -1)
+		{
+			FlushLifecycle();
 
 			x3::net::ConnectAcknowledge acknowledge;
-			acknowledge.ClientID = lastClientID;
+			acknowledge.ClientID = pClient->clientID;
+			acknowledge.ShipID = (int32_t)pClient->m_shipID;
 			acknowledge.size = sizeof(x3::net::ConnectAcknowledge);
 			acknowledge.type = x3::net::PacketType::ConnectAcknowledge;
+			SendPacketToClient(conn, &acknowledge);
+			SendShipSnapshot(conn, pClient->m_shipID);
+			return;
+		}
 
-			acknowledge.ShipID = CreateShip(connectPacket.Model);
+		x3::net::Connect connectPacket;
+		memcpy(&connectPacket, data, sizeof(x3::net::Connect));
 
-			SendPacketToClient(pIncomingMsg->m_conn, &acknowledge);
+		// Bring everybody already in game up to date first, so the snapshot
+		// below and the pending lifecycle batches never overlap.
+		FlushLifecycle();
 
-			for (size_t i = 0; i < 65535; i++)
-			{
-				if ((*universe->entities).at(i) == nullptr || i == acknowledge.ShipID)
-					continue;
+		x3::net::ConnectAcknowledge acknowledge;
+		acknowledge.ClientID = lastClientID;
+		acknowledge.size = sizeof(x3::net::ConnectAcknowledge);
+		acknowledge.type = x3::net::PacketType::ConnectAcknowledge;
 
-				x3::net::CreateShip packet;
-				packet.ShipID = i;
-				packet.Model = (*universe->entities)[i]->Model;
-				packet.type = x3::net::PacketType::CreateShip;
-				packet.size = sizeof(x3::net::CreateShip);
-				packet.PosX = (*universe->entities)[i]->PosX;
-				packet.PosY = (*universe->entities)[i]->PosY;
-				packet.PosZ = (*universe->entities)[i]->PosZ;
-				packet.RotX = (*universe->entities)[i]->RotX;
-				packet.RotY = (*universe->entities)[i]->RotY;
-				packet.RotZ = (*universe->entities)[i]->RotZ;
-				packet.RotW = (*universe->entities)[i]->RotW;
-				packet.UpX = (*universe->entities)[i]->UpX;
-				packet.UpY = (*universe->entities)[i]->UpY;
-				packet.UpZ = (*universe->entities)[i]->UpZ;
-				packet.LookAtX = (*universe->entities)[i]->LookAtX;
-				packet.LookAtY = (*universe->entities)[i]->LookAtY;
-				packet.LookAtZ = (*universe->entities)[i]->LookAtZ;
-				SendPacketToClient(pIncomingMsg->m_conn, &packet);
-			}
+		acknowledge.ShipID = CreateShip(connectPacket.Model);
 
-			(*universe->entities).at(acknowledge.ShipID)->NetOwnerID = acknowledge.ClientID;
+		SendPacketToClient(conn, &acknowledge);
 
-			lastClientID++;
+		SendShipSnapshot(conn, acknowledge.ShipID);
 
-			Script::call_callback_OnPlayerConnect(m_mapClients[pIncomingMsg->m_conn].clientID);
-		}
-		pIncomingMsg->Release();
+		universe->SetNetOwner(acknowledge.ShipID, acknowledge.ClientID);
+
+		// Joined from now on: the own ship's spawn goes out with the next lifecycle flush
+		pClient->clientID = lastClientID;
+		pClient->m_shipID = acknowledge.ShipID;
+
+		lastClientID++;
+
+		Script::call_callback_OnPlayerConnect(pClient->clientID);
 	}
 }
 
 size_t Server::CreateShip(int32_t model)
 {
-	for (size_t i = 0; i < 65535; i++)
+	for (size_t i = 0; i < MaxShips; i++)
 	{
 		if ((*universe->entities).at(i) != nullptr)
 			continue;
@@ -258,51 +543,302 @@ size_t Server::CreateShip(int32_t model)
 		(*universe->entities)[i]->Model = model;
 		(*universe->entities)[i]->NetOwnerID = -1;
 		(*universe->entities)[i]->Owner = -1;
+		universe->SyncColumns(i);
+		m_motion.Forget(i);
 
-		x3::net::CreateShip packet;
-		packet.ShipID = i;
-		packet.Model = model;
-		packet.type = x3::net::PacketType::CreateShip;
-		packet.size = sizeof(x3::net::CreateShip);
-		/*Quaternion rot = ToQuaternion(0, 0, 0);
-		Quaternion up = ToQuaternion(0, 1, 0);
-		packet.PosX = 0;
-		packet.PosY = 0;
-		packet.PosZ = 0;
-		packet.UpX = up.x;
-		packet.UpY = up.y;
-		packet.UpZ = up.z;
-		packet.UpW = up.w;
-		packet.RotX = rot.x;
-		packet.RotY = rot.y;
-		packet.RotZ = rot.z;
-		packet.RotW = rot.w;
-		*/
-		packet.UpX = 0;
-		packet.UpY = 0;
-		packet.UpZ = 0;
-		packet.UpW = 0;
-		packet.RotX = 0;
-		packet.RotY = 0;
-		packet.RotZ = 0;
-		packet.RotW = 0;
-		SendPacketToAllClients(&packet);
+		m_vecPendingSpawns.push_back(i);
+		m_metrics.shipsCreated->Add();
+		m_metrics.shipsLive->Add(1);
 		return i;
 	}
 	return -1;
 }
 
+std::vector<size_t> Server::CreateShips(int32_t model, size_t count, const std::vector<std::array<int32_t, 3>>& positions)
+{
+	// Never more than fit, however many a script asks for
+	count = std::min(count, MaxShips);
+	std::vector<size_t> ids;
+	ids.reserve(count);
+	for (size_t n = 0; n < count; n++)
+	{
+		size_t id = CreateShip(model);
+		if (id == (size_t)-1)
+			break;
+		if (n < positions.size())
+		{
+			(*universe->entities)[id]->PosX = positions[n][0];
+			(*universe->entities)[id]->PosY = positions[n][1];
+			(*universe->entities)[id]->PosZ = positions[n][2];
+			universe->SyncColumns(id);
+		}
+		ids.push_back(id);
+	}
+	return ids;
+}
+
 void Server::DeleteShip(size_t id)
 {
 	if ((*universe->entities).at(id) == nullptr)
 		return;
+	universe->SetNetOwner(id, -1);
 	(*universe->entities)[id] = nullptr;
+	universe->SyncColumns(id);
+	m_motion.Forget(id);
+	m_metrics.shipsDeleted->Add();
+	m_metrics.shipsLive->Add(-1);
+
+	// A ship created and deleted within the same iteration was never seen by anyone
+	auto itSpawn = std::find(m_vecPendingSpawns.begin(), m_vecPendingSpawns.end(), id);
+	if (itSpawn != m_vecPendingSpawns.end())
+		m_vecPendingSpawns.erase(itSpawn);
+	else
+		m_vecPendingDespawns.push_back(id);
+}
+
+void Server::DeleteShips(const std::vector<size_t>& ids)
+{
+	for (size_t id : ids)
+		DeleteShip(id);
+}
+
+static void FillShipSpawn(x3::net::ShipSpawn& spawn, size_t id, const x3::net::Entity& entity, uint32_t sequence)
+{
+	spawn.ShipID = id;
+	spawn.Sequence = sequence;
+	spawn.Model = entity.Model;
+	spawn.Owner = entity.Owner;
+	spawn.PosX = entity.PosX;
+	spawn.PosY = entity.PosY;
+	spawn.PosZ = entity.PosZ;
+	spawn.RotX = entity.RotX;
+	spawn.RotY = entity.RotY;
+	spawn.RotZ = entity.RotZ;
+	spawn.RotW = entity.RotW;
+	spawn.UpX = entity.UpX;
+	spawn.UpY = entity.UpY;
+	spawn.UpZ = entity.UpZ;
+	spawn.UpW = entity.UpW;
+	spawn.LookAtX = entity.LookAtX;
+	spawn.LookAtY = entity.LookAtY;
+	spawn.LookAtZ = entity.LookAtZ;
+}
+
+void Server::FlushLifecycle()
+{
+	// Despawns go first so a slot freed and reused in the same iteration arrives in order
+	if (!m_vecPendingDespawns.empty())
+	{
+		x3::net::DeleteShips packet;
+		packet.type = x3::net::PacketType::DeleteShips;
+		for (size_t i = 0; i < m_vecPendingDespawns.size();)
+		{
+			packet.Count = 0;
+			while (i < m_vecPendingDespawns.size() && packet.Count < x3::net::MaxShipDespawnsPerPacket)
+				packet.ShipIDs[packet.Count++] = (int32_t)m_vecPendingDespawns[i++];
+			packet.size = x3::net::BatchSize(packet);
+			SendPacketToJoinedClients(&packet);
+		}
+		m_vecPendingDespawns.clear();
+	}
+
+	if (!m_vecPendingSpawns.empty())
+	{
+		x3::net::CreateShips packet;
+		packet.type = x3::net::PacketType::CreateShips;
+		for (size_t i = 0; i < m_vecPendingSpawns.size();)
+		{
+			packet.Count = 0;
+			while (i < m_vecPendingSpawns.size() && packet.Count < x3::net::MaxShipSpawnsPerPacket)
+			{
+				size_t id = m_vecPendingSpawns[i++];
+				FillShipSpawn(packet.Ships[packet.Count++], id, *(*universe->entities)[id], universe->Version(id));
+			}
+			packet.size = x3::net::BatchSize(packet);
+			SendPacketToJoinedClients(&packet);
+		}
+		m_vecPendingSpawns.clear();
+	}
+}
+
+void Server::SendShipSnapshot(TransportConnection conn, size_t except)
+{
+	x3::net::CreateShips packet;
+	packet.type = x3::net::PacketType::CreateShips;
+	packet.Count = 0;
+	for (size_t i = 0; i < 65535; i++)
+	{
+		if ((*universe->entities)[i] == nullptr || i == except)
+			continue;
+
+		FillShipSpawn(packet.Ships[packet.Count++], i, *(*universe->entities)[i], universe->Version(i));
+		if (packet.Count == x3::net::MaxShipSpawnsPerPacket)
+		{
+			packet.size = x3::net::BatchSize(packet);
+			SendPacketToClient(conn, &packet);
+			packet.Count = 0;
+		}
+	}
+	if (packet.Count > 0)
+	{
+		packet.size = x3::net::BatchSize(packet);
+		SendPacketToClient(conn, &packet);
+	}
+}
+
+void Server::CollectChanges()
+{
+	universe->TakeDirty(m_vecDirtyShips);
+	m_metrics.dirtyShips->Record(m_vecDirtyShips.size());
+	if (m_vecDirtyShips.empty())
+		return;
+
+	auto now = m_clock->Now();
+	for (const Universe::DirtyEntity& dirty : m_vecDirtyShips)
+	{
+		// Transforms and owner changes are replicated as updates; the rest travels with spawns
+		if (!(dirty.fields & (Universe::DirtyTransform | Universe::DirtyOwner)))
+			continue;
+		const auto& entity = (*universe->entities)[dirty.id];
+		if (entity == nullptr)
+			continue;
+		if (dirty.fields & Universe::DirtyTransform)
+			m_motion.Observe(dirty.id, entity->PosX, entity->PosY, entity->PosZ, entity->VelX, entity->VelY, entity->VelZ, now);
+		// The client that sent the change already has it. A new owner always
+		// comes from the server, so then everybody gets the ship, the previous
+		// owner included, and the new sequence puts them on the server's state.
+		MarkShipChanged(dirty.id, (dirty.fields & Universe::DirtyOwner) ? -1 : dirty.writer);
+	}
+}
 
-	x3::net::DeleteShip packet;
+void Server::MarkShipChanged(size_t id, int32_t exceptClient)
+{
+	for (Client_t& c : m_vecClients)
+	{
+		if (c.clientID != -1 && (exceptClient == -1 || c.clientID != exceptClient))
+			c.m_mailbox.Post(id);
+	}
+}
+
+static void FillShipUpdate(x3::net::ShipUpdate& packet, size_t id, const x3::net::Entity& entity, uint32_t sequence)
+{
+	packet.type = x3::net::PacketType::ShipUpdate;
+	packet.size = sizeof(x3::net::ShipUpdate);
 	packet.ShipID = id;
-	packet.type = x3::net::PacketType::DeleteShip;
-	packet.size = sizeof(x3::net::DeleteShip);
-	SendPacketToAllClients(&packet);
+	packet.Sequence = sequence;
+	packet.PosX = entity.PosX;
+	packet.PosY = entity.PosY;
+	packet.PosZ = entity.PosZ;
+	packet.RotX = entity.RotX;
+	packet.RotY = entity.RotY;
+	packet.RotZ = entity.RotZ;
+	packet.RotW = entity.RotW;
+	packet.UpX = entity.UpX;
+	packet.UpY = entity.UpY;
+	packet.UpZ = entity.UpZ;
+	packet.UpW = entity.UpW;
+	packet.LookAtX = entity.LookAtX;
+	packet.LookAtY = entity.LookAtY;
+	packet.LookAtZ = entity.LookAtZ;
+	packet.VelX = entity.VelX;
+	packet.VelY = entity.VelY;
+	packet.VelZ = entity.VelZ;
+}
+
+x3::net::ShipUpdate& Server::SerializeShip(size_t id, const x3::net::Entity& entity)
+{
+	if (m_vecSerializedShips.size() <= id)
+		m_vecSerializedShips.resize(universe->entities->size());
+	SerializedShip& cached = m_vecSerializedShips[id];
+	uint32_t version = universe->Version(id);
+	if (!cached.valid || cached.version != version)
+	{
+		FillShipUpdate(cached.packet, id, entity, version);
+		cached.version = version;
+		cached.valid = true;
+		m_metrics.shipsSerialized->Add();
+	}
+	return cached.packet;
+}
+
+void Server::ReplicateShips()
+{
+	auto now = m_clock->Now();
+	int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+	for (Client_t& c : m_vecClients)
+	{
+		if (c.clientID == -1 || c.m_mailbox.Empty() || now < c.m_nextSnapshot)
+			continue;
+
+		const x3::net::Entity* viewer = c.m_shipID < 65535 ? (*universe->entities)[c.m_shipID].get() : nullptr;
+
+		size_t budget = c.m_sendRate.Budget(sizeof(x3::net::ShipUpdate));
+		size_t sent = 0;
+		size_t id;
+
+		// Ships that stopped changing get their last state once more, reliably
+		while (sent < budget && c.m_mailbox.TakeSettled(nowMs, ShipSettleDelayMs, id))
+		{
+			const auto& entity = (*universe->entities).at(id);
+			if (entity == nullptr)
+				continue;
+
+			SendPacketToClient(c.m_hConn, &SerializeShip(id, *entity));
+			c.m_mailbox.Sent(id, nowMs, true);
+			m_metrics.updatesSettled->Add();
+			sent++;
+		}
+
+		auto distanceTo = [&](const x3::net::Entity& entity) {
+			if (viewer == nullptr)
+				return 0.0f;
+			float dx = (float)entity.PosX - (float)viewer->PosX;
+			float dy = (float)entity.PosY - (float)viewer->PosY;
+			float dz = (float)entity.PosZ - (float)viewer->PosZ;
+			return std::sqrt(dx * dx + dy * dy + dz * dz);
+		};
+
+		// Every posted ship gains priority for the time since the last snapshot
+		float elapsed = std::min(std::chrono::duration<float>(now - c.m_lastSnapshot).count(), 1.0f);
+		c.m_lastSnapshot = now;
+		c.m_mailbox.Accumulate([&](size_t shipID) {
+			const auto& entity = (*universe->entities)[shipID];
+			if (entity == nullptr)
+				return 0.0f;
+			float age = c.m_mailbox.EverSent(shipID) ? std::min((nowMs - c.m_mailbox.LastSent(shipID)) / 1000.0f, MaxChangeAgeSec) : MaxChangeAgeSec;
+			float change = m_motion.Speed(shipID) * age;
+			return m_priorityWeights.Weight(distanceTo(*entity), change, shipID == c.m_targetShip) * elapsed;
+		});
+
+		// The budget goes to the highest priorities among ships whose distance band is due;
+		// the rest stay posted and keep accumulating
+		c.m_mailbox.TakeHighest(budget - sent, [&](size_t shipID) {
+			const auto& entity = (*universe->entities)[shipID];
+			if (entity == nullptr || viewer == nullptr)
+				return true;
+			auto interval = m_lodPolicy.Interval(distanceTo(*entity), m_motion.RelativeSpeed(shipID, c.m_shipID));
+			if (nowMs - c.m_mailbox.LastSent(shipID) >= interval.count())
+				return true;
+			// Once per posted update, however many snapshots it waits
+			if (c.m_mailbox.Defer(shipID))
+				m_metrics.updatesDeferred->Add();
+			return false;
+		}, m_vecSnapshotShips);
+
+		for (size_t shipID : m_vecSnapshotShips)
+		{
+			const auto& entity = (*universe->entities)[shipID];
+			if (entity == nullptr)
+				continue;
+
+			SendPacketToClient(c.m_hConn, &SerializeShip(shipID, *entity), SendMode::Unreliable);
+			c.m_mailbox.Sent(shipID, nowMs, false);
+			sent++;
+		}
+		c.m_nextSnapshot = now + c.m_sendRate.Interval();
+		m_metrics.snapshotShips->Record(sent);
+		m_metrics.replicationBacklog->Record(c.m_mailbox.Size());
+	}
 }
 
 /*void Server::PollLocalUserInput()
@@ -374,123 +910,39 @@ void Server::DeleteShip(size_t id)
 	}
 }*/
 
-void Server::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t* pInfo)
+int64_t Server::OnConnectionOpened(TransportConnection conn, const std::string& description)
 {
-	// What's the state of the connection?
-	switch (pInfo->m_info.m_eState)
-	{
-	case k_ESteamNetworkingConnectionState_None:
-		// NOTE: We will get callbacks here when we destroy connections.  You can ignore these.
-		break;
-
-	case k_ESteamNetworkingConnectionState_ClosedByPeer:
-	case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
-	{
-		// Ignore if they were not previously connected.  (If they disconnected
-		// before we accepted the connection.)
-		if (pInfo->m_eOldState == k_ESteamNetworkingConnectionState_Connected)
-		{
-
-			// Locate the client.  Note that it should have been found, because this
-			// is the only codepath where we remove clients (except on shutdown),
-			// and connection change callbacks are dispatched in queue order.
-			auto itClient = m_mapClients.find(pInfo->m_hConn);
-			assert(itClient != m_mapClients.end());
+	// This must be a new connection
+	Screen::Log("Connection request from " + description);
 
-			// Select appropriate log messages
-			const char* pszDebugLogAction;
-			if (pInfo->m_info.m_eState == k_ESteamNetworkingConnectionState_ProblemDetectedLocally)
-			{
-				pszDebugLogAction = "problem detected locally";
-				//sprintf_s(temp, "Alas, %s hath fallen into shadow.  (%s)", itClient->second.m_sNick.c_str(), pInfo->m_info.m_szEndDebug);
-				Screen::Log(std::string("Alas, ") + itClient->second.m_sNick.c_str() + std::string("hath fallen into shadow. (") + pInfo->m_info.m_szEndDebug + std::string(")"));
-			}
-			else
-			{
-				// Note that here we could check the reason code to see if
-				// it was a "usual" connection or an "unusual" one.
-				pszDebugLogAction = "closed by peer";
-				//sprintf_s(temp, "%s hath departed", itClient->second.m_sNick.c_str());
-				Screen::Log(std::string() + itClient->second.m_sNick.c_str() + " has departed.");
-			}
-
-			// Spew something to our own log.  Note that because we put their nick
-			// as the connection description, it will show up, along with their
-			// transport-specific data (e.g. their IP address)
-			std::stringstream stream;
-			stream << "Connection" << pInfo->m_info.m_szConnectionDescription << pszDebugLogAction << "reason: " << pInfo->m_info.m_eEndReason << " " << pInfo->m_info.m_szEndDebug;
-			Screen::Log(stream.str());
-
-			m_mapClients.erase(itClient);
-
-			// Send a message so everybody else knows what happened
-			//SendStringToAllClients(temp);
-		}
-		else
-		{
-			assert(pInfo->m_eOldState == k_ESteamNetworkingConnectionState_Connecting);
-		}
+	// Add them to the client list; the slot is remembered on the connection
+	return AddClient(conn);
+}
 
-		// Clean up the connection.  This is important!
-		// The connection is "closed" in the network sense, but
-		// it has not been destroyed.  We must close it on our end, too
-		// to finish up.  The reason information do not matter in this case,
-		// and we cannot linger because it's already closed on the other end,
-		// so we just pass 0's.
-		m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
-		break;
-	}
+void Server::OnConnectionClosed(TransportConnection conn, int64_t userData, const std::string& reason, bool problem)
+{
+	// Locate the client.  Note that it should have been found, because this
+	// is the only codepath where we remove clients (except on shutdown),
+	// and connection changes are reported in order.
+	Client_t* pClient = GetClient(userData, conn);
+	assert(pClient);
+	if (!pClient)
+		return;
 
-	case k_ESteamNetworkingConnectionState_Connecting:
+	// Select appropriate log messages
+	if (problem)
 	{
-		// This must be a new connection
-		assert(m_mapClients.find(pInfo->m_hConn) == m_mapClients.end());
-
-		Screen::Log(std::string("Connection request from ") + pInfo->m_info.m_szConnectionDescription);
-
-		// A client is attempting to connect
-		// Try to accept the connection.
-		if (m_pInterface->AcceptConnection(pInfo->m_hConn) != k_EResultOK)
-		{
-			// This could fail.  If the remote host tried to connect, but then
-			// disconnected, the connection may already be half closed.  Just
-			// destroy whatever we have on our side.
-			m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
-			Screen::Log("Can't accept connection.  (It was already closed?)");
-			break;
-		}
-
-		// Assign the poll group
-		if (!m_pInterface->SetConnectionPollGroup(pInfo->m_hConn, m_hPollGroup))
-		{
-			m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
-			Screen::Log("Failed to set poll group?");
-			break;
-		}
-
-		// Add them to the client list, using std::map wacky syntax
-		m_mapClients[pInfo->m_hConn];
-		break;
+		Screen::Log(std::string("Alas, ") + pClient->m_sNick.c_str() + std::string("hath fallen into shadow. (") + reason + std::string(")"));
 	}
-
-	case k_ESteamNetworkingConnectionState_Connected:
-		// We will get a callback immediately after accepting the connection.
-		// Since we are the server, we can ignore this, it's not news to us.
-		break;
-
-	default:
-		// Silences -Wswitch
-		break;
+	else
+	{
+		// Note that here we could check the reason code to see if
+		// it was a "usual" connection or an "unusual" one.
+		Screen::Log(std::string() + pClient->m_sNick.c_str() + " has departed.");
 	}
-}
 
-void Server::SteamNetConnectionStatusChangedCallback(SteamNetConnectionStatusChangedCallback_t* pInfo)
-{
-	s_pCallbackInstance->OnSteamNetConnectionStatusChanged(pInfo);
-}
+	DropClient(userData);
 
-void Server::PollConnectionStateChanges()
-{
-	s_pCallbackInstance = this;
-	m_pInterface->RunCallbacks();
+	// Send a message so everybody else knows what happened
+	//SendStringToAllClients(temp);
 }
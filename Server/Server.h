@@ -19,36 +19,47 @@
 #include <iterator>
 #include <functional>
 
-#ifdef WIN32
-#include <GameNetworkingSockets/steam/steamnetworkingsockets.h>
-#include <GameNetworkingSockets/steam/isteamnetworkingutils.h>
-#else
-#include "../../SDKs/GameNetworkingSockets/include/steam/steamnetworkingsockets.h"
-#include "../../SDKs/GameNetworkingSockets/include/steam/isteamnetworkingutils.h"
-#endif
-#ifndef STEAMNETWORKINGSOCKETS_OPENSOURCE
-#include <GameNetworkingSockets/steam/steam_api.h>
-#endif
-
 #include "Universe.h"
 #include "Screen.h"
+#include "Transport.h"
 #include <net_message.h>
 #include <net_packets.h>
 #include <net_entity.h>
 #include "Script.h"
+#include "Metrics.h"
+#include "ConnectionStats.h"
+#include "Replication.h"
+#include "Ingress.h"
+#include "Clock.h"
 
 
 
-void InitSteamDatagramConnectionSockets();
-void ShutdownSteamDatagramConnectionSockets();
-
-class Server
+class Server : public TransportHandler
 {
 public:
 	void Init(std::shared_ptr<Universe> universe, std::function<void(int)> callback_OnPlayerConnect);
-	void Run(uint16 nPort);
+	void Run(std::unique_ptr<Transport> transport, uint16_t nPort);
+	// Run in parts, for harnesses that drive the server loop themselves.
+	// Tick is one loop iteration, without console commands or the sleep.
+	void Start(std::unique_ptr<Transport> transport, uint16_t nPort);
+	void Tick();
+	void Stop();
+	void PrintStats();
+	// Ship IDs run from 0 to MaxShips - 1
+	static const size_t MaxShips = 65535;
 	size_t CreateShip(int32_t model);
+	std::vector<size_t> CreateShips(int32_t model, size_t count, const std::vector<std::array<int32_t, 3>>& positions = {});
 	void DeleteShip(size_t id);
+	void DeleteShips(const std::vector<size_t>& ids);
+	std::shared_ptr<Universe> GetUniverse() const { return universe; }
+	LodPolicy& GetLodPolicy() { return m_lodPolicy; }
+	PriorityWeights& GetPriorityWeights() { return m_priorityWeights; }
+	IngressPolicy& GetIngressPolicy() { return m_ingressPolicy; }
+	// The loop's time source; set before Start, and share it with a LoopbackTransport for virtual time
+	void SetClock(std::shared_ptr<Clock> clock) { m_clock = clock; }
+	std::shared_ptr<Clock> GetClock() const { return m_clock; }
+	// Replicates the ship to the player more eagerly; -1 clears the target
+	bool SetPlayerTarget(int32_t clientID, size_t shipID);
 
 	std::function<void(int)> callback_OnPlayerConnect;
 
@@ -61,34 +72,133 @@ public:
 private:
 	Server() {	}
 	std::shared_ptr<Universe> universe;
-	HSteamListenSocket m_hListenSock = 0;
-	HSteamNetPollGroup m_hPollGroup= 0;
-	ISteamNetworkingSockets* m_pInterface = 0;
+	std::unique_ptr<Transport> m_transport;
+	std::shared_ptr<Clock> m_clock = std::make_shared<SteadyClock>();
 
 	struct Client_t
 	{
+		TransportConnection m_hConn = InvalidTransportConnection;
 		std::string m_sNick;
 		int32_t clientID = -1;
+		// The ship the player flies; replication rates are measured from it
+		size_t m_shipID = (size_t)-1;
+		size_t m_targetShip = (size_t)-1;
+		ConnectionStats m_stats;
+		// Ship updates are sent per client, paced by its own link
+		OutboundMailbox m_mailbox;
+		SendRateController m_sendRate;
+		std::chrono::steady_clock::time_point m_nextSnapshot;
+		std::chrono::steady_clock::time_point m_lastSnapshot;
+		IngressLimiter m_ingress;
+		// Over its ingress limits too often; disconnected after this poll
+		bool m_kicked = false;
 	};
 
-	std::map< HSteamNetConnection, Client_t > m_mapClients;
+	// Clients live in index-stable slots. The slot index is attached to the
+	// connection as user data, so message handlers get their client in O(1)
+	// from it, and broadcasts walk one contiguous array.
+	std::vector<Client_t> m_vecClients;
+	std::vector<uint32_t> m_vecFreeClientSlots;
+	Client_t* GetClient(int64_t nConnUserData, TransportConnection conn);
+	int64_t AddClient(TransportConnection conn);
+	void RemoveClient(int64_t nConnUserData);
+	// Despawns the client's ships and frees its slot
+	void DropClient(int64_t nConnUserData);
 	int32_t lastClientID = 0; 
 
-	void SendPacketToClient(HSteamNetConnection conn, x3::net::Packet* packet);
-	void SendStringToClient(HSteamNetConnection conn, const char* str);
-	void SendPacketToAllClients(x3::net::Packet* packet, HSteamNetConnection except = k_HSteamNetConnection_Invalid);
-	void SendStringToAllClients(const char* str, HSteamNetConnection except = k_HSteamNetConnection_Invalid);
-
-	void PollIncomingMessages();
-
-	void OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t* pInfo);
-
-	static void SteamNetConnectionStatusChangedCallback(SteamNetConnectionStatusChangedCallback_t* pInfo);
-
-	void PollConnectionStateChanges();
-
-protected:
-	std::shared_ptr<Universe> GetUniverse() const { return universe; }
+	// Transport stats are sampled for every client on this interval
+	static constexpr std::chrono::milliseconds ConnectionSampleInterval{ 250 };
+	// Lanes the connections are configured with; GameNetworkingSockets defaults to one
+	static const int ConnectionLanes = 1;
+	std::chrono::steady_clock::time_point m_nextConnectionSample;
+	void SampleConnections();
+	void PrintClients();
+
+	IngressPolicy m_ingressPolicy;
+	std::vector<int64_t> m_vecKickedClients;
+	void DisconnectKickedClients();
+
+	// Posts the ships the universe marked dirty this tick to the clients' mailboxes
+	void CollectChanges();
+	std::vector<Universe::DirtyEntity> m_vecDirtyShips;
+	// Posts a ship to every joined client but exceptClient
+	void MarkShipChanged(size_t id, int32_t exceptClient = -1);
+	// Each changed ship is serialized once, however many clients it goes to
+	struct SerializedShip
+	{
+		bool valid = false;
+		uint32_t version = 0;
+		x3::net::ShipUpdate packet;
+	};
+	std::vector<SerializedShip> m_vecSerializedShips;
+	x3::net::ShipUpdate& SerializeShip(size_t id, const x3::net::Entity& entity);
+	// Sends each client whose snapshot is due up to its budget of queued ships
+	void ReplicateShips();
+	LodPolicy m_lodPolicy;
+	MotionTracker m_motion;
+	PriorityWeights m_priorityWeights;
+	// Movement older than this no longer adds to a ship's change weight
+	static constexpr float MaxChangeAgeSec = 5.0f;
+	std::vector<size_t> m_vecSnapshotShips;
+	// A ship last sent unreliably gets one reliable resend once it stayed unchanged this long.
+	// Longer than the clients' dead reckoning heartbeat (1 s by default), or every heartbeat
+	// of a ship flying straight would count as settled and go out twice.
+	static const int64_t ShipSettleDelayMs = 1500;
+
+	// Spawns and despawns are coalesced and sent as CreateShips/DeleteShips once per loop iteration
+	std::vector<size_t> m_vecPendingSpawns;
+	std::vector<size_t> m_vecPendingDespawns;
+	void FlushLifecycle();
+	void SendShipSnapshot(TransportConnection conn, size_t except);
+
+	void SendPacketToClient(TransportConnection conn, x3::net::Packet* packet, SendMode mode = SendMode::Reliable);
+	void SendStringToClient(TransportConnection conn, const char* str);
+	void SendPacketToAllClients(x3::net::Packet* packet, TransportConnection except = InvalidTransportConnection);
+	void SendStringToAllClients(const char* str, TransportConnection except = InvalidTransportConnection);
+	void SendPacketToJoinedClients(x3::net::Packet* packet);
+
+	int64_t OnConnectionOpened(TransportConnection conn, const std::string& description) override;
+	void OnConnectionClosed(TransportConnection conn, int64_t userData, const std::string& reason, bool problem) override;
+	void OnMessage(TransportConnection conn, int64_t userData, const void* data, uint32_t size) override;
+
+	struct Metrics_t
+	{
+		metrics::Counter* packetsReceived[x3::net::PacketTypeCount];
+		metrics::Counter* bytesReceived[x3::net::PacketTypeCount];
+		metrics::Counter* packetsSent[x3::net::PacketTypeCount];
+		metrics::Counter* bytesSent[x3::net::PacketTypeCount];
+		metrics::Counter* packetsMalformed;
+		metrics::Counter* packetsLimited[x3::net::PacketTypeCount];
+		metrics::Counter* clientsKicked;
+		metrics::Counter* shipsCreated;
+		metrics::Counter* shipsDeleted;
+		metrics::Gauge* shipsLive;
+		metrics::Gauge* clientsConnected;
+		metrics::Histogram* tickDuration;
+		metrics::Histogram* broadcastRecipients;
+		metrics::Histogram* broadcastDuration;
+		metrics::Histogram* clientPing;
+		metrics::Histogram* clientLoss;
+		metrics::Histogram* clientPendingBytes;
+		metrics::Histogram* clientQueueTime;
+		metrics::Gauge* clientPingMax;
+		metrics::Gauge* clientPendingBytesMax;
+		metrics::Histogram* snapshotShips;
+		metrics::Histogram* replicationBacklog;
+		metrics::Gauge* clientsCongested;
+		metrics::Counter* updatesDeferred;
+		metrics::Counter* updatesSettled;
+		metrics::Histogram* dirtyShips;
+		metrics::Counter* shipsSerialized;
+		metrics::Counter* updatesStale;
+	} m_metrics;
+	metrics::Exporter m_metricsExporter;
+	void InitMetrics();
+
+	// Snapshot of the packet counters at the previous "stats" command, for rates
+	std::chrono::steady_clock::time_point m_lastStatsTime;
+	uint64_t m_lastStatsReceived[x3::net::PacketTypeCount] = {};
+	uint64_t m_lastStatsSent[x3::net::PacketTypeCount] = {};
 };
 
 extern std::unique_ptr<Server> ServerSingleton;
\ No newline at end of file
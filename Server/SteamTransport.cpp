@@ -0,0 +1,233 @@
+#include "SteamTransport.h"
+#include "Screen.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+SteamNetworkingMicroseconds g_logTimeZero;
+
+static SteamTransport* s_pCallbackInstance;
+
+void InitSteamDatagramConnectionSockets()
+{
+	SteamDatagramErrMsg errMsg;
+	if (!GameNetworkingSockets_Init(nullptr, errMsg))
+		Screen::LogError("GameNetworkingSockets_Init failed.");
+
+	g_logTimeZero = SteamNetworkingUtils()->GetLocalTimestamp();
+
+	// Fixed TODO: Reimplemented debug output function
+	SteamNetworkingUtils()->SetDebugOutputFunction(k_ESteamNetworkingSocketsDebugOutputType_Msg, [](ESteamNetworkingSocketsDebugOutputType eType, const char* pszMsg) {
+		Screen::Log(pszMsg);
+	});
+}
+
+void ShutdownSteamDatagramConnectionSockets()
+{
+	// Give connections time to finish up.  This is an application layer protocol
+	// here, it's not TCP.  Note that if you have an application layer protocol, pending operations should be completed.
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	GameNetworkingSockets_Kill();
+}
+
+bool SteamTransport::Listen(uint16_t port)
+{
+	InitSteamDatagramConnectionSockets();
+
+	// Select instance to use.  For now we'll always use the default.
+	// But we could use SteamGameServerNetworkingSockets() on Steam.
+	m_pInterface = SteamNetworkingSockets();
+
+	// Start listening
+	SteamNetworkingIPAddr serverLocalAddr;
+	serverLocalAddr.Clear();
+	serverLocalAddr.m_port = port;
+	SteamNetworkingConfigValue_t opt;
+	opt.SetPtr(k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged, (void*)SteamNetConnectionStatusChangedCallback);
+	m_hListenSock = m_pInterface->CreateListenSocketIP(serverLocalAddr, 1, &opt);
+	if (m_hListenSock == k_HSteamListenSocket_Invalid)
+		return false;
+	m_hPollGroup = m_pInterface->CreatePollGroup();
+	return m_hPollGroup != k_HSteamNetPollGroup_Invalid;
+}
+
+void SteamTransport::Poll(TransportHandler& handler)
+{
+	m_pHandler = &handler;
+
+	while (true)
+	{
+		ISteamNetworkingMessage* pIncomingMsg = nullptr;
+		int numMsgs = m_pInterface->ReceiveMessagesOnPollGroup(m_hPollGroup, &pIncomingMsg, 1);
+		if (numMsgs == 0)
+			break;
+		if (numMsgs < 0)
+		{
+			Screen::LogError("Error checking for messages");
+			break;
+		}
+		assert(numMsgs == 1 && pIncomingMsg);
+		handler.OnMessage(pIncomingMsg->m_conn, pIncomingMsg->m_nConnUserData, pIncomingMsg->m_pData, (uint32_t)pIncomingMsg->m_cbSize);
+		pIncomingMsg->Release();
+	}
+
+	s_pCallbackInstance = this;
+	m_pInterface->RunCallbacks();
+	m_pHandler = nullptr;
+}
+
+void SteamTransport::Send(TransportConnection conn, const void* data, uint32_t size, SendMode mode)
+{
+	int nSendFlags = mode == SendMode::Reliable ? k_nSteamNetworkingSend_Reliable : k_nSteamNetworkingSend_UnreliableNoNagle;
+	m_pInterface->SendMessageToConnection(conn, data, size, nSendFlags, nullptr);
+}
+
+bool SteamTransport::Sample(TransportConnection conn, ConnectionSample& sample, LaneSample* lanes, int laneCount)
+{
+	SteamNetConnectionRealTimeStatus_t status;
+	SteamNetConnectionRealTimeLaneStatus_t laneStatus[ConnectionStats::MaxLanes];
+	laneCount = std::min(laneCount, (int)ConnectionStats::MaxLanes);
+	if (m_pInterface->GetConnectionRealTimeStatus(conn, &status, laneCount, laneStatus) != k_EResultOK)
+		return false;
+	if (status.m_eState != k_ESteamNetworkingConnectionState_Connected)
+		return false;
+
+	sample.PingMs = status.m_nPing;
+	sample.QualityLocal = status.m_flConnectionQualityLocal;
+	sample.QualityRemote = status.m_flConnectionQualityRemote;
+	sample.OutBytesPerSec = status.m_flOutBytesPerSec;
+	sample.InBytesPerSec = status.m_flInBytesPerSec;
+	sample.SendRateBytesPerSec = status.m_nSendRateBytesPerSecond;
+	sample.PendingReliable = status.m_cbPendingReliable;
+	sample.PendingUnreliable = status.m_cbPendingUnreliable;
+	sample.SentUnackedReliable = status.m_cbSentUnackedReliable;
+	sample.QueueTimeUs = status.m_usecQueueTime;
+
+	for (int i = 0; i < laneCount; i++)
+	{
+		lanes[i].PendingReliable = laneStatus[i].m_cbPendingReliable;
+		lanes[i].PendingUnreliable = laneStatus[i].m_cbPendingUnreliable;
+		lanes[i].SentUnackedReliable = laneStatus[i].m_cbSentUnackedReliable;
+		lanes[i].QueueTimeUs = laneStatus[i].m_usecQueueTime;
+	}
+	return true;
+}
+
+void SteamTransport::CloseConnection(TransportConnection conn, const char* reason)
+{
+	// We use "linger mode" to ask SteamNetworkingSockets
+	// to flush this out and close gracefully.
+	m_pInterface->CloseConnection(conn, 0, reason, true);
+}
+
+void SteamTransport::Shutdown()
+{
+	m_pInterface->CloseListenSocket(m_hListenSock);
+	m_hListenSock = k_HSteamListenSocket_Invalid;
+
+	m_pInterface->DestroyPollGroup(m_hPollGroup);
+	m_hPollGroup = k_HSteamNetPollGroup_Invalid;
+
+	ShutdownSteamDatagramConnectionSockets();
+}
+
+void SteamTransport::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t* pInfo)
+{
+	// What's the state of the connection?
+	switch (pInfo->m_info.m_eState)
+	{
+	case k_ESteamNetworkingConnectionState_None:
+		// NOTE: We will get callbacks here when we destroy connections.  You can ignore these.
+		break;
+
+	case k_ESteamNetworkingConnectionState_ClosedByPeer:
+	case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
+	{
+		// Ignore if they were not previously connected.  (If they disconnected
+		// before we accepted the connection.)
+		if (pInfo->m_eOldState == k_ESteamNetworkingConnectionState_Connected)
+		{
+			bool problem = pInfo->m_info.m_eState == k_ESteamNetworkingConnectionState_ProblemDetectedLocally;
+
+			// Spew something to our own log.  Note that because we put their nick
+			// as the connection description, it will show up, along with their
+			// transport-specific data (e.g. their IP address)
+			std::stringstream stream;
+			stream << "Connection " << pInfo->m_info.m_szConnectionDescription << " " << (problem ? "problem detected locally" : "closed by peer") << ", reason: " << pInfo->m_info.m_eEndReason << " " << pInfo->m_info.m_szEndDebug;
+			Screen::Log(stream.str());
+
+			m_pHandler->OnConnectionClosed(pInfo->m_hConn, pInfo->m_info.m_nUserData, pInfo->m_info.m_szEndDebug, problem);
+		}
+		else
+		{
+			assert(pInfo->m_eOldState == k_ESteamNetworkingConnectionState_Connecting);
+		}
+
+		// Clean up the connection.  This is important!
+		// The connection is "closed" in the network sense, but
+		// it has not been destroyed.  We must close it on our end, too
+		// to finish up.  The reason information do not matter in this case,
+		// and we cannot linger because it's already closed on the other end,
+		// so we just pass 0's.
+		m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+		break;
+	}
+
+	case k_ESteamNetworkingConnectionState_Connecting:
+	{
+		// A client is attempting to connect
+		// Try to accept the connection.
+		if (m_pInterface->AcceptConnection(pInfo->m_hConn) != k_EResultOK)
+		{
+			// This could fail.  If the remote host tried to connect, but then
+			// disconnected, the connection may already be half closed.  Just
+			// destroy whatever we have on our side.
+			m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+			Screen::Log("Can't accept connection.  (It was already closed?)");
+			break;
+		}
+
+		// Assign the poll group
+		if (!m_pInterface->SetConnectionPollGroup(pInfo->m_hConn, m_hPollGroup))
+		{
+			m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+			Screen::Log("Failed to set poll group?");
+			break;
+		}
+
+		// Let the server add them, and remember what it gave us on the connection
+		int64_t userData = m_pHandler->OnConnectionOpened(pInfo->m_hConn, pInfo->m_info.m_szConnectionDescription);
+		if (userData < 0)
+		{
+			m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+			break;
+		}
+		if (!m_pInterface->SetConnectionUserData(pInfo->m_hConn, userData))
+		{
+			m_pHandler->OnConnectionClosed(pInfo->m_hConn, userData, "Failed to set connection user data", true);
+			m_pInterface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+			Screen::Log("Failed to set connection user data?");
+			break;
+		}
+		break;
+	}
+
+	case k_ESteamNetworkingConnectionState_Connected:
+		// We will get a callback immediately after accepting the connection.
+		// Since we are the server, we can ignore this, it's not news to us.
+		break;
+
+	default:
+		// Silences -Wswitch
+		break;
+	}
+}
+
+void SteamTransport::SteamNetConnectionStatusChangedCallback(SteamNetConnectionStatusChangedCallback_t* pInfo)
+{
+	s_pCallbackInstance->OnSteamNetConnectionStatusChanged(pInfo);
+}
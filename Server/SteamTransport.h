@@ -0,0 +1,43 @@
+#pragma once
+
+#ifdef WIN32
+#include <GameNetworkingSockets/steam/steamnetworkingsockets.h>
+#include <GameNetworkingSockets/steam/isteamnetworkingutils.h>
+#else
+#include "../../SDKs/GameNetworkingSockets/include/steam/steamnetworkingsockets.h"
+#include "../../SDKs/GameNetworkingSockets/include/steam/isteamnetworkingutils.h"
+#endif
+#ifndef STEAMNETWORKINGSOCKETS_OPENSOURCE
+#include <GameNetworkingSockets/steam/steam_api.h>
+#endif
+
+#include "Transport.h"
+
+void InitSteamDatagramConnectionSockets();
+void ShutdownSteamDatagramConnectionSockets();
+
+// GameNetworkingSockets: encrypted connections with reliable messages and
+// its own connection quality reporting
+class SteamTransport : public Transport
+{
+public:
+	const char* Name() const override { return "gns"; }
+
+	bool Listen(uint16_t port) override;
+	void Poll(TransportHandler& handler) override;
+	void Send(TransportConnection conn, const void* data, uint32_t size, SendMode mode) override;
+	bool Sample(TransportConnection conn, ConnectionSample& sample, LaneSample* lanes, int laneCount) override;
+	void CloseConnection(TransportConnection conn, const char* reason) override;
+	void Shutdown() override;
+
+private:
+	HSteamListenSocket m_hListenSock = k_HSteamListenSocket_Invalid;
+	HSteamNetPollGroup m_hPollGroup = k_HSteamNetPollGroup_Invalid;
+	ISteamNetworkingSockets* m_pInterface = nullptr;
+	// Set for the duration of Poll, for the status callback
+	TransportHandler* m_pHandler = nullptr;
+
+	void OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t* pInfo);
+
+	static void SteamNetConnectionStatusChangedCallback(SteamNetConnectionStatusChangedCallback_t* pInfo);
+};
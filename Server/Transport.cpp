@@ -0,0 +1,14 @@
+#include "Transport.h"
+#include "SteamTransport.h"
+#include "UdpTransport.h"
+
+std::unique_ptr<Transport> CreateTransport(const std::string& name)
+{
+	if (name == "gns")
+		return std::make_unique<SteamTransport>();
+#ifdef __linux__
+	if (name == "udp")
+		return std::make_unique<UdpTransport>();
+#endif
+	return nullptr;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "ConnectionStats.h"
+
+// Identifies a connection within its transport; 0 is never a valid connection
+typedef uint32_t TransportConnection;
+const TransportConnection InvalidTransportConnection = 0;
+
+enum class SendMode
+{
+	Reliable,
+	// May be dropped or reordered; sent without waiting to coalesce
+	Unreliable
+};
+
+// What a transport reports back while the server polls it
+class TransportHandler
+{
+public:
+	virtual ~TransportHandler() {}
+	// A peer was accepted. The returned value is attached to the connection and
+	// handed back with each of its messages; a negative value rejects the peer.
+	virtual int64_t OnConnectionOpened(TransportConnection conn, const std::string& description) = 0;
+	// Only for connections OnConnectionOpened accepted. problem is true when this
+	// side gave up on the peer, false when the peer closed the connection.
+	virtual void OnConnectionClosed(TransportConnection conn, int64_t userData, const std::string& reason, bool problem) = 0;
+	// data is only valid during the call
+	virtual void OnMessage(TransportConnection conn, int64_t userData, const void* data, uint32_t size) = 0;
+};
+
+// The server's side of the network: accepts clients, delivers their packets
+// and sends packets to them. Everything is called from the server loop.
+class Transport
+{
+public:
+	virtual ~Transport() {}
+	virtual const char* Name() const = 0;
+
+	virtual bool Listen(uint16_t port) = 0;
+	// Delivers everything received since the last call, and connection changes, to handler
+	virtual void Poll(TransportHandler& handler) = 0;
+	virtual void Send(TransportConnection conn, const void* data, uint32_t size, SendMode mode) = 0;
+	// Puts sends queued by this iteration on the wire; once per server loop iteration
+	virtual void Flush() {}
+	// False if the connection is unknown or not established
+	virtual bool Sample(TransportConnection conn, ConnectionSample& sample, LaneSample* lanes, int laneCount) = 0;
+	// Drops the connection without calling OnConnectionClosed
+	virtual void CloseConnection(TransportConnection conn, const char* reason) = 0;
+	// Closes the listening socket and releases the transport; connections should be closed first
+	virtual void Shutdown() = 0;
+};
+
+// "gns" for GameNetworkingSockets, "udp" for the client's plain datagram
+// protocol where supported. Null for an unknown or unsupported name.
+std::unique_ptr<Transport> CreateTransport(const std::string& name);
@@ -0,0 +1,408 @@
+#ifdef __linux__
+
+#include "UdpTransport.h"
+#include "Screen.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <net_packets.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+constexpr std::chrono::seconds UdpTransport::PeerTimeout;
+constexpr double UdpTransport::ConnectsPerSecond;
+constexpr double UdpTransport::ConnectBurst;
+
+static_assert(sizeof(x3::net::ConnectChallenge) <= sizeof(x3::net::Connect), "A challenge must not be larger than the connect it answers");
+
+// Largest payload of a single UDP datagram, which a GSO send must not exceed either
+static const size_t MaxUdpPayload = 65507;
+
+int UdpTransport::OpenSocket(uint16_t port)
+{
+	int udpSocket = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+	if (udpSocket < 0)
+		return -1;
+
+	// Bursts of snapshots and joins outrun the default buffers; best effort
+	int bufferSize = 4 * 1024 * 1024;
+	setsockopt(udpSocket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+	setsockopt(udpSocket, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(udpSocket, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close(udpSocket);
+		return -1;
+	}
+	return udpSocket;
+}
+
+bool UdpTransport::Listen(uint16_t port)
+{
+	udpSocket = OpenSocket(port);
+	if (udpSocket < 0)
+		return false;
+
+	// Setting the segment size to 0 changes nothing but fails where GSO is not supported
+	int segment = 0;
+	gso = setsockopt(udpSocket, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) == 0;
+
+	receiveBuffer.resize(BatchSize * MaxReceiveSize);
+
+	nextTimeoutCheck = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	Screen::Log(std::string("UDP transport, GSO ") + (gso ? "enabled" : "not supported"));
+	return true;
+}
+
+void UdpTransport::Poll(TransportHandler& handler)
+{
+	if (udpSocket < 0)
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	for (size_t batch = 0; batch < MaxBatchesPerPoll; batch++)
+	{
+		size_t count = ReceiveBatch(udpSocket, receiveBuffer.data(), [&](const sockaddr_in& address, const char* data, uint32_t size) {
+			Deliver(handler, address, data, size, now);
+		});
+		if (count < BatchSize)
+			break;
+	}
+
+	if (now >= nextTimeoutCheck)
+	{
+		nextTimeoutCheck = now + std::chrono::seconds(1);
+		TimeOutPeers(handler, now);
+		connectLimiter.Prune(now);
+
+		// Once a second at most, so a flood doesn't also flood the log
+		if (connectsLimited != reportedConnectsLimited)
+		{
+			reportedConnectsLimited = connectsLimited;
+			Screen::LogError("Connect rate limit hit, " + std::to_string(connectsLimited) + " connects from unknown addresses dropped so far");
+		}
+	}
+}
+
+template <typename OnDatagram>
+size_t UdpTransport::ReceiveBatch(int socket, char* buffer, OnDatagram onDatagram)
+{
+	mmsghdr messages[BatchSize];
+	iovec vectors[BatchSize];
+	sockaddr_in addresses[BatchSize];
+	memset(messages, 0, sizeof(messages));
+	for (size_t i = 0; i < BatchSize; i++)
+	{
+		vectors[i].iov_base = buffer + i * MaxReceiveSize;
+		vectors[i].iov_len = MaxReceiveSize;
+		messages[i].msg_hdr.msg_name = &addresses[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+		messages[i].msg_hdr.msg_iov = &vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int count = recvmmsg(socket, messages, BatchSize, MSG_DONTWAIT, nullptr);
+	if (count <= 0)
+	{
+		if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			Screen::LogError(std::string("recvmmsg failed: ") + strerror(errno));
+		return 0;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		const char* data = (const char*)vectors[i].iov_base;
+		uint32_t size = messages[i].msg_len;
+		if (messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+			continue;
+		// Not even a packet header, or a type nobody knows; nothing the server could use
+		if (size < sizeof(x3::net::Packet) || (size_t)((const x3::net::Packet*)data)->type >= x3::net::PacketTypeCount)
+			continue;
+		onDatagram(addresses[i], data, size);
+	}
+	return (size_t)count;
+}
+
+void UdpTransport::Deliver(TransportHandler& handler, const sockaddr_in& address, const char* data, uint32_t size, std::chrono::steady_clock::time_point now)
+{
+	TransportConnection conn;
+	auto found = peersByAddress.find(AddressKey(address));
+	if (found == peersByAddress.end())
+	{
+		// Only a Connect opens a connection, so stray datagrams don't take a client slot
+		if (((const x3::net::Packet*)data)->type != x3::net::PacketType::Connect)
+			return;
+		if (!CheckCookie(address, data, size, now))
+			return;
+		conn = Open(handler, address, now);
+		if (conn == InvalidTransportConnection)
+			return;
+	}
+	else
+	{
+		conn = found->second;
+	}
+
+	Peer& peer = peers[conn];
+	peer.lastReceived = now;
+	peer.bytesIn += size;
+	// The handler may close the connection, so peer is not used after this
+	handler.OnMessage(conn, peer.userData, data, size);
+}
+
+bool UdpTransport::CheckCookie(const sockaddr_in& address, const char* data, uint32_t size, std::chrono::steady_clock::time_point now)
+{
+	// Both the first Connect and the one with the cookie count, whatever they carry
+	uint32_t network = ntohl(address.sin_addr.s_addr) >> 8;
+	if (!connectLimiter.TryTake(network, now))
+	{
+		connectsLimited++;
+		return false;
+	}
+	if (size < sizeof(x3::net::Connect))
+		return false;
+
+	x3::net::Connect connect;
+	memcpy(&connect, data, sizeof(x3::net::Connect));
+	if (cookies.Verify(address.sin_addr.s_addr, address.sin_port, connect.Cookie, now))
+		return true;
+
+	x3::net::ConnectChallenge challenge;
+	challenge.type = x3::net::PacketType::ConnectChallenge;
+	challenge.size = sizeof(x3::net::ConnectChallenge);
+	challenge.Cookie = cookies.Issue(address.sin_addr.s_addr, address.sin_port, now);
+	SendTo(address, &challenge, sizeof(challenge));
+	challengesSent++;
+	return false;
+}
+
+TransportConnection UdpTransport::Open(TransportHandler& handler, const sockaddr_in& address, std::chrono::steady_clock::time_point now)
+{
+	TransportConnection conn = ++lastConnection;
+	if (conn == InvalidTransportConnection)
+		conn = ++lastConnection;
+
+	Peer& peer = peers[conn];
+	peer.address = address;
+	peer.lastReceived = now;
+	peer.lastSample = now;
+	peersByAddress[AddressKey(address)] = conn;
+
+	int64_t userData = handler.OnConnectionOpened(conn, Describe(address));
+	if (userData < 0)
+	{
+		peersByAddress.erase(AddressKey(address));
+		peers.erase(conn);
+		return InvalidTransportConnection;
+	}
+	peers[conn].userData = userData;
+	return conn;
+}
+
+void UdpTransport::TimeOutPeers(TransportHandler& handler, std::chrono::steady_clock::time_point now)
+{
+	std::vector<TransportConnection> expired;
+	for (const auto& entry : peers)
+	{
+		if (now - entry.second.lastReceived > PeerTimeout)
+			expired.push_back(entry.first);
+	}
+
+	for (TransportConnection conn : expired)
+	{
+		auto found = peers.find(conn);
+		if (found == peers.end())
+			continue;
+		Peer peer = found->second;
+		peersByAddress.erase(AddressKey(peer.address));
+		peers.erase(found);
+
+		Screen::Log("Connection " + Describe(peer.address) + " timed out");
+		handler.OnConnectionClosed(conn, peer.userData, "Timed out", true);
+	}
+}
+
+void UdpTransport::Send(TransportConnection conn, const void* data, uint32_t size, SendMode /*mode*/)
+{
+	auto found = peers.find(conn);
+	if (found == peers.end() || size == 0)
+		return;
+	SendTo(found->second.address, data, size);
+	found->second.bytesOut += size;
+}
+
+void UdpTransport::SendTo(const sockaddr_in& address, const void* data, uint32_t size)
+{
+	PendingSend send;
+	send.address = address;
+	send.offset = sendBuffer.size();
+	send.size = size;
+	sendBuffer.insert(sendBuffer.end(), (const char*)data, (const char*)data + size);
+	pendingSends.push_back(send);
+}
+
+void UdpTransport::Flush()
+{
+	if (udpSocket < 0)
+	{
+		sendBuffer.clear();
+		pendingSends.clear();
+		return;
+	}
+
+	mmsghdr messages[BatchSize];
+	iovec vectors[BatchSize];
+	// Pending send each message starts at, to redo from if GSO is refused
+	size_t firstSend[BatchSize];
+	alignas(cmsghdr) char control[BatchSize][CMSG_SPACE(sizeof(uint16_t))];
+
+	size_t next = 0;
+	while (next < pendingSends.size())
+	{
+		memset(messages, 0, sizeof(messages));
+		size_t count = 0;
+		while (count < BatchSize && next < pendingSends.size())
+		{
+			PendingSend& first = pendingSends[next];
+
+			// Equally sized packets to the same client go out as one send, split by the kernel
+			size_t run = 1;
+			if (gso && first.size <= MaxSegmentSize)
+			{
+				while (next + run < pendingSends.size() && run < MaxSegments
+					&& pendingSends[next + run].size == first.size
+					&& AddressKey(pendingSends[next + run].address) == AddressKey(first.address)
+					&& (run + 1) * first.size <= MaxUdpPayload)
+					run++;
+			}
+
+			msghdr& header = messages[count].msg_hdr;
+			vectors[count].iov_base = &sendBuffer[first.offset];
+			vectors[count].iov_len = first.size * run;
+			header.msg_name = &first.address;
+			header.msg_namelen = sizeof(first.address);
+			header.msg_iov = &vectors[count];
+			header.msg_iovlen = 1;
+			if (run > 1)
+			{
+				header.msg_control = control[count];
+				header.msg_controllen = sizeof(control[count]);
+				cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				uint16_t segmentSize = (uint16_t)first.size;
+				memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+			}
+
+			firstSend[count] = next;
+			next += run;
+			count++;
+		}
+
+		size_t sent = SendBatch(messages, count);
+		if (sent < count)
+		{
+			// E.g. a network card without checksum offload; the rest goes one datagram at a time
+			gso = false;
+			next = firstSend[sent];
+			Screen::Log("UDP GSO refused by the kernel, sending datagrams one by one");
+		}
+	}
+
+	sendBuffer.clear();
+	pendingSends.clear();
+}
+
+size_t UdpTransport::SendBatch(mmsghdr* messages, size_t count)
+{
+	size_t sent = 0;
+	while (sent < count)
+	{
+		int result = sendmmsg(udpSocket, messages + sent, (unsigned int)(count - sent), 0);
+		if (result > 0)
+		{
+			sent += (size_t)result;
+			continue;
+		}
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result < 0 && (errno == EIO || errno == EINVAL) && messages[sent].msg_hdr.msg_controllen > 0)
+			return sent;
+		// The send buffer is full or the datagram was refused; it is dropped like on the wire
+		sent++;
+	}
+	return count;
+}
+
+bool UdpTransport::Sample(TransportConnection conn, ConnectionSample& sample, LaneSample* lanes, int laneCount)
+{
+	auto found = peers.find(conn);
+	if (found == peers.end())
+		return false;
+	Peer& peer = found->second;
+
+	auto now = std::chrono::steady_clock::now();
+	double seconds = std::max(std::chrono::duration<double>(now - peer.lastSample).count(), 1e-3);
+
+	// There are no acknowledgements to measure ping, loss or a send rate from;
+	// those stay at their "unknown" defaults
+	sample = ConnectionSample();
+	sample.OutBytesPerSec = (float)(peer.bytesOut / seconds);
+	sample.InBytesPerSec = (float)(peer.bytesIn / seconds);
+	for (int i = 0; i < laneCount; i++)
+		lanes[i] = LaneSample();
+
+	peer.bytesOut = 0;
+	peer.bytesIn = 0;
+	peer.lastSample = now;
+	return true;
+}
+
+void UdpTransport::CloseConnection(TransportConnection conn, const char* /*reason*/)
+{
+	auto found = peers.find(conn);
+	if (found == peers.end())
+		return;
+	peersByAddress.erase(AddressKey(found->second.address));
+	peers.erase(found);
+}
+
+void UdpTransport::Shutdown()
+{
+	if (udpSocket >= 0)
+	{
+		Flush();
+		close(udpSocket);
+	}
+	udpSocket = -1;
+	peers.clear();
+	peersByAddress.clear();
+}
+
+uint64_t UdpTransport::AddressKey(const sockaddr_in& address)
+{
+	return ((uint64_t)address.sin_addr.s_addr << 16) | address.sin_port;
+}
+
+std::string UdpTransport::Describe(const sockaddr_in& address)
+{
+	char ip[INET_ADDRSTRLEN] = {};
+	inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+	return std::string("udp ") + ip + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+#endif
@@ -0,0 +1,130 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "ConnectCookie.h"
+#include "RateLimit.h"
+#include "Transport.h"
+
+// The client's own protocol: every packet is one plain UDP datagram, and a
+// client is known by its address from its first Connect on. There is no
+// reliability and no disconnect message, so "reliable" sends are sent like
+// any other and clients that go quiet are timed out.
+//
+// A Connect from an unknown address is answered with a ConnectChallenge and
+// forgotten. The connection, and with it the player's ship and the universe
+// snapshot, only comes once the client sends its Connect again with the
+// challenge's cookie. Connects from unknown addresses are also rate limited
+// per /24 network.
+//
+// Datagrams are received with recvmmsg and sent with sendmmsg in batches.
+// Runs of equally sized packets to one client, which is what a snapshot of
+// ship updates is, leave as a single UDP GSO send where the kernel supports it.
+//
+// Everything runs on the server thread. Receive workers reading SO_REUSEPORT
+// sockets were tried and removed: connection lookup, cookies, decoding, the
+// ownership check and sequence filtering all need the server's state, so a
+// worker could only take over recvmmsg and a copy, and the thread handoff
+// cost more than that saved.
+class UdpTransport : public Transport
+{
+public:
+	// Datagrams per recvmmsg and per sendmmsg
+	static const size_t BatchSize = 64;
+	// Bounds one Poll, so a flood can't keep the server loop from its other work
+	static const size_t MaxBatchesPerPoll = 16;
+	// Client packets are far smaller; anything longer is dropped as malformed
+	static const size_t MaxReceiveSize = 2048;
+	// Segments above the path MTU would be refused by the kernel
+	static const size_t MaxSegmentSize = 1400;
+	static const size_t MaxSegments = 64;
+	// A client in game sends at least its heartbeat every second
+	static constexpr std::chrono::seconds PeerTimeout{ 10 };
+	// Connects from unknown addresses, per /24 source network
+	static constexpr double ConnectsPerSecond = 10.0;
+	static constexpr double ConnectBurst = 40.0;
+	static const size_t MaxLimitedNetworks = 65536;
+
+	~UdpTransport() override { Shutdown(); }
+
+	const char* Name() const override { return "udp"; }
+
+	bool Listen(uint16_t port) override;
+	void Poll(TransportHandler& handler) override;
+	void Send(TransportConnection conn, const void* data, uint32_t size, SendMode mode) override;
+	void Flush() override;
+	bool Sample(TransportConnection conn, ConnectionSample& sample, LaneSample* lanes, int laneCount) override;
+	void CloseConnection(TransportConnection conn, const char* reason) override;
+	void Shutdown() override;
+
+	bool GsoEnabled() const { return gso; }
+	uint64_t ChallengesSent() const { return challengesSent; }
+	uint64_t ConnectsLimited() const { return connectsLimited; }
+
+private:
+	struct Peer
+	{
+		sockaddr_in address;
+		int64_t userData = -1;
+		std::chrono::steady_clock::time_point lastReceived;
+		// Totals since the last Sample, for its rates
+		uint64_t bytesIn = 0;
+		uint64_t bytesOut = 0;
+		std::chrono::steady_clock::time_point lastSample;
+	};
+
+	// A packet waiting for Flush; its bytes are in sendBuffer, right after the previous one's
+	struct PendingSend
+	{
+		sockaddr_in address;
+		size_t offset;
+		uint32_t size;
+	};
+
+	int udpSocket = -1;
+	bool gso = false;
+	TransportConnection lastConnection = InvalidTransportConnection;
+	std::unordered_map<TransportConnection, Peer> peers;
+	std::unordered_map<uint64_t, TransportConnection> peersByAddress;
+	std::chrono::steady_clock::time_point nextTimeoutCheck;
+
+	ConnectCookies cookies;
+	KeyedRateLimiter<uint32_t> connectLimiter{ ConnectsPerSecond, ConnectBurst, MaxLimitedNetworks };
+	uint64_t challengesSent = 0;
+	uint64_t connectsLimited = 0;
+	uint64_t reportedConnectsLimited = 0;
+
+	std::vector<char> receiveBuffer;
+	std::vector<char> sendBuffer;
+	std::vector<PendingSend> pendingSends;
+
+	static uint64_t AddressKey(const sockaddr_in& address);
+	static std::string Describe(const sockaddr_in& address);
+	static int OpenSocket(uint16_t port);
+	// Reads one recvmmsg batch from socket into buffer and calls
+	// onDatagram(address, data, size) for each datagram that can be a packet.
+	// Returns the number of datagrams read, at most BatchSize.
+	template <typename OnDatagram>
+	static size_t ReceiveBatch(int socket, char* buffer, OnDatagram onDatagram);
+	void Deliver(TransportHandler& handler, const sockaddr_in& address, const char* data, uint32_t size, std::chrono::steady_clock::time_point now);
+	// True if the Connect from an unknown address carries a valid cookie; challenges it otherwise
+	bool CheckCookie(const sockaddr_in& address, const char* data, uint32_t size, std::chrono::steady_clock::time_point now);
+	void SendTo(const sockaddr_in& address, const void* data, uint32_t size);
+	TransportConnection Open(TransportHandler& handler, const sockaddr_in& address, std::chrono::steady_clock::time_point now);
+	void TimeOutPeers(TransportHandler& handler, std::chrono::steady_clock::time_point now);
+	// Sends messages[0, count). Returns the index of the first message the kernel
+	// refused for its GSO segmentation, or count when all went out.
+	size_t SendBatch(struct mmsghdr* messages, size_t count);
+};
+
+#endif
@@ -1,7 +1,114 @@
 #include "Universe.h"
+#include "net_packets.h"
 
 Universe::Universe()
 {
     entities = std::make_shared<std::array<std::shared_ptr<x3::net::Entity>, 65535>>();
     stars = std::make_shared<std::array<std::shared_ptr<x3::net::Entity>, 65535>>();
-}
\ No newline at end of file
+    ownerIndexSlot.resize(entities->size());
+    versions.resize(entities->size(), 0);
+    inboundSequences.resize(entities->size(), 0);
+    dirtySlot.resize(entities->size(), NotDirty);
+    columns = std::make_unique<EntityColumns>();
+}
+
+void Universe::SyncColumns(size_t id)
+{
+    const auto& entity = (*entities).at(id);
+    if (entity == nullptr)
+        columns->Clear(id);
+    else
+        columns->Set(id, *entity);
+    versions[id]++;
+    inboundSequences[id] = 0;
+}
+
+bool Universe::AcceptSequence(size_t id, uint32_t sequence)
+{
+    if (sequence == 0)
+        return true;
+    uint32_t& last = inboundSequences[id];
+    if (last != 0 && !x3::net::SequenceNewer(sequence, last))
+        return false;
+    last = sequence;
+    return true;
+}
+
+void Universe::MarkDirty(size_t id, uint32_t fields, int32_t writer)
+{
+    const auto& entity = (*entities).at(id);
+    if (entity == nullptr)
+        return;
+    if (fields & DirtyTransform)
+        columns->Set(id, *entity);
+    versions[id]++;
+
+    if (dirtySlot[id] == NotDirty)
+    {
+        dirtySlot[id] = (uint32_t)dirty.size();
+        dirty.push_back({ id, fields, writer });
+        return;
+    }
+    DirtyEntity& entry = dirty[dirtySlot[id]];
+    entry.fields |= fields;
+    if (entry.writer != writer)
+        entry.writer = -1;
+}
+
+void Universe::TakeDirty(std::vector<DirtyEntity>& out)
+{
+    for (const DirtyEntity& entry : dirty)
+        dirtySlot[entry.id] = NotDirty;
+    out.swap(dirty);
+    dirty.clear();
+}
+
+void Universe::SetNetOwner(size_t id, int32_t owner)
+{
+    auto& entity = (*entities).at(id);
+    if (entity == nullptr || entity->NetOwnerID == owner)
+        return;
+
+    if (entity->NetOwnerID >= 0)
+    {
+        // Swap-remove from the previous owner's list
+        std::vector<size_t>& owned = ownerIndex[entity->NetOwnerID];
+        uint32_t slot = ownerIndexSlot[id];
+        owned[slot] = owned.back();
+        ownerIndexSlot[owned[slot]] = slot;
+        owned.pop_back();
+        if (owned.empty())
+            ownerIndex.erase(entity->NetOwnerID);
+    }
+
+    entity->NetOwnerID = owner;
+    inboundSequences[id] = 0;
+    MarkDirty(id, DirtyOwner);
+
+    if (owner >= 0)
+    {
+        std::vector<size_t>& owned = ownerIndex[owner];
+        ownerIndexSlot[id] = (uint32_t)owned.size();
+        owned.push_back(id);
+    }
+}
+
+void Universe::TransferOwnership(int32_t from, int32_t to)
+{
+    auto it = ownerIndex.find(from);
+    if (it == ownerIndex.end() || from == to)
+        return;
+
+    // SetNetOwner unindexes each entity, so walk a copy; this also marks it
+    // dirty and resets its sequence when to is -1
+    std::vector<size_t> owned = it->second;
+    for (size_t id : owned)
+        SetNetOwner(id, to);
+}
+
+const std::vector<size_t>& Universe::GetOwnedEntities(int32_t owner) const
+{
+    static const std::vector<size_t> none;
+    auto it = ownerIndex.find(owner);
+    return it == ownerIndex.end() ? none : it->second;
+}
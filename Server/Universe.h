@@ -1,7 +1,10 @@
 #pragma once 
 #include "net_entity.h"
+#include "EntityColumns.h"
 #include <memory>
 #include <array>
+#include <vector>
+#include <unordered_map>
 
 class Universe
 {
@@ -9,5 +12,59 @@ class Universe
 	std::shared_ptr<std::array<std::shared_ptr<x3::net::Entity>, 65535>> entities;
 	std::shared_ptr<std::array<std::shared_ptr<x3::net::Entity>, 65535>> stars;
 
+    // Columnar copy of the transforms for bulk queries, see EntityColumns
+    std::unique_ptr<EntityColumns> columns;
+
     Universe();
-};
\ No newline at end of file
+
+    // Call after a ship is created or deleted
+    void SyncColumns(size_t id);
+
+    // Which parts of an entity changed
+    enum DirtyFields : uint32_t
+    {
+        DirtyTransform = 1 << 0,
+        // Owner or NetOwnerID
+        DirtyOwner = 1 << 1,
+    };
+
+    struct DirtyEntity
+    {
+        size_t id;
+        uint32_t fields;
+        // Client whose update caused every change this tick, -1 if the server or several clients
+        int32_t writer;
+    };
+
+    // Call after writing entity fields. Transform writes also update the
+    // columns. Each entity is in the dirty set at most once per tick.
+    void MarkDirty(size_t id, uint32_t fields, int32_t writer = -1);
+    // Hands out the entities marked since the last call and clears the set
+    void TakeDirty(std::vector<DirtyEntity>& out);
+    // Changes on every write, creation and deletion; lets caches keyed by entity detect staleness.
+    // Also the sequence number clients get in ShipUpdate and ShipSpawn.
+    uint32_t Version(size_t id) const { return versions[id]; }
+
+    // Checks a ShipUpdate sequence from the ship's owner and remembers it.
+    // False for updates older than one already applied; a new owner or a
+    // new ship in the slot starts over.
+    bool AcceptSequence(size_t id, uint32_t sequence);
+
+    // NetOwnerID must be changed through these so the owner index stays valid.
+    // Entities owned by the server (-1) are not indexed.
+    void SetNetOwner(size_t id, int32_t owner);
+    void TransferOwnership(int32_t from, int32_t to);
+    const std::vector<size_t>& GetOwnedEntities(int32_t owner) const;
+
+    private:
+    std::unordered_map<int32_t, std::vector<size_t>> ownerIndex;
+    // Position of each entity inside its owner's list, for O(1) removal
+    std::vector<uint32_t> ownerIndexSlot;
+
+    std::vector<uint32_t> versions;
+    std::vector<uint32_t> inboundSequences;
+    std::vector<DirtyEntity> dirty;
+    // Position of each entity in dirty, or NotDirty
+    static constexpr uint32_t NotDirty = UINT32_MAX;
+    std::vector<uint32_t> dirtySlot;
+};
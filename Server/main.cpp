@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <array>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
+#include "LoopbackBench.h"
 #include "Server.h"
 #include "Screen.h"
 #include "Script.h"
@@ -18,8 +22,35 @@ int main(int argc, const char* argv[])
 
 	std::shared_ptr<Universe> universe = std::make_shared<Universe>();
 
-	// Create server socket
-	InitSteamDatagramConnectionSockets();
+	// x3mp_server [--transport gns|udp]; the game client speaks udp.
+	// --bench-clients n runs n virtual clients in process instead, for --bench-seconds s
+	// over a link of --bench-latency ms one way, losing --bench-loss of the unreliable packets.
+	// --bench-clock virtual simulates the run's time instead, as fast as the server can tick.
+	std::string transportName = "gns";
+	LoopbackBenchOptions benchOptions;
+	benchOptions.Clients = 0;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--transport") == 0)
+			transportName = argv[++i];
+		else if (strcmp(argv[i], "--bench-clients") == 0)
+			benchOptions.Clients = (unsigned)std::max(atoi(argv[++i]), 0);
+		else if (strcmp(argv[i], "--bench-seconds") == 0)
+			benchOptions.Duration = std::chrono::seconds(std::max(atoi(argv[++i]), 1));
+		else if (strcmp(argv[i], "--bench-latency") == 0)
+			benchOptions.Link.Latency = std::chrono::milliseconds(std::max(atoi(argv[++i]), 0));
+		else if (strcmp(argv[i], "--bench-loss") == 0)
+			benchOptions.Link.Loss = std::min(std::max(atof(argv[++i]), 0.0), 1.0);
+		else if (strcmp(argv[i], "--bench-clock") == 0)
+			benchOptions.VirtualTime = strcmp(argv[++i], "virtual") == 0;
+	}
+	std::unique_ptr<Transport> transport = benchOptions.Clients > 0 ? nullptr : CreateTransport(transportName);
+	if (transport == nullptr && benchOptions.Clients == 0)
+	{
+		Screen::LogError("Unknown or unsupported transport: " + transportName);
+		Screen::Stop();
+		return 1;
+	}
 
 	Screen::Log(" Loading resources...");
 	Screen::Log(" Test resource from luascript.lua...", false);
@@ -37,13 +68,12 @@ int main(int argc, const char* argv[])
 
 	script->Start();
 
-	uint16 nPort = 13337;
-	SteamNetworkingIPAddr addrServer; 
-	addrServer.Clear();
-
-	ServerSingleton->Run(nPort);
+	uint16_t nPort = 13337;
 
-	ShutdownSteamDatagramConnectionSockets();
+	if (benchOptions.Clients > 0)
+		RunLoopbackBench(*ServerSingleton, nPort, benchOptions);
+	else
+		ServerSingleton->Run(std::move(transport), nPort);
 
 	script->Stop();
 
@@ -0,0 +1,67 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include "EntityColumns.h"
+#include "test.h"
+
+// Times each column kernel the CPU supports over the full 65536-slot
+// EntityColumns capacity, the scan QueryRadius and QueryBox do, and reports
+// it against the scalar loop.
+
+template <typename F>
+static double Measure(int iterations, F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+		f(i);
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main()
+{
+	static EntityColumns columns;
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int32_t> coordinate(-1000000, 1000000);
+	for (size_t id = 0; id < EntityColumns::Capacity; id++)
+	{
+		x3::net::Entity entity{};
+		entity.PosX = coordinate(random);
+		entity.PosY = coordinate(random);
+		entity.PosZ = coordinate(random);
+		columns.Set(id, entity);
+		if (random() % 2)
+			columns.Clear(id);
+	}
+	const int32_t min[3] = { -200000, -200000, -200000 };
+	const int32_t max[3] = { 200000, 200000, 200000 };
+
+	std::vector<const ColumnKernels*> supported = GetSupportedColumnKernels();
+	std::vector<size_t> found;
+	found.reserve(EntityColumns::Capacity);
+	double scalarRadius = 0.0, scalarBox = 0.0, bestRadius = 0.0, bestBox = 0.0;
+	for (const ColumnKernels* kernels : supported)
+	{
+		double radius = Measure(500, [&](int i) {
+			found.clear();
+			kernels->WithinRadius(columns.PosX, columns.PosY, columns.PosZ, columns.Live, EntityColumns::Capacity, (float)(i * 1000), 0.0f, 0.0f, 300000.0f * 300000.0f, found);
+		});
+		double box = Measure(500, [&](int) {
+			found.clear();
+			kernels->WithinBox(columns.PosX, columns.PosY, columns.PosZ, columns.Live, EntityColumns::Capacity, min, max, found);
+		});
+		std::printf("%-6s radius %.1f us, box %.1f us per %zu-slot scan\n", kernels->name, radius, box, EntityColumns::Capacity);
+		if (kernels == supported.front())
+		{
+			bestRadius = radius;
+			bestBox = box;
+		}
+		scalarRadius = radius;
+		scalarBox = box;
+	}
+	std::printf("%s over scalar: radius %.1fx, box %.1fx\n", supported.front()->name, scalarRadius / bestRadius, scalarBox / bestBox);
+	// AVX2 is typically 9-17x ahead with half the lanes live; ask for 2x so
+	// noisy machines pass
+	if (supported.size() > 1)
+		CHECK(scalarRadius / bestRadius > 2.0 && scalarBox / bestBox > 2.0);
+	TEST_MAIN_END();
+}
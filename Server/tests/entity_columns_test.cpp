@@ -0,0 +1,184 @@
+#include <climits>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "EntityColumns.h"
+#include "test.h"
+
+// Runs every column kernel the CPU supports against a plain loop over the
+// same data. Counts that are not a multiple of 4 or 8 exercise the scalar
+// tails, and points placed exactly on the radius or on a box face check that
+// both ends of the comparisons are inclusive.
+
+static const size_t MaxCount = 1024;
+
+struct Columns
+{
+	alignas(32) int32_t x[MaxCount];
+	alignas(32) int32_t y[MaxCount];
+	alignas(32) int32_t z[MaxCount];
+	alignas(32) int32_t live[MaxCount];
+	alignas(32) float out[MaxCount];
+};
+
+static const size_t Counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 1000, MaxCount };
+
+// Coordinates stay within +-1000 so every float in the radius kernels is an
+// exact integer and the reference can use int64 math
+static void Fill(Columns& columns, std::mt19937& random, int32_t range)
+{
+	std::uniform_int_distribution<int32_t> coordinate(-range, range);
+	for (size_t i = 0; i < MaxCount; i++)
+	{
+		columns.x[i] = coordinate(random);
+		columns.y[i] = coordinate(random);
+		columns.z[i] = coordinate(random);
+		columns.live[i] = (random() % 4) ? -1 : 0;
+	}
+}
+
+static void TestDistanceSquared(const ColumnKernels& kernels)
+{
+	static Columns columns;
+	std::mt19937 random(1);
+	Fill(columns, random, 1000);
+	for (size_t n : Counts)
+	{
+		for (size_t i = 0; i < MaxCount; i++)
+			columns.out[i] = -1.0f;
+		kernels.DistanceSquared(columns.x, columns.y, columns.z, n, 10.0f, -20.0f, 30.0f, columns.out);
+		for (size_t i = 0; i < n; i++)
+		{
+			int64_t dx = columns.x[i] - 10, dy = columns.y[i] + 20, dz = columns.z[i] - 30;
+			CHECK(columns.out[i] == (float)(dx * dx + dy * dy + dz * dz));
+		}
+		// Nothing past n is written
+		for (size_t i = n; i < MaxCount; i++)
+			CHECK(columns.out[i] == -1.0f);
+	}
+}
+
+static void TestWithinRadius(const ColumnKernels& kernels)
+{
+	static Columns columns;
+	std::mt19937 random(2);
+	Fill(columns, random, 1000);
+	// Lanes exactly on a radius of 5 around (100, 100, 100), in every vector
+	// position and in the tails
+	for (size_t i = 0; i < MaxCount; i += 3)
+	{
+		columns.x[i] = 103;
+		columns.y[i] = 104;
+		columns.z[i] = 100;
+	}
+	for (size_t n : Counts)
+	{
+		for (float radius : { 5.0f, 4.0f, 500.0f, 0.0f })
+		{
+			std::vector<size_t> expected, actual;
+			int64_t radiusSq = (int64_t)(radius * radius);
+			for (size_t i = 0; i < n; i++)
+			{
+				int64_t dx = columns.x[i] - 100, dy = columns.y[i] - 100, dz = columns.z[i] - 100;
+				if (columns.live[i] && dx * dx + dy * dy + dz * dz <= radiusSq)
+					expected.push_back(i);
+			}
+			kernels.WithinRadius(columns.x, columns.y, columns.z, columns.live, n, 100.0f, 100.0f, 100.0f, radius * radius, actual);
+			CHECK(actual == expected);
+		}
+	}
+}
+
+static void TestWithinBox(const ColumnKernels& kernels)
+{
+	static Columns columns;
+	std::mt19937 random(3);
+	Fill(columns, random, INT32_MAX);
+	const int32_t min[3] = { -1000000, INT32_MIN, -5 };
+	const int32_t max[3] = { 1000000, 0, INT32_MAX };
+	// Lanes on each face of the box, and just outside it
+	for (size_t i = 0; i < MaxCount; i += 5)
+	{
+		columns.x[i] = (i % 2) ? min[0] : max[0];
+		columns.y[i] = (i % 3) ? min[1] : max[1];
+		columns.z[i] = (i % 7) ? min[2] : max[2];
+	}
+	for (size_t i = 2; i < MaxCount; i += 11)
+	{
+		columns.x[i] = max[0] + 1;
+		columns.y[i] = 0;
+		columns.z[i] = min[2] - 1;
+	}
+	for (size_t n : Counts)
+	{
+		std::vector<size_t> expected, actual;
+		for (size_t i = 0; i < n; i++)
+		{
+			bool inside = columns.x[i] >= min[0] && columns.x[i] <= max[0] && columns.y[i] >= min[1] && columns.y[i] <= max[1] && columns.z[i] >= min[2] && columns.z[i] <= max[2];
+			if (columns.live[i] && inside)
+				expected.push_back(i);
+		}
+		kernels.WithinBox(columns.x, columns.y, columns.z, columns.live, n, min, max, actual);
+		CHECK(actual == expected);
+	}
+
+	// The whole int32 range as a box takes every live lane
+	const int32_t everywhereMin[3] = { INT32_MIN, INT32_MIN, INT32_MIN };
+	const int32_t everywhereMax[3] = { INT32_MAX, INT32_MAX, INT32_MAX };
+	std::vector<size_t> expected, actual;
+	for (size_t i = 0; i < 1000; i++)
+		if (columns.live[i])
+			expected.push_back(i);
+	kernels.WithinBox(columns.x, columns.y, columns.z, columns.live, 1000, everywhereMin, everywhereMax, actual);
+	CHECK(actual == expected);
+}
+
+static void TestFixedToFloat(const ColumnKernels& kernels)
+{
+	static Columns columns;
+	std::mt19937 random(4);
+	Fill(columns, random, INT32_MAX);
+	columns.x[0] = INT32_MIN;
+	columns.x[1] = INT32_MAX;
+	for (size_t n : Counts)
+	{
+		for (size_t i = 0; i < MaxCount; i++)
+			columns.out[i] = -1.0f;
+		kernels.FixedToFloat(columns.x, n, 1.0f / 500.0f, columns.out);
+		for (size_t i = 0; i < n; i++)
+			CHECK(columns.out[i] == (float)columns.x[i] * (1.0f / 500.0f));
+		for (size_t i = n; i < MaxCount; i++)
+			CHECK(columns.out[i] == -1.0f);
+	}
+}
+
+int main()
+{
+	std::vector<const ColumnKernels*> supported = GetSupportedColumnKernels();
+	CHECK(!supported.empty());
+	CHECK(supported.front() == &GetColumnKernels());
+	for (const ColumnKernels* kernels : supported)
+	{
+		std::printf("checking %s kernels\n", kernels->name);
+		TestDistanceSquared(*kernels);
+		TestWithinRadius(*kernels);
+		TestWithinBox(*kernels);
+		TestFixedToFloat(*kernels);
+	}
+
+	// EntityColumns queries the whole capacity with the selected kernels
+	static EntityColumns columns;
+	x3::net::Entity entity{};
+	entity.PosX = 3;
+	entity.PosY = 4;
+	columns.Set(7, entity);
+	columns.Set(EntityColumns::Capacity - 1, entity);
+	std::vector<size_t> found;
+	columns.QueryRadius(0.0f, 0.0f, 0.0f, 5.0f, found);
+	CHECK(found.size() == 2 && found[0] == 7 && found[1] == EntityColumns::Capacity - 1);
+	columns.Clear(7);
+	found.clear();
+	columns.QueryRadius(0.0f, 0.0f, 0.0f, 5.0f, found);
+	CHECK(found.size() == 1 && found[0] == EntityColumns::Capacity - 1);
+	TEST_MAIN_END();
+}
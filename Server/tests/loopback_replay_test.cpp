@@ -0,0 +1,80 @@
+#include <sys/wait.h>
+#include <unistd.h>
+#include <memory>
+#include "LoopbackBench.h"
+#include "Script.h"
+#include "Server.h"
+#include "Universe.h"
+#include "test.h"
+
+// Runs the loopback bench on a VirtualClock twice with the same seed and
+// checks that the clients saw exactly the same thing. The server is a
+// process wide singleton that keeps its universe and client IDs, so each run
+// gets a fresh process.
+
+// No scripts are loaded in the bench; these stand in for Script.cpp so the
+// test doesn't need Lua
+void Script::call_callback_OnPlayerConnect(int) {}
+void Script::call_callback_OnConsoleCommand(std::string) {}
+
+static LoopbackBenchResult RunInChild(uint32_t seed)
+{
+	LoopbackBenchResult result;
+	int channel[2];
+	if (pipe(channel) != 0)
+		return result;
+	pid_t child = fork();
+	if (child == 0)
+	{
+		close(channel[0]);
+		LoopbackBenchOptions options;
+		options.Clients = 20;
+		options.Duration = std::chrono::seconds(10);
+		options.Link.Latency = std::chrono::milliseconds(30);
+		options.Link.Jitter = std::chrono::milliseconds(5);
+		options.Link.Loss = 0.02;
+		options.Link.Reorder = 0.01;
+		options.Seed = seed;
+		options.VirtualTime = true;
+		ServerSingleton->Init(std::make_shared<Universe>(), nullptr);
+		LoopbackBenchResult run = RunLoopbackBench(*ServerSingleton, 23500, options);
+		bool written = write(channel[1], &run, sizeof(run)) == (ssize_t)sizeof(run);
+		_exit(written ? 0 : 1);
+	}
+	close(channel[1]);
+	ssize_t length = read(channel[0], &result, sizeof(result));
+	close(channel[0]);
+	int status = 0;
+	waitpid(child, &status, 0);
+	CHECK(length == (ssize_t)sizeof(result));
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	return result;
+}
+
+int main()
+{
+	LoopbackBenchResult first = RunInChild(1);
+	LoopbackBenchResult second = RunInChild(1);
+	std::printf("%llu ticks, %u joined, %llu messages, %llu ship updates, %llu lost, digest %016llx\n",
+		(unsigned long long)first.Ticks, first.Joined, (unsigned long long)first.Messages,
+		(unsigned long long)first.ShipUpdates, (unsigned long long)first.MessagesLost, (unsigned long long)first.Digest);
+
+	// The run did something worth comparing
+	CHECK(first.Joined == 20);
+	CHECK(first.ShipUpdates > 0);
+	CHECK(first.MessagesLost > 0);
+
+	CHECK(second.Ticks == first.Ticks);
+	CHECK(second.Joined == first.Joined);
+	CHECK(second.UpdatesSent == first.UpdatesSent);
+	CHECK(second.Messages == first.Messages);
+	CHECK(second.Bytes == first.Bytes);
+	CHECK(second.ShipUpdates == first.ShipUpdates);
+	CHECK(second.MessagesLost == first.MessagesLost);
+	CHECK(second.Digest == first.Digest);
+
+	// Another seed loses other packets, which the digest has to notice
+	LoopbackBenchResult other = RunInChild(2);
+	CHECK(other.Digest != first.Digest);
+	TEST_MAIN_END();
+}
@@ -0,0 +1,187 @@
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "LoopbackTransport.h"
+#include "test.h"
+
+// The simulated link on a VirtualClock: delays, loss, the ordering of
+// reliable messages and the pending counts the server's send rate reads.
+
+using namespace std::chrono;
+
+class Handler : public TransportHandler
+{
+public:
+	std::vector<uint32_t> received;
+
+	int64_t OnConnectionOpened(TransportConnection, const std::string&) override { return 1; }
+	void OnConnectionClosed(TransportConnection, int64_t, const std::string&, bool) override {}
+	void OnMessage(TransportConnection, int64_t, const void* data, uint32_t size) override
+	{
+		uint32_t value = 0;
+		if (size == sizeof(value))
+			memcpy(&value, data, size);
+		received.push_back(value);
+	}
+};
+
+struct Link
+{
+	std::shared_ptr<VirtualClock> clock = std::make_shared<VirtualClock>();
+	LoopbackTransport transport;
+	Handler handler;
+	TransportConnection conn;
+
+	explicit Link(const LinkConditions& conditions, uint32_t seed = 1) : transport(conditions, seed, clock)
+	{
+		transport.Listen(0);
+		conn = transport.ConnectClient();
+		transport.Poll(handler);
+	}
+
+	void Send(uint32_t value, SendMode mode) { transport.Send(conn, &value, sizeof(value), mode); }
+
+	size_t Receive(std::vector<uint32_t>& out)
+	{
+		return transport.ClientReceive(conn, [&](const void* data, uint32_t size) {
+			uint32_t value = 0;
+			if (size == sizeof(value))
+				memcpy(&value, data, size);
+			out.push_back(value);
+		});
+	}
+};
+
+static void TestLatency()
+{
+	LinkConditions conditions;
+	conditions.Latency = milliseconds(30);
+	Link link(conditions);
+	CHECK(link.transport.ClientConnected(link.conn));
+
+	std::vector<uint32_t> received;
+	link.Send(7, SendMode::Unreliable);
+	link.transport.ClientSend(link.conn, "\x08\0\0\0", 4, SendMode::Reliable);
+	link.clock->Advance(milliseconds(29));
+	CHECK(link.Receive(received) == 0);
+	link.transport.Poll(link.handler);
+	CHECK(link.handler.received.empty());
+
+	link.clock->Advance(milliseconds(1));
+	CHECK(link.Receive(received) == 1);
+	CHECK(received.size() == 1 && received[0] == 7);
+	link.transport.Poll(link.handler);
+	CHECK(link.handler.received.size() == 1 && link.handler.received[0] == 8);
+}
+
+static void TestLoss()
+{
+	LinkConditions conditions;
+	conditions.Loss = 0.25;
+	Link link(conditions);
+	const uint32_t count = 20000;
+	for (uint32_t i = 0; i < count; i++)
+		link.Send(i, SendMode::Unreliable);
+	std::vector<uint32_t> received;
+	link.Receive(received);
+	double lost = 1.0 - (double)received.size() / count;
+	std::printf("unreliable loss at 0.25: %.4f\n", lost);
+	CHECK_NEAR(lost, 0.25, 0.02);
+	CHECK(link.transport.MessagesLost() == count - received.size());
+
+	// Loss only applies to unreliable messages
+	received.clear();
+	for (uint32_t i = 0; i < 1000; i++)
+		link.Send(i, SendMode::Reliable);
+	CHECK(link.Receive(received) == 1000);
+}
+
+// Unreliable copies carry this bit, to tell the two streams apart
+static const uint32_t UnreliableBit = 0x80000000u;
+
+static void TestReliableOrderUnderJitter()
+{
+	LinkConditions conditions;
+	conditions.Latency = milliseconds(10);
+	conditions.Jitter = milliseconds(50);
+	conditions.Loss = 0.1;
+	conditions.Reorder = 0.1;
+	Link link(conditions, 3);
+
+	const uint32_t count = 2000;
+	std::vector<uint32_t> received;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		link.Send(i, SendMode::Reliable);
+		link.Send(i | UnreliableBit, SendMode::Unreliable);
+		link.clock->Advance(milliseconds(1));
+		link.Receive(received);
+	}
+	link.clock->Advance(seconds(1));
+	link.Receive(received);
+
+	std::vector<uint32_t> reliable;
+	bool unreliableReordered = false;
+	uint32_t lastUnreliable = 0;
+	for (uint32_t value : received)
+	{
+		if (value & UnreliableBit)
+		{
+			unreliableReordered = unreliableReordered || (value & ~UnreliableBit) < lastUnreliable;
+			lastUnreliable = value & ~UnreliableBit;
+		}
+		else
+			reliable.push_back(value);
+	}
+	// The jitter does reorder the network underneath
+	CHECK(unreliableReordered);
+	// Yet every reliable message arrives, in the order sent
+	CHECK(reliable.size() == count);
+	for (size_t i = 0; i < reliable.size(); i++)
+		CHECK(reliable[i] == (uint32_t)i);
+}
+
+static void TestPendingCounts()
+{
+	LinkConditions conditions;
+	conditions.Latency = milliseconds(20);
+	conditions.Jitter = milliseconds(10);
+	conditions.Loss = 0.5;
+	Link link(conditions);
+
+	for (uint32_t i = 0; i < 100; i++)
+	{
+		link.Send(i, SendMode::Reliable);
+		link.Send(i, SendMode::Unreliable);
+	}
+	ConnectionSample sample;
+	LaneSample lane;
+	CHECK(link.transport.Sample(link.conn, sample, &lane, 1));
+	// Lost messages are never pending
+	CHECK(sample.PendingReliable == 100);
+	CHECK(sample.PendingUnreliable == 100 - (int32_t)link.transport.MessagesLost());
+	CHECK(lane.PendingReliable == sample.PendingReliable);
+
+	std::vector<uint32_t> received;
+	link.clock->Advance(milliseconds(25));
+	link.Receive(received);
+	CHECK(link.transport.Sample(link.conn, sample, &lane, 1));
+	CHECK(sample.PendingReliable + sample.PendingUnreliable > 0);
+
+	link.clock->Advance(milliseconds(10));
+	link.Receive(received);
+	CHECK(link.transport.Sample(link.conn, sample, &lane, 1));
+	CHECK(sample.PendingReliable == 0);
+	CHECK(sample.PendingUnreliable == 0);
+	CHECK(lane.PendingReliable == 0 && lane.PendingUnreliable == 0);
+	CHECK(received.size() == 200 - link.transport.MessagesLost());
+}
+
+int main()
+{
+	TestLatency();
+	TestLoss();
+	TestReliableOrderUnderJitter();
+	TestPendingCounts();
+	TEST_MAIN_END();
+}
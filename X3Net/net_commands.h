@@ -0,0 +1,222 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace x3
+{
+	namespace net
+	{
+		// A trivially copyable value that one thread at a time writes and
+		// another reads without taking a lock. The reader gets a consistent
+		// copy or is told to try again; it never waits for the writer. The
+		// value is kept in atomic words so the concurrent copy is well defined.
+		template <typename T>
+		class SeqlockValue
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "SeqlockValue needs a trivially copyable type");
+
+		public:
+			// Concurrent writers of the same value take turns
+			void Store(const T& value)
+			{
+				uint32_t seq = sequence.load(std::memory_order_relaxed);
+				while ((seq & 1) || !sequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+					seq = sequence.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+
+				uint32_t buffer[WordCount] = {};
+				memcpy(buffer, &value, sizeof(T));
+				for (size_t i = 0; i < WordCount; i++)
+					words[i].store(buffer[i], std::memory_order_relaxed);
+
+				sequence.store(seq + 2, std::memory_order_release);
+			}
+
+			// False if a write was in progress
+			bool TryLoad(T& out) const
+			{
+				uint32_t before = sequence.load(std::memory_order_acquire);
+				if (before & 1)
+					return false;
+				uint32_t buffer[WordCount];
+				for (size_t i = 0; i < WordCount; i++)
+					buffer[i] = words[i].load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (sequence.load(std::memory_order_relaxed) != before)
+					return false;
+				memcpy(&out, buffer, sizeof(T));
+				return true;
+			}
+
+		private:
+			static const size_t WordCount = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+			std::atomic<uint32_t> sequence{ 0 };
+			std::atomic<uint32_t> words[WordCount] = {};
+		};
+
+		// Commands from any thread to the thread that owns the entities, held
+		// per entity and coalesced: whatever was posted for an entity since the
+		// last drain is applied as at most one delete, one create and one update
+		// with the newest state, in that order.
+		//
+		// Posting never allocates and never blocks on the consumer. Drain runs
+		// on the owning thread, e.g. once per frame from a game hook, and never
+		// waits for producers either: an entity that is being written to right
+		// then is simply left for the next drain.
+		template <typename Spawn, typename State>
+		class EntityCommandBuffer
+		{
+		public:
+			enum Command : uint32_t
+			{
+				Delete = 1 << 0,
+				Create = 1 << 1,
+				Update = 1 << 2,
+			};
+
+			// IDs range from 0 to capacity - 1
+			explicit EntityCommandBuffer(size_t capacity)
+				: capacity(capacity), entries(new Entry[capacity])
+			{
+				// Every entity is queued at most once, so this many cells never overflow
+				size_t size = 2;
+				while (size < capacity)
+					size *= 2;
+				queue.reset(new std::atomic<uint32_t>[size]);
+				for (size_t i = 0; i < size; i++)
+					queue[i].store(0, std::memory_order_relaxed);
+				queueMask = size - 1;
+			}
+
+			size_t Capacity() const { return capacity; }
+
+			bool PostCreate(int32_t id, const Spawn& spawn, const State& state)
+			{
+				if (!InRange(id))
+					return false;
+				entries[id].spawn.Store(spawn);
+				entries[id].state.Store(state);
+				// A newer create replaces a pending one with everything posted before it
+				Post(id, Create | Update, Create | Update);
+				return true;
+			}
+
+			bool PostUpdate(int32_t id, const State& state)
+			{
+				if (!InRange(id))
+					return false;
+				entries[id].state.Store(state);
+				Post(id, 0, Update);
+				return true;
+			}
+
+			// Cancels a create and updates still pending for the entity
+			bool PostDelete(int32_t id)
+			{
+				if (!InRange(id))
+					return false;
+				Post(id, Create | Update, Delete);
+				return true;
+			}
+
+			// Calls onDelete(id), onCreate(id, spawn, state) and onUpdate(id, state)
+			// for every entity with pending commands. Entities posted to while
+			// this runs are left for the next call.
+			template <typename OnDelete, typename OnCreate, typename OnUpdate>
+			size_t Drain(OnDelete onDelete, OnCreate onCreate, OnUpdate onUpdate)
+			{
+				size_t end = tail.load(std::memory_order_acquire);
+				size_t drained = 0;
+				while (head != end)
+				{
+					std::atomic<uint32_t>& cell = queue[head & queueMask];
+					uint32_t value = cell.load(std::memory_order_acquire);
+					// Reserved by a producer that has not published it yet
+					if (value == 0)
+						break;
+					cell.store(0, std::memory_order_relaxed);
+					head++;
+
+					int32_t id = (int32_t)(value - 1);
+					Entry& entry = entries[id];
+					uint32_t commands = entry.pending.exchange(0, std::memory_order_acq_rel);
+
+					Spawn spawn;
+					State state;
+					if (((commands & Create) && !TryLoad(entry.spawn, spawn))
+						|| ((commands & Update) && !TryLoad(entry.state, state)))
+					{
+						// A producer is writing this entity right now. The delete was
+						// posted before that write, so it still goes ahead; the rest is
+						// handed back for the next drain.
+						if (commands & (Create | Update))
+							Post(id, 0, commands & (Create | Update));
+						commands &= Delete;
+					}
+
+					if (commands & Delete)
+						onDelete(id);
+					if (commands & Create)
+						onCreate(id, spawn, state);
+					else if (commands & Update)
+						onUpdate(id, state);
+					if (commands)
+						drained++;
+				}
+				return drained;
+			}
+
+			// Entities with commands waiting, approximately
+			size_t Queued() const { return tail.load(std::memory_order_relaxed) - head; }
+
+		private:
+			struct Entry
+			{
+				std::atomic<uint32_t> pending{ 0 };
+				SeqlockValue<Spawn> spawn;
+				SeqlockValue<State> state;
+			};
+
+			size_t capacity;
+			std::unique_ptr<Entry[]> entries;
+			// Bounded multi producer, single consumer queue of entity IDs + 1;
+			// 0 marks a cell that is free or not yet published
+			std::unique_ptr<std::atomic<uint32_t>[]> queue;
+			size_t queueMask = 0;
+			std::atomic<size_t> tail{ 0 };
+			size_t head = 0;
+
+			bool InRange(int32_t id) const { return id >= 0 && (size_t)id < capacity; }
+
+			// Replaces the clear bits with set; queues the entity if nothing was pending
+			void Post(int32_t id, uint32_t clear, uint32_t set)
+			{
+				std::atomic<uint32_t>& pending = entries[id].pending;
+				uint32_t old = pending.load(std::memory_order_relaxed);
+				while (!pending.compare_exchange_weak(old, (old & ~clear) | set, std::memory_order_acq_rel, std::memory_order_relaxed))
+					;
+				if (old == 0)
+				{
+					size_t position = tail.fetch_add(1, std::memory_order_acq_rel);
+					queue[position & queueMask].store((uint32_t)id + 1, std::memory_order_release);
+				}
+			}
+
+			// Writes are a short copy, so a few attempts nearly always succeed
+			template <typename T>
+			static bool TryLoad(const SeqlockValue<T>& value, T& out)
+			{
+				for (int attempt = 0; attempt < 64; attempt++)
+				{
+					if (value.TryLoad(out))
+						return true;
+				}
+				return false;
+			}
+		};
+	}
+}
@@ -25,6 +25,10 @@ namespace x3
 			int32_t LookAtX = 0;
 			int32_t LookAtY = 0;
 			int32_t LookAtZ = 0;
+			// Last velocity reported by the owner, position units per second
+			int32_t VelX = 0;
+			int32_t VelY = 0;
+			int32_t VelZ = 0;
 		};
 	}
 }
\ No newline at end of file
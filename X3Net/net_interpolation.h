@@ -0,0 +1,306 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "net_packets.h"
+
+namespace x3
+{
+	namespace net
+	{
+		// Transform of a ship at a point in time. Time is in seconds on the
+		// receiver's clock, the other fields are in the game's fixed point format.
+		struct TransformSample
+		{
+			double Time = 0.0;
+			int32_t Pos[3] = {};
+			int32_t Rot[4] = {};
+			int32_t Up[4] = {};
+			int32_t LookAt[3] = {};
+			// Position units per second, as estimated by the ship's owner
+			int32_t Vel[3] = {};
+			bool HasVelocity = false;
+		};
+
+		// Works for any packet carrying the ShipUpdate transform fields, e.g. CreateShip
+		template <typename Transform>
+		inline TransformSample ToTransformSample(const Transform& update, double time)
+		{
+			TransformSample sample;
+			sample.Time = time;
+			sample.Pos[0] = update.PosX;
+			sample.Pos[1] = update.PosY;
+			sample.Pos[2] = update.PosZ;
+			sample.Rot[0] = update.RotX;
+			sample.Rot[1] = update.RotY;
+			sample.Rot[2] = update.RotZ;
+			sample.Rot[3] = update.RotW;
+			sample.Up[0] = update.UpX;
+			sample.Up[1] = update.UpY;
+			sample.Up[2] = update.UpZ;
+			sample.Up[3] = update.UpW;
+			sample.LookAt[0] = update.LookAtX;
+			sample.LookAt[1] = update.LookAtY;
+			sample.LookAt[2] = update.LookAtZ;
+			return sample;
+		}
+
+		inline TransformSample ToTransformSample(const ShipUpdate& update, double time)
+		{
+			TransformSample sample = ToTransformSample<ShipUpdate>(update, time);
+			sample.Vel[0] = update.VelX;
+			sample.Vel[1] = update.VelY;
+			sample.Vel[2] = update.VelZ;
+			sample.HasVelocity = true;
+			return sample;
+		}
+
+		inline int32_t ToFixed(double value)
+		{
+			if (value >= (double)INT32_MAX)
+				return INT32_MAX;
+			if (value <= (double)INT32_MIN)
+				return INT32_MIN;
+			return (int32_t)std::lround(value);
+		}
+
+		inline int32_t LerpFixed(int32_t a, int32_t b, double t)
+		{
+			return ToFixed((double)a + ((double)b - (double)a) * t);
+		}
+
+		// Spherical interpolation of two fixed point quaternions (x, y, z, w).
+		// The game's scale is not assumed: both inputs are normalized, and the
+		// result is scaled back to their interpolated length. t outside [0, 1]
+		// extrapolates along the same arc.
+		inline void SlerpFixed(const int32_t a[4], const int32_t b[4], double t, int32_t out[4])
+		{
+			double qa[4], qb[4];
+			double lengthA = 0.0, lengthB = 0.0;
+			for (int i = 0; i < 4; i++)
+			{
+				qa[i] = a[i];
+				qb[i] = b[i];
+				lengthA += qa[i] * qa[i];
+				lengthB += qb[i] * qb[i];
+			}
+			lengthA = std::sqrt(lengthA);
+			lengthB = std::sqrt(lengthB);
+			if (lengthA == 0.0 || lengthB == 0.0)
+			{
+				for (int i = 0; i < 4; i++)
+					out[i] = LerpFixed(a[i], b[i], t);
+				return;
+			}
+
+			double dot = 0.0;
+			for (int i = 0; i < 4; i++)
+			{
+				qa[i] /= lengthA;
+				qb[i] /= lengthB;
+				dot += qa[i] * qb[i];
+			}
+			// q and -q are the same rotation; take the short way round
+			if (dot < 0.0)
+			{
+				dot = -dot;
+				for (int i = 0; i < 4; i++)
+					qb[i] = -qb[i];
+			}
+
+			double wa, wb;
+			if (dot > 0.9995)
+			{
+				// Nearly parallel, plain lerp is accurate and avoids dividing by sin(~0)
+				wa = 1.0 - t;
+				wb = t;
+			}
+			else
+			{
+				double theta = std::acos(dot);
+				double sinTheta = std::sin(theta);
+				wa = std::sin((1.0 - t) * theta) / sinTheta;
+				wb = std::sin(t * theta) / sinTheta;
+			}
+
+			double q[4];
+			double length = 0.0;
+			for (int i = 0; i < 4; i++)
+			{
+				q[i] = wa * qa[i] + wb * qb[i];
+				length += q[i] * q[i];
+			}
+			length = std::sqrt(length);
+			double scale = (lengthA + (lengthB - lengthA) * t) / (length > 0.0 ? length : 1.0);
+			for (int i = 0; i < 4; i++)
+				out[i] = ToFixed(q[i] * scale);
+		}
+
+		inline void InterpolateTransform(const TransformSample& a, const TransformSample& b, double t, TransformSample& out)
+		{
+			out.Time = a.Time + (b.Time - a.Time) * t;
+			for (int i = 0; i < 3; i++)
+			{
+				out.Pos[i] = LerpFixed(a.Pos[i], b.Pos[i], t);
+				out.LookAt[i] = LerpFixed(a.LookAt[i], b.LookAt[i], t);
+			}
+			SlerpFixed(a.Rot, b.Rot, t, out.Rot);
+			SlerpFixed(a.Up, b.Up, t, out.Up);
+		}
+
+		// Dead reckoning model: the position moves on at the sample's velocity,
+		// the orientation is held. Senders (see net_prediction.h) and receivers
+		// must agree on this so a sender knows what the others are showing.
+		inline void Extrapolate(const TransformSample& from, double time, TransformSample& out)
+		{
+			out = from;
+			double dt = time - from.Time;
+			for (int i = 0; i < 3; i++)
+				out.Pos[i] = ToFixed((double)from.Pos[i] + (double)from.Vel[i] * dt);
+			out.Time = time;
+		}
+
+		// Ring of the most recent samples of one entity, in time order
+		template <size_t Capacity = 32>
+		class InterpolationBuffer
+		{
+		public:
+			// Samples not newer than the latest one are dropped
+			bool Push(const TransformSample& sample)
+			{
+				if (count > 0 && sample.Time <= At(count - 1).Time)
+					return false;
+				samples[(first + count) % Capacity] = sample;
+				if (count < Capacity)
+					count++;
+				else
+					first = (first + 1) % Capacity;
+				return true;
+			}
+
+			void Clear() { first = count = 0; }
+			size_t Count() const { return count; }
+			const TransformSample& At(size_t i) const { return samples[(first + i) % Capacity]; }
+
+			// State at time. Between samples it interpolates; past the newest it
+			// extrapolates, at most maxExtrapolation seconds, then holds. Samples
+			// with a velocity are dead reckoned, others continue along the last
+			// two. Before the oldest it holds the oldest.
+			bool Sample(double time, double maxExtrapolation, TransformSample& out) const
+			{
+				if (count == 0)
+					return false;
+				if (time > At(count - 1).Time && At(count - 1).HasVelocity)
+				{
+					const TransformSample& newest = At(count - 1);
+					Extrapolate(newest, newest.Time + std::min(time - newest.Time, maxExtrapolation), out);
+					out.Time = time;
+					return true;
+				}
+				if (count == 1 || time <= At(0).Time)
+				{
+					out = At(0);
+					out.Time = time;
+					return true;
+				}
+
+				const TransformSample& newest = At(count - 1);
+				if (time >= newest.Time)
+				{
+					const TransformSample& previous = At(count - 2);
+					double ahead = time - newest.Time;
+					if (ahead > maxExtrapolation)
+						ahead = maxExtrapolation;
+					double t = 1.0 + ahead / (newest.Time - previous.Time);
+					InterpolateTransform(previous, newest, t, out);
+					out.Time = time;
+					return true;
+				}
+
+				// Binary search for the pair around time
+				size_t low = 0, high = count - 1;
+				while (high - low > 1)
+				{
+					size_t mid = (low + high) / 2;
+					if (At(mid).Time <= time)
+						low = mid;
+					else
+						high = mid;
+				}
+				const TransformSample& a = At(low);
+				const TransformSample& b = At(high);
+				InterpolateTransform(a, b, (time - a.Time) / (b.Time - a.Time), out);
+				out.Time = time;
+				return true;
+			}
+
+		private:
+			TransformSample samples[Capacity];
+			size_t first = 0;
+			size_t count = 0;
+		};
+
+		// Interpolation buffers for all remote ships. Receivers push each
+		// ShipUpdate with its arrival time and sample every frame a fixed delay
+		// in the past, so there are usually two samples to blend between and
+		// jitter or a lower network rate does not show as stutter.
+		class SnapshotInterpolator
+		{
+		public:
+			// How far behind the newest data ships are shown
+			double Delay = 0.1;
+			// How long a ship keeps moving on its last velocity when updates stop.
+			// Longer than the sender heartbeat, as dead reckoned ships flying
+			// straight only send that often.
+			double MaxExtrapolation = 1.5;
+
+			void Push(int32_t id, const TransformSample& sample)
+			{
+				if (id < 0)
+					return;
+				if ((size_t)id >= buffers.size())
+					buffers.resize((size_t)id + 1);
+				if (!buffers[id])
+					buffers[id].reset(new InterpolationBuffer<>());
+				buffers[id]->Push(sample);
+			}
+
+			void Push(const ShipUpdate& update, double now)
+			{
+				Push(update.ShipID, ToTransformSample(update, now));
+			}
+
+			// Drops the ship's history, e.g. on despawn or a teleport
+			void Remove(int32_t id)
+			{
+				if (id >= 0 && (size_t)id < buffers.size() && buffers[id])
+					buffers[id]->Clear();
+			}
+
+			bool Sample(int32_t id, double now, TransformSample& out) const
+			{
+				if (id < 0 || (size_t)id >= buffers.size() || !buffers[id])
+					return false;
+				return buffers[id]->Sample(now - Delay, MaxExtrapolation, out);
+			}
+
+			// Calls f(id, sample) for every ship with data
+			template <typename F>
+			void ForEach(double now, F f) const
+			{
+				TransformSample sample;
+				for (size_t id = 0; id < buffers.size(); id++)
+				{
+					if (buffers[id] && buffers[id]->Sample(now - Delay, MaxExtrapolation, sample))
+						f((int32_t)id, sample);
+				}
+			}
+
+		private:
+			std::vector<std::unique_ptr<InterpolationBuffer<>>> buffers;
+		};
+	}
+}
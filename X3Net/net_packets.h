@@ -1,10 +1,12 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
+#include <type_traits>
 #include "net_message.h"
 
 namespace x3 {
 	namespace net {
-		enum class PacketType {
+		enum class PacketType : uint32_t {
 			Connect,
 			CreateShip,
 			DeleteShip,
@@ -12,15 +14,39 @@ namespace x3 {
 			ShipUpdate,
 			ConnectAcknowledge,
 			ChatMessage,
-			PlayerChatEnter
+			PlayerChatEnter,
+			CreateShips,
+			DeleteShips,
+			ConnectChallenge
 		};
 
+		// Keep in sync with the last PacketType
+		const size_t PacketTypeCount = (size_t)PacketType::ConnectChallenge + 1;
+
+		inline const char* PacketTypeName(PacketType type)
+		{
+			static const char* names[PacketTypeCount] = {
+				"Connect", "CreateShip", "DeleteShip", "CreateStar", "ShipUpdate", "ConnectAcknowledge",
+				"ChatMessage", "PlayerChatEnter", "CreateShips", "DeleteShips", "ConnectChallenge"
+			};
+			return (size_t)type < PacketTypeCount ? names[(size_t)type] : "Unknown";
+		}
+
+		// Packets go on the wire as they are in memory: packed, fixed width
+		// fields and no vtable, so the 32-bit client and the 64-bit server agree
+		// on every offset. Both are little endian. The asserts below pin the sizes.
+#pragma pack(push, 1)
 		struct Packet {
-			virtual ~Packet() = default;
 			PacketType type{};
-			size_t size{};
+			uint32_t size{};
 		};
 
+		// Sequence numbers wrap around; a is newer than b if it is less than half the range ahead
+		inline bool SequenceNewer(uint32_t a, uint32_t b)
+		{
+			return (int32_t)(a - b) > 0;
+		}
+
 		struct ShipUpdate : Packet {
 			int32_t ShipID = 0;
 			int32_t PosX = 0;
@@ -37,11 +63,27 @@ namespace x3 {
 			int32_t LookAtX = 0;
 			int32_t LookAtY = 0;
 			int32_t LookAtZ = 0;
+			// Increases with every state change of the ship; 0 means unsequenced.
+			// Clients number their own ship's updates, the server stamps what it relays.
+			uint32_t Sequence = 0;
+			// Position units per second, for dead reckoning between updates
+			int32_t VelX = 0;
+			int32_t VelY = 0;
+			int32_t VelZ = 0;
 		};
 
 		struct Connect : Packet {
 			int16_t Model = 0;
 			char Name[64];
+			// 0 at first; the server may answer with a ConnectChallenge, and the
+			// Connect is then sent again carrying its cookie
+			uint64_t Cookie = 0;
+		};
+
+		// The server's answer to a Connect from an address it doesn't know yet.
+		// Smaller than Connect, so spoofed connects can't be used to amplify.
+		struct ConnectChallenge : Packet {
+			uint64_t Cookie = 0;
 		};
 
 		struct ConnectAcknowledge : Packet {
@@ -73,6 +115,54 @@ namespace x3 {
 			int32_t ShipID = 0;
 		};
 
+		// One entry of a CreateShips batch, same fields as CreateShip plus the
+		// ShipUpdate sequence the spawned state corresponds to
+		struct ShipSpawn {
+			int32_t ShipID = 0;
+			int32_t Model = 0;
+			int32_t Owner = 0;
+			int32_t PosX = 0;
+			int32_t PosY = 0;
+			int32_t PosZ = 0;
+			int32_t RotX = 0;
+			int32_t RotY = 0;
+			int32_t RotZ = 0;
+			int32_t RotW = 0;
+			int32_t UpX = 0;
+			int32_t UpY = 0;
+			int32_t UpZ = 0;
+			int32_t UpW = 0;
+			int32_t LookAtX = 0;
+			int32_t LookAtY = 0;
+			int32_t LookAtZ = 0;
+			uint32_t Sequence = 0;
+		};
+
+		const int32_t MaxShipSpawnsPerPacket = 64;
+		const int32_t MaxShipDespawnsPerPacket = 256;
+
+		// Bulk lifecycle packets. Only the first Count entries are sent, so
+		// size is trimmed to the used part of the array (see BatchSize).
+		struct CreateShips : Packet {
+			int32_t Count = 0;
+			ShipSpawn Ships[MaxShipSpawnsPerPacket];
+		};
+
+		struct DeleteShips : Packet {
+			int32_t Count = 0;
+			int32_t ShipIDs[MaxShipDespawnsPerPacket];
+		};
+
+		inline size_t BatchSize(const CreateShips& packet)
+		{
+			return sizeof(CreateShips) - sizeof(ShipSpawn) * (MaxShipSpawnsPerPacket - packet.Count);
+		}
+
+		inline size_t BatchSize(const DeleteShips& packet)
+		{
+			return sizeof(DeleteShips) - sizeof(int32_t) * (MaxShipDespawnsPerPacket - packet.Count);
+		}
+
 		struct CreateStar : Packet {
 			int32_t StarID = 0;
 			int32_t Model = 0;
@@ -91,5 +181,21 @@ namespace x3 {
 		struct PlayerChatEnter: Packet {
 			char Message[512];
 		};
+#pragma pack(pop)
+
+		static_assert(sizeof(Packet) == 8, "Wire header changed");
+		static_assert(sizeof(ShipUpdate) == 84, "Wire layout changed");
+		static_assert(sizeof(Connect) == 82, "Wire layout changed");
+		static_assert(sizeof(ConnectChallenge) == 16, "Wire layout changed");
+		static_assert(sizeof(ConnectAcknowledge) == 16, "Wire layout changed");
+		static_assert(sizeof(CreateShip) == 76, "Wire layout changed");
+		static_assert(sizeof(DeleteShip) == 12, "Wire layout changed");
+		static_assert(sizeof(ShipSpawn) == 72, "Wire layout changed");
+		static_assert(sizeof(CreateShips) == 4620, "Wire layout changed");
+		static_assert(sizeof(DeleteShips) == 1036, "Wire layout changed");
+		static_assert(sizeof(CreateStar) == 28, "Wire layout changed");
+		static_assert(sizeof(ChatMessage) == 524, "Wire layout changed");
+		static_assert(sizeof(PlayerChatEnter) == 520, "Wire layout changed");
+		static_assert(std::is_trivially_copyable<CreateShips>::value && std::is_trivially_copyable<ShipUpdate>::value, "Packets are copied onto the wire byte for byte");
 	}
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+#include <cmath>
+#include "net_interpolation.h"
+
+namespace x3
+{
+	namespace net
+	{
+		// When the owner of a ship has to tell the others about it
+		struct PredictionThresholds
+		{
+			// Largest position error receivers may show, in position units
+			double Position = 2000.0;
+			// Largest orientation error, in radians
+			double Orientation = 0.05;
+			// Longest time between two updates, so receivers and late joiners catch up even when nothing changes
+			double Heartbeat = 1.0;
+		};
+
+		// Angle between two fixed point quaternions of any scale, in radians
+		inline double QuaternionAngle(const int32_t a[4], const int32_t b[4])
+		{
+			double dot = 0.0, lengthA = 0.0, lengthB = 0.0;
+			for (int i = 0; i < 4; i++)
+			{
+				dot += (double)a[i] * (double)b[i];
+				lengthA += (double)a[i] * (double)a[i];
+				lengthB += (double)b[i] * (double)b[i];
+			}
+			if (lengthA == 0.0 || lengthB == 0.0)
+				return lengthA == lengthB ? 0.0 : 3.14159265358979323846;
+			double cosHalf = std::fabs(dot) / std::sqrt(lengthA * lengthB);
+			return 2.0 * std::acos(cosHalf < 1.0 ? cosHalf : 1.0);
+		}
+
+		// Decides when the local ship needs an update. The sender runs the
+		// same dead reckoning as the receivers (Extrapolate) from the last
+		// state it sent and only sends again once the real state has moved
+		// too far from that prediction, or the heartbeat is due. A parked or
+		// cruising ship then costs about one packet per heartbeat.
+		class DeadReckoningSender
+		{
+		public:
+			PredictionThresholds Thresholds;
+
+			// Feed every local frame; tracks the velocity that goes out with the next update
+			void Observe(const TransformSample& actual)
+			{
+				if (observed)
+				{
+					double dt = actual.Time - last.Time;
+					// Several observations within one game frame say nothing about speed
+					if (dt < 0.001)
+						return;
+					for (int i = 0; i < 3; i++)
+					{
+						double v = ((double)actual.Pos[i] - (double)last.Pos[i]) / dt;
+						// Smoothed, frame times of the mod thread are not exact
+						velocity[i] = velocity[i] * (1.0 - VelocitySmoothing) + v * VelocitySmoothing;
+					}
+				}
+				last = actual;
+				observed = true;
+			}
+
+			// Current state with the estimated velocity, as it would be sent
+			TransformSample Current() const
+			{
+				TransformSample sample = last;
+				for (int i = 0; i < 3; i++)
+					sample.Vel[i] = ToFixed(velocity[i]);
+				sample.HasVelocity = true;
+				return sample;
+			}
+
+			bool ShouldSend(double now) const
+			{
+				if (!observed)
+					return false;
+				if (!sentAny || now - sent.Time >= Thresholds.Heartbeat)
+					return true;
+
+				TransformSample predicted;
+				Extrapolate(sent, last.Time, predicted);
+				double error = 0.0;
+				for (int i = 0; i < 3; i++)
+				{
+					double d = (double)last.Pos[i] - (double)predicted.Pos[i];
+					error += d * d;
+				}
+				if (error > Thresholds.Position * Thresholds.Position)
+					return true;
+				return QuaternionAngle(last.Rot, sent.Rot) > Thresholds.Orientation
+					|| QuaternionAngle(last.Up, sent.Up) > Thresholds.Orientation;
+			}
+
+			// Call with the state that went out, i.e. Current() at send time
+			void Sent(const TransformSample& sample)
+			{
+				sent = sample;
+				sentAny = true;
+			}
+
+			// Forget everything, e.g. after the ship changed
+			void Reset()
+			{
+				observed = sentAny = false;
+				velocity[0] = velocity[1] = velocity[2] = 0.0;
+			}
+
+		private:
+			static constexpr double VelocitySmoothing = 0.5;
+			TransformSample last;
+			TransformSample sent;
+			double velocity[3] = {};
+			bool observed = false;
+			bool sentAny = false;
+		};
+	}
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace x3
+{
+	namespace net
+	{
+		// Refers to whatever occupied an ID at one point; stale once the ID is
+		// reassigned or removed, even if a new entity gets the same ID
+		struct EntityHandle
+		{
+			int32_t ID = -1;
+			uint32_t Generation = 0;
+		};
+
+		// Two way map between network IDs and local objects, both directions in
+		// O(1): an array from ID to pointer and an open addressing hash from
+		// pointer to ID. Every change to an ID bumps its generation, so
+		// handles taken earlier can tell they no longer refer to the same object.
+		template <typename T>
+		class EntityRegistry
+		{
+		public:
+			// IDs range from 0 to capacity - 1
+			explicit EntityRegistry(size_t capacity)
+				: pointers(capacity, nullptr), generations(capacity, 0)
+			{
+				// At most half full, so probe sequences stay short
+				size_t tableSize = 16;
+				while (tableSize < capacity * 2)
+					tableSize *= 2;
+				table.resize(tableSize);
+				mask = tableSize - 1;
+			}
+
+			size_t Capacity() const { return pointers.size(); }
+			size_t Size() const { return count; }
+
+			// Null for free and out of range IDs
+			T* Get(int32_t id) const { return InRange(id) ? pointers[id] : nullptr; }
+			T* operator[](int32_t id) const { return Get(id); }
+
+			// ID of a registered object, -1 if unknown
+			int32_t Find(const T* pointer) const
+			{
+				if (pointer == nullptr)
+					return -1;
+				for (size_t i = Hash(pointer);; i = (i + 1) & mask)
+				{
+					if (table[i].pointer == pointer)
+						return table[i].id;
+					if (table[i].pointer == nullptr)
+						return -1;
+				}
+			}
+
+			bool Contains(const T* pointer) const { return Find(pointer) != -1; }
+
+			// Assigns pointer to id, replacing what was there. An object has one
+			// ID at a time; registering it again moves it. Null removes.
+			void Set(int32_t id, T* pointer)
+			{
+				if (!InRange(id))
+					return;
+				if (pointer == nullptr)
+				{
+					Remove(id);
+					return;
+				}
+				if (pointers[id] == pointer)
+					return;
+				int32_t previous = Find(pointer);
+				if (previous != -1)
+					Remove(previous);
+				Remove(id);
+
+				pointers[id] = pointer;
+				generations[id]++;
+				count++;
+				size_t i = Hash(pointer);
+				while (table[i].pointer != nullptr)
+					i = (i + 1) & mask;
+				table[i].pointer = pointer;
+				table[i].id = id;
+			}
+
+			void Remove(int32_t id)
+			{
+				if (!InRange(id) || pointers[id] == nullptr)
+					return;
+				Erase(pointers[id]);
+				pointers[id] = nullptr;
+				generations[id]++;
+				count--;
+			}
+
+			void Clear()
+			{
+				for (size_t id = 0; id < pointers.size(); id++)
+					Remove((int32_t)id);
+			}
+
+			uint32_t Generation(int32_t id) const { return InRange(id) ? generations[id] : 0; }
+
+			EntityHandle Handle(int32_t id) const
+			{
+				EntityHandle handle;
+				handle.ID = id;
+				handle.Generation = Generation(id);
+				return handle;
+			}
+
+			// Null if the handle is stale
+			T* Resolve(const EntityHandle& handle) const
+			{
+				if (!InRange(handle.ID) || generations[handle.ID] != handle.Generation)
+					return nullptr;
+				return pointers[handle.ID];
+			}
+
+		private:
+			struct Bucket
+			{
+				const T* pointer = nullptr;
+				int32_t id = -1;
+			};
+
+			std::vector<T*> pointers;
+			std::vector<uint32_t> generations;
+			std::vector<Bucket> table;
+			size_t mask = 0;
+			size_t count = 0;
+
+			bool InRange(int32_t id) const { return id >= 0 && (size_t)id < pointers.size(); }
+
+			size_t Hash(const T* pointer) const
+			{
+				// Fibonacci hashing; the low bits of heap pointers are mostly alignment
+				uint64_t key = (uint64_t)(uintptr_t)pointer;
+				return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+			}
+
+			// Linear probing without tombstones: entries after the removed one
+			// move back if the gap lies between them and their home bucket
+			void Erase(const T* pointer)
+			{
+				size_t i = Hash(pointer);
+				while (table[i].pointer != pointer)
+					i = (i + 1) & mask;
+				size_t gap = i;
+				for (size_t j = (gap + 1) & mask; table[j].pointer != nullptr; j = (j + 1) & mask)
+				{
+					size_t home = Hash(table[j].pointer);
+					// Can move if home is not cyclically within (gap, j]
+					if (((j - home) & mask) >= ((j - gap) & mask))
+					{
+						table[gap] = table[j];
+						gap = j;
+					}
+				}
+				table[gap] = Bucket();
+			}
+		};
+	}
+}
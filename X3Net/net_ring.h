@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace x3
+{
+	namespace net
+	{
+		// Size the ring pads its indices and slots to, so producer and
+		// consumer never write to the same cache line
+		const size_t CacheLineSize = 64;
+
+		// Single producer, single consumer ring of fixed size packet slots.
+		// The network thread receives straight into a free slot and commits
+		// it; the game thread reads the packet in place and releases it.
+		// Neither side allocates, locks or waits: Reserve fails when the ring
+		// is full and Front when it is empty.
+		//
+		// Exactly one thread may call the producer functions (Reserve, Commit,
+		// Push, Dropped) and one other thread the consumer functions (Front,
+		// Pop).
+		template <size_t SlotSize, size_t SlotCount>
+		class PacketRing
+		{
+			static_assert(SlotCount >= 2 && (SlotCount & (SlotCount - 1)) == 0, "SlotCount must be a power of two");
+
+		public:
+			// Producer: a slot to receive up to SlotSize bytes into, or nullptr if full.
+			// Nothing is published until Commit, so an unusable packet can just be left.
+			void* Reserve()
+			{
+				size_t tail = this->tail.load(std::memory_order_relaxed);
+				if (tail - cachedHead == SlotCount)
+				{
+					cachedHead = head.load(std::memory_order_acquire);
+					if (tail - cachedHead == SlotCount)
+						return nullptr;
+				}
+				return slots[tail & (SlotCount - 1)].data;
+			}
+
+			// Producer: publishes the slot last returned by Reserve
+			void Commit(size_t length)
+			{
+				size_t tail = this->tail.load(std::memory_order_relaxed);
+				slots[tail & (SlotCount - 1)].length = (uint32_t)length;
+				this->tail.store(tail + 1, std::memory_order_release);
+				pushed.store(pushed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			}
+
+			// Producer: copies a packet in; false and counted as overflow if the ring is full
+			bool Push(const void* data, size_t length)
+			{
+				if (length > SlotSize)
+					return false;
+				void* slot = Reserve();
+				if (slot == nullptr)
+				{
+					Dropped();
+					return false;
+				}
+				memcpy(slot, data, length);
+				Commit(length);
+				return true;
+			}
+
+			// Producer: counts a packet that was discarded because Reserve failed
+			void Dropped()
+			{
+				overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			}
+
+			// Consumer: oldest packet, valid until Pop; nullptr if empty
+			void* Front(size_t* length = nullptr)
+			{
+				size_t head = this->head.load(std::memory_order_relaxed);
+				if (head == cachedTail)
+				{
+					cachedTail = tail.load(std::memory_order_acquire);
+					if (head == cachedTail)
+						return nullptr;
+				}
+				Slot& slot = slots[head & (SlotCount - 1)];
+				if (length)
+					*length = slot.length;
+				return slot.data;
+			}
+
+			// Consumer: releases the packet returned by Front
+			void Pop()
+			{
+				head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			}
+
+			// Approximate from any thread
+			size_t Size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+			bool Empty() const { return Size() == 0; }
+			static constexpr size_t Capacity() { return SlotCount; }
+			static constexpr size_t MaxPacketSize() { return SlotSize; }
+
+			// Packets accepted and packets dropped because the consumer fell behind, since start
+			uint64_t Pushed() const { return pushed.load(std::memory_order_relaxed); }
+			uint64_t Overflows() const { return overflows.load(std::memory_order_relaxed); }
+
+		private:
+			struct alignas(CacheLineSize) Slot
+			{
+				// First, so packets start on a cache line and are aligned for any field
+				unsigned char data[SlotSize];
+				uint32_t length;
+			};
+
+			// Each side's index shares a line with its cached copy of the other side's,
+			// which is only refreshed when the ring looks full or empty
+			alignas(CacheLineSize) std::atomic<size_t> head{ 0 };
+			size_t cachedTail = 0;
+			alignas(CacheLineSize) std::atomic<size_t> tail{ 0 };
+			size_t cachedHead = 0;
+			std::atomic<uint64_t> pushed{ 0 };
+			std::atomic<uint64_t> overflows{ 0 };
+			Slot slots[SlotCount];
+		};
+	}
+}
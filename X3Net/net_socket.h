@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <cerrno>
+#include <poll.h>
+#endif
+
+namespace x3
+{
+	namespace net
+	{
+#ifdef _WIN32
+		typedef SOCKET SocketHandle;
+#else
+		typedef int SocketHandle;
+#endif
+
+		enum class WaitResult
+		{
+			Readable,
+			Timeout,
+			Error
+		};
+
+		// Blocks until the socket has data or timeoutMs passes; a negative timeout waits forever
+		inline WaitResult WaitReadable(SocketHandle socket, int timeoutMs)
+		{
+#ifdef _WIN32
+			WSAPOLLFD descriptor = {};
+			descriptor.fd = socket;
+			descriptor.events = POLLRDNORM;
+			int result = WSAPoll(&descriptor, 1, timeoutMs);
+#else
+			pollfd descriptor = {};
+			descriptor.fd = socket;
+			descriptor.events = POLLIN;
+			int result;
+			do
+				result = poll(&descriptor, 1, timeoutMs);
+			while (result < 0 && errno == EINTR);
+#endif
+			// A closed socket is reported as "ready" with POLLNVAL, which a
+			// receive loop would otherwise spin on
+			if (result < 0 || (result > 0 && (descriptor.revents & POLLNVAL)))
+				return WaitResult::Error;
+			return result == 0 ? WaitResult::Timeout : WaitResult::Readable;
+		}
+
+		// Wakes a consumer thread when the network thread has queued packets.
+		// Notifications that arrive while nobody waits are not lost; any
+		// number of them wake the next wait once.
+		class PacketSignal
+		{
+		public:
+			void Notify()
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					pending = true;
+				}
+				condition.notify_one();
+			}
+
+			// True if woken by Notify, false when the deadline passed first
+			bool WaitUntil(std::chrono::steady_clock::time_point deadline)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				bool notified = condition.wait_until(lock, deadline, [this] { return pending; });
+				pending = false;
+				return notified;
+			}
+
+		private:
+			std::mutex mutex;
+			std::condition_variable condition;
+			bool pending = false;
+		};
+
+		// The network thread loop: waits until the socket is readable, lets
+		// receive drain it and wakes the consumer through signal if receive
+		// returns true because it queued packets. timeoutMs only bounds how
+		// long a cleared running flag takes to be noticed. While the wait
+		// fails, e.g. after the socket was closed, it backs off up to a
+		// second at a time rather than spinning.
+		template <typename Receive>
+		void RunReceiveLoop(SocketHandle socket, const std::atomic<bool>& running, PacketSignal& signal, int timeoutMs, Receive receive)
+		{
+			const int MinBackoffMs = 10, MaxBackoffMs = 1000;
+			int backoffMs = 0;
+			while (running)
+			{
+				switch (WaitReadable(socket, timeoutMs))
+				{
+				case WaitResult::Readable:
+					backoffMs = 0;
+					if (receive())
+						signal.Notify();
+					break;
+				case WaitResult::Timeout:
+					backoffMs = 0;
+					break;
+				case WaitResult::Error:
+					backoffMs = backoffMs ? backoffMs * 2 : MinBackoffMs;
+					if (backoffMs > MaxBackoffMs)
+						backoffMs = MaxBackoffMs;
+					std::this_thread::sleep_for(std::chrono::milliseconds(backoffMs));
+					break;
+				}
+			}
+		}
+	}
+}
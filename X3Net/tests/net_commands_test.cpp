@@ -0,0 +1,176 @@
+#include <thread>
+#include <vector>
+#include "net_commands.h"
+#include "test.h"
+
+using namespace x3::net;
+
+struct Spawn
+{
+	int32_t Model = 0;
+};
+
+struct State
+{
+	int32_t Pos[3] = {};
+	uint32_t Sequence = 0;
+};
+
+typedef EntityCommandBuffer<Spawn, State> Buffer;
+
+// Records what a drain applied, in order
+struct Applied
+{
+	std::vector<std::pair<char, int32_t>> calls;
+	State lastState;
+
+	size_t Drain(Buffer& buffer)
+	{
+		return buffer.Drain(
+			[this](int32_t id) { calls.push_back({ 'D', id }); },
+			[this](int32_t id, const Spawn&, const State& state) { calls.push_back({ 'C', id }); lastState = state; },
+			[this](int32_t id, const State& state) { calls.push_back({ 'U', id }); lastState = state; });
+	}
+};
+
+static State MakeState(int32_t x)
+{
+	State state;
+	state.Pos[0] = x;
+	return state;
+}
+
+static void TestUpdatesCoalesce()
+{
+	Buffer buffer(16);
+	for (int i = 1; i <= 10; i++)
+		buffer.PostUpdate(3, MakeState(i));
+	Applied applied;
+	CHECK(applied.Drain(buffer) == 1);
+	CHECK(applied.calls.size() == 1);
+	CHECK(applied.calls[0].first == 'U');
+	CHECK(applied.lastState.Pos[0] == 10);
+	// Nothing left over
+	Applied again;
+	CHECK(again.Drain(buffer) == 0);
+}
+
+static void TestCreateCarriesLatestState()
+{
+	Buffer buffer(16);
+	Spawn spawn;
+	spawn.Model = 7;
+	buffer.PostCreate(2, spawn, MakeState(1));
+	buffer.PostUpdate(2, MakeState(2));
+	Applied applied;
+	applied.Drain(buffer);
+	CHECK(applied.calls.size() == 1);
+	CHECK(applied.calls[0].first == 'C');
+	CHECK(applied.lastState.Pos[0] == 2);
+}
+
+static void TestDeleteCancelsPendingCreate()
+{
+	Buffer buffer(16);
+	buffer.PostCreate(4, Spawn(), MakeState(1));
+	buffer.PostUpdate(4, MakeState(2));
+	buffer.PostDelete(4);
+	Applied applied;
+	applied.Drain(buffer);
+	CHECK(applied.calls.size() == 1);
+	CHECK(applied.calls[0].first == 'D');
+}
+
+static void TestDeleteThenCreateReusesSlot()
+{
+	Buffer buffer(16);
+	buffer.PostDelete(5);
+	buffer.PostCreate(5, Spawn(), MakeState(9));
+	Applied applied;
+	applied.Drain(buffer);
+	CHECK(applied.calls.size() == 2);
+	CHECK(applied.calls.size() == 2 && applied.calls[0].first == 'D' && applied.calls[1].first == 'C');
+	CHECK(applied.lastState.Pos[0] == 9);
+}
+
+static void TestOutOfRangeIsRejected()
+{
+	Buffer buffer(16);
+	CHECK(!buffer.PostUpdate(-1, State()));
+	CHECK(!buffer.PostUpdate(16, State()));
+	CHECK(!buffer.PostDelete(100));
+}
+
+// Several producers hammer their entities while the consumer drains. Every
+// state the consumer sees must have been written as a whole, and once the
+// producers stop, the last drain must show each entity's final state.
+static void TestConcurrentProducers()
+{
+	const int entities = 64;
+	const int producers = 4;
+	const int perProducer = entities / producers;
+	const uint32_t updates = 20000;
+	Buffer buffer(entities);
+	std::atomic<int> running{ producers };
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++)
+	{
+		threads.emplace_back([&, p]() {
+			for (uint32_t i = 1; i <= updates; i++)
+			{
+				// Producer p owns IDs p, p + producers, ...
+				int32_t id = (int32_t)((i % perProducer) * producers + p);
+				State state;
+				state.Sequence = i;
+				state.Pos[0] = (int32_t)i;
+				state.Pos[1] = (int32_t)i * 2;
+				state.Pos[2] = (int32_t)i * 3;
+				buffer.PostUpdate(id, state);
+			}
+			running--;
+		});
+	}
+
+	std::vector<uint32_t> latest(entities, 0);
+	bool torn = false;
+	auto drain = [&]() {
+		buffer.Drain(
+			[](int32_t) {},
+			[](int32_t, const Spawn&, const State&) {},
+			[&](int32_t id, const State& state) {
+				if (state.Pos[0] != (int32_t)state.Sequence || state.Pos[1] != (int32_t)state.Sequence * 2 || state.Pos[2] != (int32_t)state.Sequence * 3)
+					torn = true;
+				latest[id] = state.Sequence;
+			});
+	};
+	while (running > 0)
+		drain();
+	for (std::thread& thread : threads)
+		thread.join();
+	while (buffer.Queued() > 0)
+		drain();
+
+	CHECK(!torn);
+	bool complete = true;
+	for (int32_t id = 0; id < entities; id++)
+	{
+		// The last i with i % perProducer == id / producers
+		uint32_t slot = (uint32_t)(id / producers);
+		uint32_t expected = updates - ((updates + perProducer - slot) % perProducer);
+		if (latest[id] != expected)
+			complete = false;
+	}
+	CHECK(complete);
+}
+
+int main()
+{
+	TestUpdatesCoalesce();
+	TestCreateCarriesLatestState();
+	TestDeleteCancelsPendingCreate();
+	TestDeleteThenCreateReusesSlot();
+	TestOutOfRangeIsRejected();
+	TestConcurrentProducers();
+	TEST_MAIN_END();
+}
@@ -0,0 +1,127 @@
+#include "net_interpolation.h"
+#include "test.h"
+
+using namespace x3::net;
+
+static TransformSample MakeSample(double time, int32_t x, const int32_t rot[4])
+{
+	TransformSample sample;
+	sample.Time = time;
+	sample.Pos[0] = x;
+	for (int i = 0; i < 4; i++)
+	{
+		sample.Rot[i] = rot[i];
+		sample.Up[i] = rot[i];
+	}
+	return sample;
+}
+
+static void TestSlerpEndpointsAndMidpoint()
+{
+	// 90 degrees about Z in an arbitrary fixed point scale
+	const int32_t scale = 1 << 20;
+	const int32_t identity[4] = { 0, 0, 0, scale };
+	const int32_t quarter[4] = { 0, 0, (int32_t)(scale * std::sqrt(0.5)), (int32_t)(scale * std::sqrt(0.5)) };
+	int32_t out[4];
+
+	SlerpFixed(identity, quarter, 0.0, out);
+	CHECK_NEAR(out[3], scale, 1);
+	SlerpFixed(identity, quarter, 1.0, out);
+	CHECK_NEAR(out[2], quarter[2], 1);
+
+	// Halfway is 45 degrees, not the normalized-lerp result
+	SlerpFixed(identity, quarter, 0.5, out);
+	CHECK_NEAR(out[2], scale * std::sin(3.14159265358979323846 / 8), 2);
+	CHECK_NEAR(out[3], scale * std::cos(3.14159265358979323846 / 8), 2);
+}
+
+static void TestSlerpTakesShortestArc()
+{
+	const int32_t scale = 1 << 20;
+	const int32_t a[4] = { 0, 0, 0, scale };
+	const int32_t negated[4] = { 0, 0, 0, -scale };
+	int32_t out[4];
+	// Same rotation with opposite sign: stays put instead of spinning
+	SlerpFixed(a, negated, 0.5, out);
+	CHECK_NEAR(std::abs(out[3]), scale, 1);
+	CHECK_NEAR(out[2], 0, 1);
+}
+
+static void TestInterpolatesBetweenSamples()
+{
+	const int32_t rot[4] = { 0, 0, 0, 1 << 20 };
+	InterpolationBuffer<8> buffer;
+	buffer.Push(MakeSample(1.0, 0, rot));
+	buffer.Push(MakeSample(2.0, 1000, rot));
+	buffer.Push(MakeSample(3.0, 3000, rot));
+
+	TransformSample out;
+	CHECK(buffer.Sample(1.5, 0.25, out));
+	CHECK_NEAR(out.Pos[0], 500, 0);
+	CHECK(buffer.Sample(2.5, 0.25, out));
+	CHECK_NEAR(out.Pos[0], 2000, 0);
+	// Before the oldest sample it holds
+	CHECK(buffer.Sample(0.0, 0.25, out));
+	CHECK_NEAR(out.Pos[0], 0, 0);
+}
+
+static void TestExtrapolationIsCapped()
+{
+	const int32_t rot[4] = { 0, 0, 0, 1 << 20 };
+	InterpolationBuffer<8> buffer;
+	buffer.Push(MakeSample(1.0, 0, rot));
+	buffer.Push(MakeSample(2.0, 1000, rot));
+
+	TransformSample out;
+	CHECK(buffer.Sample(2.1, 0.25, out));
+	CHECK_NEAR(out.Pos[0], 1100, 0);
+	// Beyond the cap the ship holds where the cap put it
+	CHECK(buffer.Sample(10.0, 0.25, out));
+	CHECK_NEAR(out.Pos[0], 1250, 0);
+}
+
+static void TestRingDropsOldAndStaleSamples()
+{
+	const int32_t rot[4] = { 0, 0, 0, 1 << 20 };
+	InterpolationBuffer<4> buffer;
+	for (int i = 0; i < 10; i++)
+		CHECK(buffer.Push(MakeSample(i, i * 100, rot)));
+	CHECK(buffer.Count() == 4);
+	CHECK_NEAR(buffer.At(0).Time, 6.0, 0);
+	// Out of order arrivals are ignored
+	CHECK(!buffer.Push(MakeSample(8.5, 0, rot)));
+	CHECK(buffer.Count() == 4);
+}
+
+static void TestInterpolatorDelay()
+{
+	SnapshotInterpolator interpolator;
+	interpolator.Delay = 0.1;
+	ShipUpdate update;
+	update.ShipID = 7;
+	update.RotW = 1 << 20;
+	update.PosX = 0;
+	interpolator.Push(update, 1.0);
+	update.PosX = 1000;
+	interpolator.Push(update, 1.1);
+
+	TransformSample out;
+	// Rendered 100 ms behind: at 1.15 the ship is halfway between the two updates
+	CHECK(interpolator.Sample(7, 1.15, out));
+	CHECK_NEAR(out.Pos[0], 500, 0);
+	CHECK(!interpolator.Sample(8, 1.15, out));
+
+	interpolator.Remove(7);
+	CHECK(!interpolator.Sample(7, 1.15, out));
+}
+
+int main()
+{
+	TestSlerpEndpointsAndMidpoint();
+	TestSlerpTakesShortestArc();
+	TestInterpolatesBetweenSamples();
+	TestExtrapolationIsCapped();
+	TestRingDropsOldAndStaleSamples();
+	TestInterpolatorDelay();
+	TEST_MAIN_END();
+}
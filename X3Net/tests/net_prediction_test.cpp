@@ -0,0 +1,104 @@
+#include "net_prediction.h"
+#include "test.h"
+
+using namespace x3::net;
+
+static TransformSample MakeSample(double time, int32_t x)
+{
+	TransformSample sample;
+	sample.Time = time;
+	sample.Pos[0] = x;
+	sample.Rot[3] = 1 << 20;
+	sample.Up[3] = 1 << 20;
+	return sample;
+}
+
+// Runs a sender at the mod thread's 50 Hz for seconds and counts the updates it sends
+template <typename Motion>
+static int CountSends(DeadReckoningSender& sender, double seconds, Motion motion)
+{
+	int sends = 0;
+	for (double t = 0.0; t < seconds; t += 0.02)
+	{
+		sender.Observe(motion(t));
+		if (sender.ShouldSend(t))
+		{
+			sender.Sent(sender.Current());
+			sends++;
+		}
+	}
+	return sends;
+}
+
+static void TestParkedShipOnlySendsHeartbeat()
+{
+	DeadReckoningSender sender;
+	int sends = CountSends(sender, 10.0, [](double t) { return MakeSample(t, 5000); });
+	// First state plus one heartbeat per second, instead of 500 packets
+	CHECK(sends <= 11);
+}
+
+static void TestCruisingShipOnlySendsHeartbeat()
+{
+	DeadReckoningSender sender;
+	int sends = CountSends(sender, 10.0, [](double t) { return MakeSample(t, (int32_t)(t * 100000.0)); });
+	// A couple of updates until the velocity estimate settles, then heartbeats
+	CHECK(sends <= 15);
+}
+
+static void TestTurnTriggersUpdate()
+{
+	DeadReckoningSender sender;
+	sender.Observe(MakeSample(0.0, 0));
+	CHECK(sender.ShouldSend(0.0));
+	sender.Sent(sender.Current());
+
+	TransformSample turned = MakeSample(0.1, 0);
+	// About 11 degrees around Z
+	turned.Rot[2] = (int32_t)((1 << 20) * std::sin(0.1));
+	turned.Rot[3] = (int32_t)((1 << 20) * std::cos(0.1));
+	sender.Observe(turned);
+	CHECK(sender.ShouldSend(0.1));
+}
+
+static void TestPositionErrorTriggersUpdate()
+{
+	DeadReckoningSender sender;
+	sender.Thresholds.Position = 1000.0;
+	sender.Observe(MakeSample(0.0, 0));
+	sender.Sent(sender.Current());
+	sender.Observe(MakeSample(0.1, 500));
+	CHECK(!sender.ShouldSend(0.1));
+	sender.Observe(MakeSample(0.2, 1500));
+	CHECK(sender.ShouldSend(0.2));
+}
+
+static void TestReceiverFollowsPrediction()
+{
+	// What a receiver shows between updates is what the sender predicted
+	ShipUpdate update;
+	update.ShipID = 3;
+	update.RotW = 1 << 20;
+	update.PosX = 1000;
+	update.VelX = 100000;
+	SnapshotInterpolator interpolator;
+	interpolator.Delay = 0.0;
+	interpolator.Push(update, 1.0);
+
+	TransformSample out;
+	CHECK(interpolator.Sample(3, 1.5, out));
+	CHECK_NEAR(out.Pos[0], 51000, 0);
+	// Capped once updates stop arriving for longer than any heartbeat
+	CHECK(interpolator.Sample(3, 10.0, out));
+	CHECK_NEAR(out.Pos[0], 1000 + 100000 * interpolator.MaxExtrapolation, 0);
+}
+
+int main()
+{
+	TestParkedShipOnlySendsHeartbeat();
+	TestCruisingShipOnlySendsHeartbeat();
+	TestTurnTriggersUpdate();
+	TestPositionErrorTriggersUpdate();
+	TestReceiverFollowsPrediction();
+	TEST_MAIN_END();
+}
@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <random>
+#include "net_registry.h"
+#include "test.h"
+
+using namespace x3::net;
+
+// Compares the client's old pointer check, a std::find over all 65535
+// slots, with EntityRegistry::Find for the same lookups.
+
+struct Object
+{
+	char padding[0x130];
+};
+
+static const size_t MaxEntities = 65535;
+
+template <typename F>
+static double Measure(int iterations, F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+		f(i);
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main()
+{
+	static std::array<Object*, MaxEntities> entities{};
+	EntityRegistry<Object> registry(MaxEntities);
+	std::vector<Object> objects(500);
+	std::mt19937 random(1);
+	std::vector<Object*> lookups;
+	for (Object& object : objects)
+	{
+		int32_t id = (int32_t)(random() % MaxEntities);
+		entities[id] = &object;
+		registry.Set(id, &object);
+	}
+	for (int i = 0; i < 1024; i++)
+		lookups.push_back(&objects[random() % objects.size()]);
+
+	volatile size_t sink = 0;
+	double linear = Measure(2000, [&](int i) {
+		Object* pointer = lookups[i % lookups.size()];
+		sink = sink + (std::find(entities.begin(), entities.end(), pointer) != entities.end());
+	});
+	double hashed = Measure(2000000, [&](int i) {
+		sink = sink + registry.Contains(lookups[i % lookups.size()]);
+	});
+
+	std::printf("std::find over %zu slots: %.1f ns per lookup\n", MaxEntities, linear);
+	std::printf("EntityRegistry::Find: %.1f ns per lookup (%.0fx faster)\n", hashed, linear / hashed);
+	// Two orders of magnitude are typical; ask for one so noisy machines pass
+	CHECK(linear / hashed > 10.0);
+	TEST_MAIN_END();
+}
@@ -0,0 +1,116 @@
+#include <random>
+#include <unordered_map>
+#include "net_registry.h"
+#include "test.h"
+
+using namespace x3::net;
+
+struct Object
+{
+	int value = 0;
+};
+
+static void TestBothDirections()
+{
+	EntityRegistry<Object> registry(100);
+	Object a, b;
+	registry.Set(5, &a);
+	registry.Set(7, &b);
+	CHECK(registry.Get(5) == &a);
+	CHECK(registry[7] == &b);
+	CHECK(registry.Find(&a) == 5);
+	CHECK(registry.Find(&b) == 7);
+	CHECK(registry.Size() == 2);
+	CHECK(registry.Get(-1) == nullptr);
+	CHECK(registry.Get(100) == nullptr);
+
+	registry.Remove(5);
+	CHECK(registry.Get(5) == nullptr);
+	CHECK(!registry.Contains(&a));
+	CHECK(registry.Find(&b) == 7);
+	CHECK(registry.Size() == 1);
+}
+
+static void TestReassignMovesObject()
+{
+	EntityRegistry<Object> registry(100);
+	Object a, b;
+	registry.Set(1, &a);
+	// The same object under a new ID leaves the old one free
+	registry.Set(2, &a);
+	CHECK(registry.Get(1) == nullptr);
+	CHECK(registry.Find(&a) == 2);
+	// A new object in an occupied slot forgets the old one
+	registry.Set(2, &b);
+	CHECK(!registry.Contains(&a));
+	CHECK(registry.Find(&b) == 2);
+	CHECK(registry.Size() == 1);
+}
+
+static void TestHandlesGoStale()
+{
+	EntityRegistry<Object> registry(10);
+	Object a, b;
+	registry.Set(3, &a);
+	EntityHandle handle = registry.Handle(3);
+	CHECK(registry.Resolve(handle) == &a);
+	registry.Remove(3);
+	CHECK(registry.Resolve(handle) == nullptr);
+	// ID reused by another ship: the old handle must not see it
+	registry.Set(3, &b);
+	CHECK(registry.Resolve(handle) == nullptr);
+	CHECK(registry.Resolve(registry.Handle(3)) == &b);
+}
+
+// Random churn at full capacity, compared against a plain map
+static void TestMatchesReference()
+{
+	const int capacity = 4096;
+	EntityRegistry<Object> registry(capacity);
+	std::vector<Object> objects(capacity * 2);
+	std::unordered_map<const Object*, int32_t> reference;
+	std::vector<Object*> byID(capacity, nullptr);
+	std::mt19937 random(42);
+
+	bool consistent = true;
+	for (int step = 0; step < 200000; step++)
+	{
+		int32_t id = (int32_t)(random() % capacity);
+		Object* object = &objects[random() % objects.size()];
+		if (random() % 3 == 0)
+		{
+			if (byID[id])
+				reference.erase(byID[id]);
+			byID[id] = nullptr;
+			registry.Remove(id);
+		}
+		else
+		{
+			auto it = reference.find(object);
+			if (it != reference.end())
+				byID[it->second] = nullptr;
+			if (byID[id])
+				reference.erase(byID[id]);
+			byID[id] = object;
+			reference[object] = id;
+			registry.Set(id, object);
+		}
+
+		Object* probe = &objects[random() % objects.size()];
+		auto it = reference.find(probe);
+		if (registry.Find(probe) != (it == reference.end() ? -1 : it->second))
+			consistent = false;
+		if (registry.Get(id) != byID[id] || registry.Size() != reference.size())
+			consistent = false;
+	}
+	CHECK(consistent);
+}
+
+int main()
+{
+	TestBothDirections();
+	TestReassignMovesObject();
+	TestHandlesGoStale();
+	TestMatchesReference();
+	TEST_MAIN_END();
+}
@@ -0,0 +1,115 @@
+#include <thread>
+#include "net_ring.h"
+#include "net_packets.h"
+#include "test.h"
+
+using namespace x3::net;
+
+static void TestPushAndPopInOrder()
+{
+	PacketRing<64, 4> ring;
+	size_t length = 0;
+	CHECK(ring.Front() == nullptr);
+	for (uint32_t i = 0; i < 4; i++)
+		CHECK(ring.Push(&i, sizeof(i)));
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		void* packet = ring.Front(&length);
+		CHECK(packet != nullptr);
+		CHECK(length == sizeof(uint32_t));
+		CHECK(packet != nullptr && *(uint32_t*)packet == i);
+		ring.Pop();
+	}
+	CHECK(ring.Empty());
+}
+
+static void TestOverflowIsCounted()
+{
+	PacketRing<64, 4> ring;
+	uint32_t value = 0;
+	for (int i = 0; i < 6; i++)
+		ring.Push(&value, sizeof(value));
+	CHECK(ring.Size() == 4);
+	CHECK(ring.Pushed() == 4);
+	CHECK(ring.Overflows() == 2);
+	// Oversized packets are refused, not truncated
+	char big[65] = {};
+	ring.Pop();
+	CHECK(!ring.Push(big, sizeof(big)));
+}
+
+static void TestReserveWithoutCommit()
+{
+	PacketRing<64, 4> ring;
+	void* slot = ring.Reserve();
+	CHECK(slot != nullptr);
+	// A malformed packet is simply never committed
+	CHECK(ring.Front() == nullptr);
+	CHECK(ring.Reserve() == slot);
+}
+
+static void TestSlotsAreAligned()
+{
+	static PacketRing<sizeof(ShipUpdate), 8> ring;
+	for (int i = 0; i < 8; i++)
+	{
+		void* slot = ring.Reserve();
+		CHECK(((uintptr_t)slot % CacheLineSize) == 0);
+		ring.Commit(0);
+	}
+}
+
+// The producer retries while the ring is full, so every packet it pushes
+// must come out exactly once, intact and in order, across many wraps.
+static void TestConcurrentProducerAndConsumer()
+{
+	static PacketRing<sizeof(ShipUpdate), 256> ring;
+	const uint32_t total = 2000000;
+	std::thread producer([&]() {
+		for (uint32_t i = 1; i <= total; i++)
+		{
+			void* slot;
+			while ((slot = ring.Reserve()) == nullptr)
+				std::this_thread::yield();
+			ShipUpdate* update = (ShipUpdate*)slot;
+			update->Sequence = i;
+			update->PosX = (int32_t)i * 3;
+			ring.Commit(sizeof(ShipUpdate));
+		}
+	});
+
+	uint32_t expected = 1;
+	bool ordered = true, intact = true;
+	while (expected <= total)
+	{
+		size_t length = 0;
+		ShipUpdate* update = (ShipUpdate*)ring.Front(&length);
+		if (update == nullptr)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		if (length != sizeof(ShipUpdate) || update->PosX != (int32_t)update->Sequence * 3)
+			intact = false;
+		if (update->Sequence != expected)
+			ordered = false;
+		expected++;
+		ring.Pop();
+	}
+	producer.join();
+	CHECK(ordered);
+	CHECK(intact);
+	CHECK(ring.Empty());
+	CHECK(ring.Pushed() == total);
+	CHECK(ring.Overflows() == 0);
+}
+
+int main()
+{
+	TestPushAndPopInOrder();
+	TestOverflowIsCounted();
+	TestReserveWithoutCommit();
+	TestSlotsAreAligned();
+	TestConcurrentProducerAndConsumer();
+	TEST_MAIN_END();
+}
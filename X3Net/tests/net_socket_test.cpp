@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include "net_socket.h"
+#include "net_ring.h"
+#include "net_packets.h"
+#include "test.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace x3::net;
+
+static void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+	closesocket(socket);
+#else
+	close(socket);
+#endif
+}
+
+static SocketHandle OpenLoopback(uint16_t& port)
+{
+	SocketHandle socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	bind(socket, (sockaddr*)&address, sizeof(address));
+	socklen_t length = sizeof(address);
+	getsockname(socket, (sockaddr*)&address, &length);
+	port = ntohs(address.sin_port);
+#ifdef _WIN32
+	u_long mode = 1;
+	ioctlsocket(socket, FIONBIO, &mode);
+#else
+	fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	return socket;
+}
+
+static void TestWaitTimesOut()
+{
+	uint16_t port;
+	SocketHandle socket = OpenLoopback(port);
+	auto start = std::chrono::steady_clock::now();
+	CHECK(WaitReadable(socket, 50) == WaitResult::Timeout);
+	auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	CHECK(waited >= 45);
+	CloseSocket(socket);
+}
+
+// Once the socket is closed every wait fails; the loop has to sleep between
+// them instead of burning a core until the running flag is cleared
+static void TestLoopBacksOffOnError()
+{
+	uint16_t port;
+	SocketHandle socket = OpenLoopback(port);
+	CloseSocket(socket);
+	CHECK(WaitReadable(socket, 50) == WaitResult::Error);
+
+	PacketSignal signal;
+	std::atomic<bool> running{ true };
+	int receives = 0;
+	std::clock_t cpuStart = std::clock();
+	std::thread network([&]() {
+		RunReceiveLoop(socket, running, signal, 100, [&]() { receives++; return true; });
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	running = false;
+	network.join();
+	double cpuMs = 1000.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+	std::printf("receive loop on a closed socket: %.1f ms of CPU in 300 ms\n", cpuMs);
+	CHECK(receives == 0);
+	CHECK(cpuMs < 100.0);
+}
+
+static void TestSignalIsNotLost()
+{
+	PacketSignal signal;
+	signal.Notify();
+	signal.Notify();
+	// Both notifications wake one wait, the next one times out
+	CHECK(signal.WaitUntil(std::chrono::steady_clock::now() + std::chrono::seconds(1)));
+	CHECK(!signal.WaitUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(10)));
+}
+
+// The client's pipeline over loopback: RunReceiveLoop blocks on the socket,
+// receives into the ring and signals; the consumer blocks on the signal. Every
+// packet has to reach the consumer well within one of the old 10 + 20 ms sleeps.
+static void TestLoopbackLatency()
+{
+	uint16_t serverPort, clientPort;
+	SocketHandle server = OpenLoopback(serverPort);
+	SocketHandle client = OpenLoopback(clientPort);
+	static PacketRing<sizeof(ShipUpdate), 64> ring;
+	PacketSignal signal;
+	std::atomic<bool> running{ true };
+
+	std::thread network([&]() {
+		RunReceiveLoop(client, running, signal, 100, [&]() {
+			bool received = false;
+			while (void* slot = ring.Reserve())
+			{
+				int length = (int)recv(client, (char*)slot, (int)ring.MaxPacketSize(), 0);
+				if (length < 0)
+					break;
+				ring.Commit((size_t)length);
+				received = true;
+			}
+			return received;
+		});
+	});
+
+	sockaddr_in to = {};
+	to.sin_family = AF_INET;
+	to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	to.sin_port = htons(clientPort);
+
+	const uint32_t count = 200;
+	std::vector<double> latencies;
+	uint32_t received = 0;
+	for (uint32_t i = 1; i <= count; i++)
+	{
+		ShipUpdate update;
+		update.type = PacketType::ShipUpdate;
+		update.Sequence = i;
+		auto sent = std::chrono::steady_clock::now();
+		sendto(server, (const char*)&update, sizeof(update), 0, (sockaddr*)&to, sizeof(to));
+
+		bool arrived = false;
+		auto deadline = sent + std::chrono::seconds(1);
+		while (!arrived && std::chrono::steady_clock::now() < deadline)
+		{
+			signal.WaitUntil(deadline);
+			while (ShipUpdate* packet = (ShipUpdate*)ring.Front())
+			{
+				arrived = arrived || packet->Sequence == i;
+				received++;
+				ring.Pop();
+			}
+		}
+		latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+	}
+	running = false;
+	network.join();
+	CloseSocket(server);
+	CloseSocket(client);
+
+	std::sort(latencies.begin(), latencies.end());
+	double median = latencies[latencies.size() / 2];
+	std::printf("loopback send to consumer: median %.3f ms, max %.3f ms\n", median, latencies.back());
+	CHECK(received == count);
+	CHECK(median < 5.0);
+}
+
+int main()
+{
+	TestWaitTimesOut();
+	TestSignalIsNotLost();
+	TestLoopBacksOffOnError();
+	TestLoopbackLatency();
+	TEST_MAIN_END();
+}
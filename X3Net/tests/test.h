@@ -0,0 +1,18 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal check macros for the X3Net tests; a failed check reports and
+// makes the test binary exit non-zero, which is all ctest needs.
+static int g_testFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); g_testFailures++; } } while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+	do { double a_ = (double)(a), b_ = (double)(b); if (std::fabs(a_ - b_) > (tolerance)) { \
+		std::printf("%s:%d: CHECK_NEAR(%s, %s) failed: %g vs %g\n", __FILE__, __LINE__, #a, #b, a_, b_); g_testFailures++; } } while (0)
+
+#define TEST_MAIN_END() \
+	do { if (g_testFailures) { std::printf("%d check(s) failed\n", g_testFailures); return EXIT_FAILURE; } std::printf("all checks passed\n"); return EXIT_SUCCESS; } while (0)